@@ -28,6 +28,15 @@ public:
         return *this;
     }
 
+    /// @brief Updates the state by hashing the raw bytes of a buffer (e.g.,
+    /// to fingerprint the contents of a file).
+    fnv1a &update(const void *data, size_t size) {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        for (size_t pos = 0; pos < size; pos++)
+            hash = (hash ^ bytes[pos]) * 0x100000001b3;
+        return *this;
+    }
+
     /// @brief Returns the current state of the hash function.
     operator uint64_t() { return hash; }
 };
@@ -7,6 +7,7 @@
 
 #include <lightwave/core.hpp>
 #include <lightwave/shape.hpp>
+#include <lightwave/transform.hpp>
 
 namespace lightwave {
 
@@ -44,16 +45,40 @@ class Instance : public Shape {
     ref<Texture> m_normal;
     /// @brief The optional texture that you should randomly dismiss an intersection
     /// based on the alpha values. 
+    /// @note Triangle meshes handle the mask themselves (see applyAlphaMask()),
+    /// in which case this is null.
     ref<Texture> m_alpha;
     /// @brief Tracks whether this instance has been added to the scene, i.e.,
     /// could be hit by ray tracing.
     bool m_visible;
     /// @brief volume of the instance
     ref<Volume> m_volume;
+    /**
+     * @brief Whether m_transform is affine, in which case it is applied
+     * through the precomputed m_objectToWorld and m_worldToObject instead
+     * (which saves a good part of the cost of moving rays into the instance).
+     */
+    bool m_isAffine;
+    /// @brief m_transform as affine transform (if m_isAffine is set).
+    AffineTransform m_objectToWorld;
+    /// @brief The inverse of m_transform as affine transform (if m_isAffine
+    /// is set).
+    AffineTransform m_worldToObject;
 
     /// @brief Transforms the frame from object coordinates to world
     /// coordinates.
     inline void transformFrame(SurfaceEvent &surf, const Vector &wo) const;
+    /// @brief Moves a ray from world coordinates into object coordinates
+    /// (without normalizing it).
+    inline Ray toObject(const Ray &worldRay) const;
+    /**
+     * @brief Moves the rays of a packet from world coordinates into object
+     * coordinates (normalizing them).
+     * @param scale Receives the factor by which distances along each ray grow
+     * in object coordinates.
+     */
+    void toObject(const RayPacket &worldPacket, RayPacket::Mask active,
+                  RayPacket &localPacket, float *scale) const;
 
 public:
     Instance(const Properties &properties) : m_light(nullptr) {
@@ -64,7 +89,13 @@ public:
         m_normal    = properties.get<Texture>("normal", nullptr); // newly added for shading normal
         m_alpha     = properties.get<Texture>("alpha", nullptr); // newly added for alpha masking
         m_volume    = properties.getOptionalChild<Volume>();
+        applyAlphaMask();
         m_visible = false;
+        m_isAffine  = m_transform && m_transform->isAffine();
+        if (m_isAffine) {
+            m_objectToWorld = m_transform->affine();
+            m_worldToObject = m_transform->affineInverse();
+        }
         // std::cout << "transform: " << m_transform << std::endl;
     }
 
@@ -99,6 +130,28 @@ public:
 
     Transform* getTransform() const { return m_transform.get(); } // newly added
 
+    /**
+     * @brief Whether the shape can be merged with other shapes in world
+     * coordinates (see @ref completeHit ). This requires that the transform
+     * (if any) is affine, and that there is no alpha mask or volume, which
+     * rely on intersecting the shape on its own.
+     */
+    bool canBeFlattened() const {
+        return (!m_transform || m_isAffine) && !m_alpha && !m_volume;
+    }
+    /// @brief The transform from object to world coordinates as affine
+    /// transform (only valid if @ref canBeFlattened ).
+    const AffineTransform &objectToWorld() const { return m_objectToWorld; }
+
+    /**
+     * @brief Completes a hit of the shape that has been found outside of the
+     * instance (e.g., by a mesh that merges the shapes of many instances):
+     * moves the surface details from object to world coordinates and binds
+     * the hit to this instance, as if intersect() had found it.
+     * @param its The hit, with @c its.t already in world coordinates.
+     */
+    void completeHit(Intersection &its) const;
+
     /**
      * @brief Intersects the instance with a given ray in world coordinates.
      * @param ray The ray to intersect the shape with in world coordinates.
@@ -110,6 +163,25 @@ public:
      */
     bool intersect(const Ray &ray, Intersection &its,
                    Sampler &rng) const override;
+    /**
+     * @brief Tests whether the instance is hit by a given ray in world
+     * coordinates closer than @c tMax .
+     * @note Instances with alpha masks or volumes need the details of the hit
+     * and hence fall back to a full intersection.
+     */
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const override;
+    /**
+     * @brief Intersects the instance with a packet of rays in world
+     * coordinates, which are moved into object coordinates together.
+     * @note Instances with alpha masks or volumes intersect the rays one by
+     * one.
+     */
+    RayPacket::Mask intersect(const RayPacket &packet, RayPacket::Mask active,
+                              Intersection *its) const override;
+    /// @brief Tests which rays of a packet in world coordinates hit the
+    /// instance closer than their respective @c tMax .
+    RayPacket::Mask occluded(const RayPacket &packet, RayPacket::Mask active,
+                             const float *tMax) const override;
     /// @brief Returns the bounding box of the instance in world coordinates.
     Bounds getBoundingBox() const override;
     /// @brief Returns the centroid of the instance in world coordinates.
@@ -141,6 +213,12 @@ public:
     }
 private:
     bool checkTransparent(const Intersection &its, Sampler &rng) const;
+    /**
+     * @brief Hands the alpha mask over to the shape if it is a triangle mesh,
+     * which can skip fully transparent triangles during traversal and only
+     * looks up the mask for partially transparent ones.
+     */
+    void applyAlphaMask();
 };
 
 } // namespace lightwave
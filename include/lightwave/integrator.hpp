@@ -12,8 +12,13 @@
 #include <lightwave/sampler.hpp>
 #include <lightwave/scene.hpp>
 
+#include <cstdlib>
+#include <string>
+
 namespace lightwave {
 
+struct Checkpoint;
+
 /**
  * @brief Integrators are rendering algorithms that take a scene and produce an
  * image from them (e.g., using path tracing). The term integrator refers to the
@@ -39,12 +44,161 @@ protected:
     ref<Image> m_image;
     /// @brief The scene that should be rendered.
     ref<Scene> m_scene;
+    /**
+     * @brief Whether the camera rays of blocks of PacketSize x PacketSize
+     * pixels are traced together as a @ref RayPacket (see the packet version
+     * of @ref Li ), which integrators that can make use of this enable.
+     */
+    bool m_tracePackets = false;
+
+    /// @brief The width and height of the blocks of pixels whose camera rays
+    /// form a packet.
+    static constexpr int PacketSize = 8;
+    static_assert(PacketSize * PacketSize <= RayPacket::MaxSize);
+
+    /**
+     * @brief Whether the image is rendered in passes of m_samplesPerPass
+     * samples over the whole image, until either the samples per pixel of
+     * m_sampler are reached or m_timeBudget runs out. Otherwise, the image is
+     * rendered block by block, with all samples of a pixel at once.
+     */
+    bool m_progressive;
+    /// @brief The wall-clock time in seconds that progressive rendering may
+    /// take (or zero for no limit).
+    float m_timeBudget;
+    /// @brief The samples per pixel that each progressive pass adds.
+    int m_samplesPerPass;
+
+    /**
+     * @brief Whether the samples per pixel of m_sampler are only an upper
+     * bound, and tiles of AdaptiveTileSize x AdaptiveTileSize pixels stop
+     * receiving samples once the relative standard error of their pixels
+     * drops below m_errorThreshold (or m_timeBudget runs out). The number of
+     * samples taken per pixel is saved as an additional image, whose id is
+     * that of m_image followed by "_spp".
+     */
+    bool m_adaptive;
+    /// @brief The mean relative standard error of the pixels of a tile at
+    /// which adaptive sampling considers the tile converged.
+    float m_errorThreshold;
+    /// @brief The samples per pixel that every tile receives before adaptive
+    /// sampling estimates its error.
+    int m_minSamples;
+
+    /// @brief The width and height of the tiles that adaptive sampling
+    /// decides to refine or not.
+    static constexpr int AdaptiveTileSize = 16;
+
+    /**
+     * @brief The wall-clock time in seconds between checkpoints, which save
+     * the progress of the render next to the image (as
+     * "<image id>.checkpoint"), or zero for no checkpoints. Renders that
+     * stop early due to m_timeBudget also save a checkpoint.
+     */
+    float m_checkpointInterval;
+    /// @brief Whether rendering continues from the checkpoint of a previous
+    /// run (if there is one).
+    bool m_resume;
+
+    /**
+     * @brief If non-zero, the port on which this process hands out blocks of
+     * the image to worker processes (set via LIGHTWAVE_COORDINATOR), besides
+     * rendering blocks itself. Only supported when rendering block by block.
+     */
+    int m_coordinatorPort;
+    /**
+     * @brief If not empty, the "host:port" of a coordinator that this process
+     * renders blocks for (set via LIGHTWAVE_WORKER), instead of rendering and
+     * saving the image itself. Workers need to load the same scene as the
+     * coordinator.
+     */
+    std::string m_workerAddress;
+
+    /// @brief Renders the image block by block.
+    /// @return Whether all samples of all pixels were taken.
+    bool renderBlocks();
+    /// @brief Renders blocks handed out by a coordinator, see
+    /// m_workerAddress.
+    void renderWorker();
+    /// @brief Renders the image in progressive passes, see m_progressive.
+    /// @return Whether all samples of all pixels were taken.
+    bool renderProgressive();
+    /// @brief Renders the image with adaptive sample counts, see m_adaptive.
+    /// @return Whether all tiles have converged.
+    bool renderAdaptive();
+
+    /// @brief A hash of the scene files this integrator was defined in, see
+    /// Properties::sourceHash().
+    uint64_t m_sourceHash;
+    /**
+     * @brief Identifies the render across runs and processes, by the scene
+     * files, the type of integrator, and the id, resolution, and sample count
+     * of the image.
+     */
+    uint64_t renderKey() const;
+    /// @brief The file checkpoints of the render are written to.
+    std::filesystem::path checkpointPath() const;
+    /**
+     * @brief Replaces the empty checkpoint of a render with the one of a
+     * previous run, if m_resume is set and there is one.
+     * @return Whether a previous checkpoint was loaded.
+     */
+    bool resumeCheckpoint(Checkpoint &checkpoint) const;
+    /**
+     * @brief Adds the radiance of the samples @c firstSample to
+     * @c firstSample + @c sampleCount - 1 of every pixel of a block to
+     * @c sums (which leaves dividing by the number of samples to the caller).
+     * @param squares If given, receives the sums of the squared radiance
+     * samples (for estimating the variance of pixels).
+     */
+    void renderSamples(const Bounds2i &block, int firstSample, int sampleCount,
+                       Image &sums, Image *squares = nullptr);
+    /// @brief Renders samples of a block in packets of camera rays, see
+    /// renderSamples().
+    void renderPackets(const Bounds2i &block, int firstSample, int sampleCount,
+                       Image &sums, Image *squares);
 
 public:
     SamplingIntegrator(const Properties &properties) : Integrator(properties) {
         m_sampler = properties.getChild<Sampler>();
         m_image   = properties.getOptionalChild<Image>();
         m_scene   = properties.getChild<Scene>();
+
+        m_sourceHash = properties.sourceHash();
+
+        m_timeBudget     = properties.get<float>("timeBudget", 0);
+        m_progressive    = properties.get<bool>("progressive", m_timeBudget > 0);
+        m_samplesPerPass = properties.get<int>("samplesPerPass", 1);
+        if (m_samplesPerPass < 1) {
+            lightwave_throw("samplesPerPass must be at least 1");
+        }
+
+        m_adaptive       = properties.get<bool>("adaptive", false);
+        m_errorThreshold = properties.get<float>("errorThreshold", 0.05f);
+        m_minSamples     = properties.get<int>(
+            "minSamples", std::max(4, m_sampler->samplesPerPixel() / 16));
+        if (m_minSamples < 2) {
+            lightwave_throw("minSamples must be at least 2");
+        }
+
+        // like BVH caches, checkpoints can be enabled for all renders at once
+        const char *interval = std::getenv("LIGHTWAVE_CHECKPOINT_INTERVAL");
+        const char *resume   = std::getenv("LIGHTWAVE_RESUME");
+        m_checkpointInterval = properties.get<float>(
+            "checkpointInterval", interval ? float(std::atof(interval)) : 0);
+        m_resume =
+            properties.get<bool>("resume", resume && std::atoi(resume) != 0);
+
+        // distributed rendering is set up per process rather than per scene
+        const char *coordinator = std::getenv("LIGHTWAVE_COORDINATOR");
+        const char *worker      = std::getenv("LIGHTWAVE_WORKER");
+        m_coordinatorPort       = coordinator ? std::atoi(coordinator) : 0;
+        m_workerAddress         = worker ? worker : "";
+        if ((m_coordinatorPort > 0 || !m_workerAddress.empty()) &&
+            (m_progressive || m_adaptive)) {
+            lightwave_throw("distributed rendering is only supported when "
+                            "rendering block by block");
+        }
     }
 
     /// @brief Sets the output image that should be populated by rendering.
@@ -71,6 +225,19 @@ public:
      * @ref execute function of the integrator.
      */
     virtual Color Li(const Ray &ray, Sampler &rng) = 0;
+
+    /**
+     * @brief Returns (estimates of) the incident radiance for a packet of
+     * camera rays, each of which comes with its own random number generator.
+     * This is only used if @ref m_tracePackets is set, and allows integrators
+     * to find the first hits of all rays at once (see the packet version of
+     * @ref Scene::intersect ). By default, @ref Li is invoked for each ray.
+     * @param result Receives the radiance of each ray.
+     */
+    virtual void Li(const RayPacket &packet, Color *result) {
+        for (int i = 0; i < packet.size; i++)
+            result[i] = Li(packet.rays[i], *packet.rng[i]);
+    }
 };
 
 } // namespace lightwave
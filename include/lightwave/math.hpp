@@ -11,7 +11,9 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cmath>
+#include <cstdint>
 #include <optional>
 
 namespace lightwave {
@@ -778,6 +780,13 @@ struct Ray {
     /// @brief The number of bounces encountered by the ray, for use in
     /// integrators.
     int depth = 0;
+    /**
+     * @brief Whether the ray only tests for occlusion. Shapes that cannot
+     * answer this directly forward such rays to @ref Shape::intersect (see
+     * @ref Shape::occluded ), and the flag keeps telling them apart from
+     * camera and indirect rays there.
+     */
+    bool shadow = false;
 
     Ray() {}
     Ray(Point origin, Vector direction, int depth = 0)
@@ -789,7 +798,49 @@ struct Ray {
     /// @brief Returns a copy of the ray with normalized direction vector
     /// (useful after applying transforms).
     Ray normalized() const {
-        return Ray(origin, direction.normalized(), depth);
+        Ray result(*this);
+        result.direction = direction.normalized();
+        return result;
+    }
+};
+
+/**
+ * @brief A group of rays that are traced together, e.g., the camera rays of a
+ * small block of pixels. Such rays take similar paths through the scene, so
+ * acceleration structures can traverse them at once and share the cost of
+ * visiting each node among them (see @ref Shape::intersect ).
+ */
+struct RayPacket {
+    /// @brief The maximum number of rays in a packet (8x8 pixels).
+    static constexpr int MaxSize = 64;
+    /// @brief A bit mask selecting rays of a packet, with bit @c i
+    /// corresponding to the ray at index @c i .
+    typedef uint64_t Mask;
+
+    /// @brief The number of rays in the packet.
+    int size = 0;
+    /// @brief The rays of the packet.
+    Ray rays[MaxSize];
+    /**
+     * @brief The random number generator of each ray. Every ray keeps its own,
+     * so that its result does not depend on which other rays it is traced
+     * together with.
+     */
+    Sampler *rng[MaxSize];
+
+    /// @brief Returns a mask selecting all rays of the packet.
+    Mask all() const {
+        return size == MaxSize ? ~Mask(0) : (Mask(1) << size) - 1;
+    }
+
+    /// @brief Calls @c function with the index of every ray selected by
+    /// @c mask .
+    template <typename Function>
+    static void forEach(Mask mask, Function &&function) {
+        while (mask) {
+            function(std::countr_zero(mask));
+            mask &= mask - 1;
+        }
     }
 };
 
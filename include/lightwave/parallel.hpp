@@ -5,8 +5,17 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <type_traits>
+#include <vector>
 
 #include <lightwave/color.hpp>
 #include <lightwave/logger.hpp>
@@ -19,8 +28,151 @@
 
 namespace lightwave {
 
+/**
+ * @brief A pool of persistent worker threads that schedules tasks by work
+ * stealing. Rendering, scene parsing and BVH construction all share the
+ * process-wide pool returned by global(), instead of creating threads of
+ * their own.
+ *
+ * Every worker owns a double-ended queue of tasks: it pushes and pops the
+ * tasks it submits itself at the back (so that nested work stays in its
+ * caches), while idle workers steal from the front of the queues of others.
+ * Tasks submitted from threads outside of the pool are run in the order they
+ * were submitted.
+ */
+class ThreadPool {
+public:
+    /// @brief A unit of work (which must not throw, see async() otherwise).
+    typedef std::function<void()> Task;
+
+    /**
+     * @brief Starts the workers of the pool.
+     * @param numThreads The number of workers (at least one).
+     * @param pinThreads Whether worker @c i only runs on core @c i (modulo
+     * the number of cores), which is only supported on Linux.
+     */
+    ThreadPool(int numThreads, bool pinThreads = false);
+    /// @brief Stops the workers, dismissing tasks that have not started yet.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &)            = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief Returns the pool shared by the whole process. Its size defaults
+     * to the number of cores, and can be set with the @c LIGHTWAVE_THREADS
+     * environment variable. Setting @c LIGHTWAVE_PIN_THREADS to 1 pins the
+     * workers to cores.
+     */
+    static ThreadPool &global();
+
+    /// @brief Returns the number of workers.
+    int numThreads() const { return int(m_workers.size()); }
+    /// @brief Returns whether the calling thread is a worker of this pool.
+    bool isWorker() const;
+
+    /// @brief Queues a task to be run by one of the workers.
+    void submit(Task task);
+
+    /// @brief Queues a function to be run by one of the workers, and returns
+    /// a future that receives its result (or the exception it threw).
+    template <class Function>
+    auto async(Function function)
+        -> std::future<std::invoke_result_t<Function>> {
+        typedef std::invoke_result_t<Function> Result;
+        auto task = std::make_shared<std::packaged_task<Result()>>(
+            std::move(function));
+        std::future<Result> result = task->get_future();
+        submit([task]() { (*task)(); });
+        return result;
+    }
+
+    /**
+     * @brief Invokes @c f for every index from 0 to @c count - 1 in parallel,
+     * and returns once all invocations are done. Workers claim @c grainSize
+     * indices at a time in increasing order, so that indices are started
+     * roughly in order. Workers that call this take part in the loop, which
+     * makes nesting loops safe.
+     * @note If an invocation throws, indices that have not started yet are
+     * skipped, and the first exception is rethrown to the caller.
+     */
+    template <class Function>
+    void parallelFor(int64_t count, Function f, int64_t grainSize = 1) {
+        if (count <= 0)
+            return;
+
+        struct Loop {
+            std::atomic<int64_t> next { 0 };
+            std::atomic<int64_t> finished { 0 };
+            std::atomic<bool> failed { false };
+            std::exception_ptr error;
+        };
+        const auto loop = std::make_shared<Loop>();
+        // helpers that only start after the loop has finished claim no
+        // indices, and hence never touch f
+        const auto work = [loop, &f, count, grainSize]() {
+            while (true) {
+                const int64_t begin = loop->next.fetch_add(grainSize);
+                if (begin >= count)
+                    return;
+                const int64_t end = std::min(begin + grainSize, count);
+                if (!loop->failed) {
+                    try {
+                        for (int64_t i = begin; i < end; i++)
+                            f(i);
+                    } catch (...) {
+                        if (!loop->failed.exchange(true))
+                            loop->error = std::current_exception();
+                    }
+                }
+                if (loop->finished.fetch_add(end - begin) + (end - begin) ==
+                    count)
+                    loop->finished.notify_all();
+            }
+        };
+
+        // outside of the pool, the caller only waits (as it would otherwise
+        // compete with the workers for cores)
+        const bool participate = isWorker();
+        const int64_t chunks   = (count + grainSize - 1) / grainSize;
+        const int64_t helpers  = std::min<int64_t>(
+            participate ? numThreads() - 1 : numThreads(),
+            participate ? chunks - 1 : chunks);
+        for (int64_t i = 0; i < helpers; i++)
+            submit(work);
+        if (participate)
+            work();
+
+        for (int64_t done; (done = loop->finished.load()) < count;)
+            loop->finished.wait(done);
+        if (loop->failed)
+            std::rethrow_exception(loop->error);
+    }
+
+private:
+    struct Worker;
+
+    /// @brief The workers, each with its own queue of tasks.
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    /// @brief The queue of tasks submitted from outside of the pool.
+    std::deque<Task> m_external;
+    std::mutex m_externalLock;
+    /// @brief The number of tasks in all queues.
+    std::atomic<int64_t> m_queued;
+    /// @brief Guards idle workers going to sleep, see m_wakeup.
+    std::mutex m_sleepLock;
+    std::condition_variable m_wakeup;
+    bool m_stop;
+
+    /// @brief Takes a task for a worker: first from its own queue, then from
+    /// the tasks submitted from outside, and then from the other workers.
+    bool take(int index, Task &task);
+    /// @brief The loop run by each worker.
+    void run(int index, bool pin);
+};
+
 /// @brief Invokes @c f for each element of the iterator, parallelized across
-/// all available cores.
+/// all available cores (using @ref ThreadPool::global ).
 template <class ForwardIt, class UnaryFunction>
 void for_each_parallel(ForwardIt first, ForwardIt last, UnaryFunction f) {
 #ifdef SINGLE_THREADED
@@ -28,37 +180,13 @@ void for_each_parallel(ForwardIt first, ForwardIt last, UnaryFunction f) {
     return;
 #endif
 
-    std::mutex m_lock;
-
-    const int numThreads = std::thread::hardware_concurrency();
-    std::vector<std::thread> m_threads;
-    m_threads.reserve(numThreads);
-
-    // build a thread pool
-    for (int i = 0; i < numThreads; i++) {
-        m_threads.emplace_back([&]() {
-            while (true) {
-                m_lock.lock();
-                if (!(first != last)) {
-                    // no more work to do
-                    m_lock.unlock();
-                    break;
-                }
-
-                // grab a work item
-                auto obj = *first;
-                ++first;
-                m_lock.unlock();
-
-                // execute the work item
-                f(obj);
-            }
-        });
-    }
-
-    // wait until all threads have finished
-    for (auto &thread : m_threads)
-        thread.join();
+    // collecting the items first lets the workers claim them by index, which
+    // needs no lock (and keeps the order of the items)
+    std::vector<std::decay_t<decltype(*first)>> items;
+    for (; first != last; ++first)
+        items.push_back(*first);
+    ThreadPool::global().parallelFor(int64_t(items.size()),
+                                     [&](int64_t i) { f(items[i]); });
 }
 
 /// @brief Invokes @c f for each element of the iterator, parallelized across
@@ -69,6 +69,9 @@ class Properties {
      * directory of the included file.
      */
     std::filesystem::path m_basePath;
+    /// @brief A hash of the contents of the scene files that were parsed
+    /// until the end of the node (see sourceHash()).
+    uint64_t m_sourceHash = 0;
     /// @brief The attributes associated with the node.
     std::map<std::string, Value> m_attributes;
     /// @brief The children associated with the node.
@@ -108,6 +111,16 @@ public:
      */
     std::filesystem::path basePath() const { return m_basePath; }
 
+    /**
+     * @brief Returns a hash of the contents of the scene files that were
+     * parsed until the end of the node, which covers the node itself and all
+     * files it includes. This allows recognizing whether results of a
+     * previous run (e.g., render checkpoints) belong to the same scene.
+     */
+    uint64_t sourceHash() const { return m_sourceHash; }
+    /// @brief Sets the hash returned by sourceHash().
+    void setSourceHash(uint64_t hash) { m_sourceHash = hash; }
+
     /**
      * @brief Registers an object as child of the node.
      * @param needsQuery If false, disables the "unqueried" warning for this
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <lightwave/core.hpp>
+#include <lightwave/math.hpp>
 #include <vector>
 
 namespace lightwave {
@@ -60,6 +61,19 @@ public:
     /// @brief Reports whether any intersection up to a given maximal distance
     /// exists (used for testing visibility of light sources).
     bool intersect(const Ray &ray, float tMax, Sampler &rng) const;
+    /**
+     * @brief Finds the closest intersection of the scene for every ray of a
+     * packet at once (which is considerably cheaper for coherent rays, such
+     * as the camera rays of neighboring pixels).
+     * @param its Receives the intersection of each ray.
+     */
+    void intersect(const RayPacket &packet, Intersection *its) const;
+    /**
+     * @brief Reports which rays of a packet (of those selected by @c active )
+     * have any intersection up to their respective maximal distance.
+     */
+    RayPacket::Mask intersect(const RayPacket &packet, RayPacket::Mask active,
+                              const float *tMax) const;
     
     /// @brief Reports whether at least one light exists that could be sampled.
     bool hasLights() const;
@@ -45,8 +45,66 @@ public:
      */
     virtual bool intersect(const Ray &ray, Intersection &its,
                            Sampler &rng) const = 0;
+    /**
+     * @brief Tests whether the shape is hit by a ray closer than @c tMax ,
+     * without computing any details about the hit (used for shadow rays).
+     * @note The default implementation performs a full intersection, shapes
+     * can override this to exit early and skip computing surface details.
+     */
+    virtual bool occluded(const Ray &ray, float tMax, Sampler &rng) const {
+        Ray shadowRay    = ray;
+        shadowRay.shadow = true;
+        Intersection its(-ray.direction, tMax);
+        return intersect(shadowRay, its, rng);
+    }
+    /**
+     * @brief Tests the shape for intersection with the rays of a packet that
+     * are selected by @c active , updating @c its[i] for every ray @c i that
+     * is hit (see the single ray version above).
+     * @return A bit mask of the rays that have been hit.
+     * @note The default implementation intersects the rays one by one, shapes
+     * with acceleration structures override this to traverse them once for
+     * the whole packet.
+     */
+    virtual RayPacket::Mask intersect(const RayPacket &packet,
+                                      RayPacket::Mask active,
+                                      Intersection *its) const {
+        RayPacket::Mask hit = 0;
+        RayPacket::forEach(active, [&](int i) {
+            if (intersect(packet.rays[i], its[i], *packet.rng[i]))
+                hit |= RayPacket::Mask(1) << i;
+        });
+        return hit;
+    }
+    /**
+     * @brief Tests which of the rays of a packet that are selected by
+     * @c active hit the shape closer than their respective @c tMax[i] .
+     * @return A bit mask of the rays that are occluded.
+     */
+    virtual RayPacket::Mask occluded(const RayPacket &packet,
+                                     RayPacket::Mask active,
+                                     const float *tMax) const {
+        RayPacket::Mask hit = 0;
+        RayPacket::forEach(active, [&](int i) {
+            if (occluded(packet.rays[i], tMax[i], *packet.rng[i]))
+                hit |= RayPacket::Mask(1) << i;
+        });
+        return hit;
+    }
     /// @brief Returns a bounding box that tightly encapsulates the shape.
     virtual Bounds getBoundingBox() const = 0;
+    /**
+     * @brief Returns a bounding box that encapsulates the shape after it has
+     * been transformed (used to bound instances in world coordinates).
+     * @note The default implementation transforms the bounding box of the
+     * whole shape, which is loose for rotated shapes. Shapes with internal
+     * structure can do better by transforming the bounding boxes of their
+     * parts individually.
+     */
+    virtual Bounds getTransformedBoundingBox(
+        const AffineTransform &transform) const {
+        return transform.apply(getBoundingBox());
+    }
     /**
      * @brief Returns the center of the shape, which must lie somewhere within
      * the bounding box of this shape.
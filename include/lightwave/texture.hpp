@@ -10,6 +10,8 @@
 #include <lightwave/core.hpp>
 #include <lightwave/math.hpp>
 
+#include <mutex>
+
 namespace lightwave {
 
 /// @brief Models spatially varying material properties (e.g., images or
@@ -33,6 +35,17 @@ public:
         // interface for scalar values)
         return evaluate(uv).r();
     }
+    /**
+     * @brief Computes bounds on the scalar values within a triangle in
+     * texture coordinates, e.g., to find the triangles of a mesh that an alpha
+     * mask renders fully opaque or fully transparent.
+     * @return Whether bounds could be computed (the default implementation
+     * gives up, and the caller needs to assume that any value can occur).
+     */
+    virtual bool scalarRange(const Point2 &a, const Point2 &b, const Point2 &c,
+                             float &min, float &max) const {
+        return false;
+    }
 };
 
 class ImageTexture : public Texture {
@@ -62,6 +75,11 @@ public:
 
     Color evaluate(const Point2 &uv) const override;
 
+    /// @brief Bounds the scalar values within a triangle by rasterizing it
+    /// over a pyramid of the minimum and maximum texel values.
+    bool scalarRange(const Point2 &a, const Point2 &b, const Point2 &c,
+                     float &min, float &max) const override;
+
     std::string toString() const override {
     return tfm::format(
         "ImageTexture[\n"
@@ -72,6 +90,22 @@ public:
         m_exposure);
     }
 
+private:
+    struct Footprint;
+
+    /**
+     * @brief The minimum and maximum red channel (which scalar() returns) of
+     * blocks of 2^level x 2^level texels, for each level up to a single block
+     * covering the whole image. Only built once scalarRange() is first used.
+     */
+    mutable std::vector<std::vector<std::pair<float, float>>> m_rangePyramid;
+    mutable std::once_flag m_rangePyramidBuilt;
+
+    void buildRangePyramid() const;
+    /// @brief Extends @c min and @c max by the texels of a block of the range
+    /// pyramid that lie within a footprint.
+    void rangeWithin(const Footprint &footprint, int level, int x, int y,
+                     float &min, float &max) const;
     };
 
 } // namespace lightwave
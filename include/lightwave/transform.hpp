@@ -11,6 +11,102 @@
 
 namespace lightwave {
 
+/**
+ * @brief An affine transformation, stored as the upper 3x4 part of a matrix
+ * in homogeneous coordinates. Unlike @ref Transform , applying it needs
+ * neither the last row of the matrix nor a homogeneous divide, which makes it
+ * suitable for hot paths such as moving rays into the coordinate system of an
+ * instance.
+ */
+class AffineTransform {
+    /// @brief The rows of the matrix, with the translation in the last
+    /// column.
+    float m_rows[3][4];
+
+public:
+    /// @brief Constructs the identity transform.
+    AffineTransform() : AffineTransform(Matrix4x4::identity()) {}
+
+    /// @brief Takes the upper 3x4 part of a matrix in homogeneous
+    /// coordinates (the last row is assumed to be @code 0, 0, 0, 1
+    /// @endcode ).
+    explicit AffineTransform(const Matrix4x4 &matrix) {
+        for (int row = 0; row < 3; row++)
+            for (int column = 0; column < 4; column++)
+                m_rows[row][column] = matrix(row, column);
+    }
+
+    /// @brief Transforms the given point.
+    Point apply(const Point &point) const {
+        Point result;
+        for (int row = 0; row < 3; row++)
+            result[row] = m_rows[row][0] * point.x() +
+                          m_rows[row][1] * point.y() +
+                          m_rows[row][2] * point.z() + m_rows[row][3];
+        return result;
+    }
+
+    /// @brief Transforms the given vector.
+    Vector apply(const Vector &vector) const {
+        Vector result;
+        for (int row = 0; row < 3; row++)
+            result[row] = m_rows[row][0] * vector.x() +
+                          m_rows[row][1] * vector.y() +
+                          m_rows[row][2] * vector.z();
+        return result;
+    }
+
+    /**
+     * @brief Transforms the given vector by the transpose of the linear part.
+     * For the inverse of a transform, this is how normals are transformed by
+     * the transform itself (the result will not be normalized).
+     */
+    Vector applyTransposed(const Vector &vector) const {
+        Vector result;
+        for (int column = 0; column < 3; column++)
+            result[column] = m_rows[0][column] * vector.x() +
+                             m_rows[1][column] * vector.y() +
+                             m_rows[2][column] * vector.z();
+        return result;
+    }
+
+    /**
+     * @brief Transforms the given ray.
+     * @warning The ray direction will not be normalized.
+     */
+    Ray apply(const Ray &ray) const {
+        Ray result(ray);
+        result.origin    = apply(ray.origin);
+        result.direction = apply(ray.direction);
+        return result;
+    }
+
+    /**
+     * @brief Returns the bounding box of a transformed bounding box. This is
+     * exactly the bounding box of its eight transformed corners, but instead
+     * of transforming the corners, each matrix entry is applied to whichever
+     * side of the box yields the smaller (or larger) result.
+     */
+    Bounds apply(const Bounds &bounds) const {
+        if (bounds.isUnbounded())
+            return Bounds::full();
+        if (bounds.min().x() > bounds.max().x())
+            return Bounds::empty();
+
+        Point min, max;
+        for (int row = 0; row < 3; row++) {
+            min[row] = max[row] = m_rows[row][3];
+            for (int column = 0; column < 3; column++) {
+                const float a = m_rows[row][column] * bounds.min()[column];
+                const float b = m_rows[row][column] * bounds.max()[column];
+                min[row] += std::min(a, b);
+                max[row] += std::max(a, b);
+            }
+        }
+        return { min, max };
+    }
+};
+
 /**
  * @brief Transfers points or vectors from one coordinate system to another.
  * @note This is an interface to allow time-dependent transforms (e.g., motion
@@ -191,6 +287,21 @@ public:
         m_inverse = m_inverse * matrix;
     }
 
+    /// @brief Returns whether this transform is affine, i.e., can be
+    /// represented by an @ref AffineTransform .
+    bool isAffine() const {
+        return m_transform.row(3) == Vector4(0, 0, 0, 1) &&
+               m_inverse.row(3) == Vector4(0, 0, 0, 1);
+    }
+
+    /// @brief Returns this transform as affine transform, see isAffine().
+    AffineTransform affine() const { return AffineTransform(m_transform); }
+    /// @brief Returns the inverse of this transform as affine transform, see
+    /// isAffine().
+    AffineTransform affineInverse() const {
+        return AffineTransform(m_inverse);
+    }
+
     /// @brief Returns the determinant of this transformation.
     float determinant() const {
         return m_transform.submatrix<3, 3>(0, 0).determinant();
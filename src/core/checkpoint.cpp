@@ -0,0 +1,106 @@
+#include "checkpoint.hpp"
+#include "mappedfile.hpp"
+#include <lightwave/core.hpp>
+#include <lightwave/logger.hpp>
+
+#include <cstring>
+#include <fstream>
+
+namespace lightwave {
+
+/// @brief The header of a checkpoint file, which is followed by the pixels,
+/// squares, and samples, in that order.
+struct CheckpointHeader {
+    char magic[8];
+    uint64_t key;
+    uint32_t mode;
+    int32_t width;
+    int32_t height;
+    int32_t samplesPerPixel;
+    uint64_t squareCount;
+};
+static constexpr char CheckpointMagic[8] = "lw-ckp2";
+
+Checkpoint::Checkpoint(Mode mode, uint64_t key, const Vector2i &resolution,
+                       int samplesPerPixel)
+    : mode(mode), key(key), resolution(resolution),
+      samplesPerPixel(samplesPerPixel) {
+    pixels.resize(resolution.product());
+    if (mode == Mode::Adaptive)
+        squares.resize(resolution.product());
+    samples.resize(resolution.product());
+}
+
+void Checkpoint::save(const std::filesystem::path &file) const {
+    CheckpointHeader header = {};
+    std::memcpy(header.magic, CheckpointMagic, sizeof(CheckpointMagic));
+    header.key             = key;
+    header.mode            = uint32_t(mode);
+    header.width           = resolution.x();
+    header.height          = resolution.y();
+    header.samplesPerPixel = samplesPerPixel;
+    header.squareCount     = squares.size();
+
+    std::filesystem::path temporary = file;
+    temporary += ".tmp";
+
+    std::ofstream stream(temporary, std::ios::binary);
+    const auto write = [&](const auto &list) {
+        stream.write(reinterpret_cast<const char *>(list.data()),
+                     std::streamsize(list.size() * sizeof(list[0])));
+    };
+    stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    write(pixels);
+    write(squares);
+    write(samples);
+    stream.close();
+
+    std::error_code error;
+    if (stream)
+        std::filesystem::rename(temporary, file, error);
+    if (!stream || error) {
+        logger(EWarn, "could not write checkpoint %s", file);
+        std::filesystem::remove(temporary, error);
+    }
+}
+
+std::optional<Checkpoint> Checkpoint::load(const std::filesystem::path &file) {
+    if (!std::filesystem::exists(file))
+        return std::nullopt;
+
+    const MappedFile mapping(file);
+    CheckpointHeader header;
+    if (!mapping || mapping.size() < sizeof(header))
+        lightwave_throw("could not read checkpoint %s", file);
+    std::memcpy(&header, mapping.data(), sizeof(header));
+    if (std::memcmp(header.magic, CheckpointMagic, sizeof(CheckpointMagic)) !=
+            0 ||
+        header.mode > uint32_t(Mode::Adaptive) || header.width <= 0 ||
+        header.height <= 0)
+        lightwave_throw("%s is not a valid checkpoint", file);
+
+    Checkpoint checkpoint(Mode(header.mode),
+                          header.key,
+                          Vector2i(header.width, header.height),
+                          header.samplesPerPixel);
+    const size_t expectedSize =
+        sizeof(header) + checkpoint.pixels.size() * sizeof(Color) +
+        checkpoint.squares.size() * sizeof(Color) +
+        checkpoint.samples.size() * sizeof(int32_t);
+    if (header.squareCount != checkpoint.squares.size() ||
+        mapping.size() != expectedSize)
+        lightwave_throw("checkpoint %s is damaged", file);
+
+    size_t offset   = sizeof(header);
+    const auto read = [&](auto &list) {
+        std::memcpy(list.data(), mapping.data() + offset,
+                    list.size() * sizeof(list[0]));
+        offset += list.size() * sizeof(list[0]);
+    };
+    read(checkpoint.pixels);
+    read(checkpoint.squares);
+    read(checkpoint.samples);
+    return checkpoint;
+}
+
+} // namespace lightwave
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <lightwave/color.hpp>
+#include <lightwave/math.hpp>
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace lightwave {
+
+/**
+ * @brief The progress of a render by a sampling integrator, which is written
+ * to disk periodically so that interrupted renders can be resumed. Since
+ * samplers are seeded by pixel and sample index, the number of samples taken
+ * per pixel fully describes the sampler state, and a resumed render produces
+ * the same image as an uninterrupted one.
+ */
+struct Checkpoint {
+    /// @brief The rendering mode of the integrator, which determines what
+    /// the pixels hold.
+    enum class Mode : uint32_t {
+        /// @brief Pixels of finished blocks hold their final values.
+        Blocks,
+        /// @brief Pixels hold the sums of their samples.
+        Progressive,
+        /// @brief Pixels hold the sums of their samples, and squares the sums
+        /// of their squared samples.
+        Adaptive,
+    };
+
+    Mode mode;
+    /**
+     * @brief Identifies the scene and integrator the checkpoint was written
+     * for (see SamplingIntegrator::renderKey()), so that checkpoints of a
+     * scene that has been edited since are not resumed.
+     */
+    uint64_t key;
+    Vector2i resolution;
+    /// @brief The (maximum) samples per pixel of the render.
+    int samplesPerPixel;
+    /// @brief The pixels of the image in row-major order.
+    std::vector<Color> pixels;
+    /// @brief The sums of the squared samples of each pixel (only used for
+    /// adaptive sampling).
+    std::vector<Color> squares;
+    /// @brief The number of samples each pixel has received.
+    std::vector<int32_t> samples;
+
+    /// @brief Creates the checkpoint of a render that has not started yet.
+    Checkpoint(Mode mode, uint64_t key, const Vector2i &resolution,
+               int samplesPerPixel);
+
+    /// @brief Whether this checkpoint can be resumed by a render with the
+    /// mode, key, resolution, and samples per pixel of @c other .
+    bool matches(const Checkpoint &other) const {
+        return mode == other.mode && key == other.key &&
+               resolution == other.resolution &&
+               samplesPerPixel == other.samplesPerPixel;
+    }
+
+    /**
+     * @brief Writes the checkpoint to a file. The file is written under a
+     * temporary name first, so that a render that is interrupted while
+     * writing leaves the previous checkpoint intact.
+     */
+    void save(const std::filesystem::path &file) const;
+    /**
+     * @brief Reads a checkpoint written by save().
+     * @return Nothing if the file does not exist, and throws if it is not a
+     * valid checkpoint.
+     */
+    static std::optional<Checkpoint> load(const std::filesystem::path &file);
+};
+
+} // namespace lightwave
@@ -0,0 +1,457 @@
+#include "distributed.hpp"
+#include <lightwave/core.hpp>
+#include <lightwave/logger.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifndef LW_OS_WINDOWS
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace lightwave {
+
+TileQueue::TileQueue(int count)
+    : m_states(count, State::Pending), m_remaining(count) {
+    m_pending.resize(count);
+    for (int i = 0; i < count; i++)
+        m_pending[i] = i;
+}
+
+void TileQueue::skip(int tile) {
+    std::lock_guard lock(m_lock);
+    if (m_states[tile] != State::Done) {
+        m_states[tile] = State::Done;
+        m_remaining--;
+    }
+}
+
+std::optional<int> TileQueue::take(Renderer renderer, bool wait) {
+    std::unique_lock lock(m_lock);
+    while (true) {
+        if (m_closed || m_remaining == 0)
+            return std::nullopt;
+
+        while (m_nextPending < m_pending.size()) {
+            const int tile = m_pending[m_nextPending++];
+            // skipped tiles are still listed
+            if (m_states[tile] == State::Pending) {
+                m_states[tile] = renderer == Renderer::Local ? State::Local
+                                                             : State::Remote;
+                return tile;
+            }
+        }
+
+        if (renderer == Renderer::Local) {
+            const auto remote =
+                std::find(m_states.begin(), m_states.end(), State::Remote);
+            if (remote != m_states.end()) {
+                *remote = State::Duplicated;
+                return int(remote - m_states.begin());
+            }
+        }
+
+        if (!wait)
+            return std::nullopt;
+        m_changed.wait(lock);
+    }
+}
+
+bool TileQueue::claim(int tile) {
+    std::lock_guard lock(m_lock);
+    if (m_states[tile] == State::Claimed || m_states[tile] == State::Done)
+        return false;
+    m_states[tile] = State::Claimed;
+    return true;
+}
+
+void TileQueue::complete(int tile) {
+    {
+        std::lock_guard lock(m_lock);
+        m_states[tile] = State::Done;
+        m_remaining--;
+    }
+    m_changed.notify_all();
+}
+
+void TileQueue::release(int tile) {
+    {
+        std::lock_guard lock(m_lock);
+        if (m_states[tile] == State::Remote) {
+            m_states[tile] = State::Pending;
+            m_pending.push_back(tile);
+        } else if (m_states[tile] == State::Duplicated) {
+            // a local thread is already working on it
+            m_states[tile] = State::Local;
+        }
+    }
+    m_changed.notify_all();
+}
+
+void TileQueue::close() {
+    {
+        std::lock_guard lock(m_lock);
+        m_closed = true;
+    }
+    m_changed.notify_all();
+}
+
+bool TileQueue::finished() {
+    std::lock_guard lock(m_lock);
+    return m_closed || m_remaining == 0;
+}
+
+#ifndef LW_OS_WINDOWS
+
+/// @brief Sent by workers when they connect, followed by a reply of a
+/// uint32_t that is non-zero if the worker was accepted.
+struct Hello {
+    char magic[8];
+    uint64_t key;
+};
+static constexpr char HelloMagic[8] = "lw-dist";
+
+/// @brief Sent by workers to request a tile (which is answered by a
+/// TileMessage), or to deliver the pixels of a tile (which follow the
+/// message).
+struct Message {
+    enum Type : uint32_t { Request, Result };
+    uint32_t type;
+    int32_t tile;
+};
+
+/// @brief Sent by the coordinator in reply to a request, with a negative
+/// tile index if no tile is handed out.
+struct TileMessage {
+    /// @brief All tiles are done.
+    static constexpr int32_t NoMoreTiles = -1;
+    /// @brief All remaining tiles are being rendered elsewhere, and the worker
+    /// should ask again later (in case they are returned by another worker).
+    static constexpr int32_t NoTileYet = -2;
+
+    int32_t tile;
+    int32_t min[2];
+    int32_t max[2];
+};
+
+static bool sendAll(int socket, const void *data, size_t size) {
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        const ssize_t sent = ::send(socket, bytes, size, 0);
+        if (sent <= 0)
+            return false;
+        bytes += sent;
+        size -= size_t(sent);
+    }
+    return true;
+}
+
+static bool receiveAll(int socket, void *data, size_t size) {
+    char *bytes = static_cast<char *>(data);
+    while (size > 0) {
+        const ssize_t received = ::recv(socket, bytes, size, 0);
+        if (received <= 0)
+            return false;
+        bytes += received;
+        size -= size_t(received);
+    }
+    return true;
+}
+
+/// @brief Disables batching of small writes, which would delay the replies
+/// to tile requests.
+static void setNoDelay(int socket) {
+    int enabled = 1;
+    ::setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+}
+
+static void ignoreBrokenPipes() {
+    // writing to a closed connection must fail rather than kill the process
+    static std::atomic_flag s_initialized = ATOMIC_FLAG_INIT;
+    if (!s_initialized.test_and_set())
+        signal(SIGPIPE, SIG_IGN);
+}
+
+struct TileCoordinator::Connection {
+    int socket;
+    /// @brief The address of the worker, for logging purposes.
+    std::string peer;
+    std::thread thread;
+};
+
+TileCoordinator::TileCoordinator(uint16_t port, uint64_t key,
+                                 const std::vector<Bounds2i> &tiles,
+                                 TileQueue &queue, Receiver receiver)
+    : m_key(key), m_tiles(tiles), m_queue(queue),
+      m_receiver(std::move(receiver)) {
+    ignoreBrokenPipes();
+
+    m_socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (m_socket < 0)
+        lightwave_throw("could not create socket: %s", ::strerror(errno));
+    int reuse = 1;
+    ::setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port        = htons(port);
+    if (::bind(m_socket, (sockaddr *) &address, sizeof(address)) != 0 ||
+        ::listen(m_socket, 16) != 0) {
+        const std::string error = ::strerror(errno);
+        ::close(m_socket);
+        lightwave_throw("could not listen on port %d: %s", port, error);
+    }
+    socklen_t length = sizeof(address);
+    ::getsockname(m_socket, (sockaddr *) &address, &length);
+    m_port = ntohs(address.sin_port);
+
+    m_acceptor = std::thread([this]() { accept(); });
+}
+
+TileCoordinator::~TileCoordinator() {
+    m_stop = true;
+    m_queue.close();
+    m_acceptor.join();
+    ::close(m_socket);
+
+    // workers may still be rendering tiles that were finished locally, which
+    // are no longer needed
+    std::lock_guard lock(m_connectionsLock);
+    for (auto &connection : m_connections)
+        ::shutdown(connection->socket, SHUT_RDWR);
+    for (auto &connection : m_connections) {
+        connection->thread.join();
+        ::close(connection->socket);
+    }
+}
+
+void TileCoordinator::accept() {
+    while (!m_stop) {
+        pollfd request = { m_socket, POLLIN, 0 };
+        if (::poll(&request, 1, 100) <= 0)
+            continue;
+
+        sockaddr_in address;
+        socklen_t length = sizeof(address);
+        const int socket = ::accept(m_socket, (sockaddr *) &address, &length);
+        if (socket < 0)
+            continue;
+        setNoDelay(socket);
+
+        char host[INET_ADDRSTRLEN] = {};
+        ::inet_ntop(AF_INET, &address.sin_addr, host, sizeof(host));
+
+        std::lock_guard lock(m_connectionsLock);
+        Connection &connection =
+            *m_connections.emplace_back(std::make_unique<Connection>());
+        connection.socket = socket;
+        connection.peer =
+            tfm::format("%s:%d", host, int(ntohs(address.sin_port)));
+        connection.thread =
+            std::thread([this, &connection]() { serve(connection); });
+    }
+}
+
+void TileCoordinator::serve(Connection &connection) {
+    Hello hello;
+    const bool valid =
+        receiveAll(connection.socket, &hello, sizeof(hello)) &&
+        std::memcmp(hello.magic, HelloMagic, sizeof(HelloMagic)) == 0 &&
+        hello.key == m_key;
+    const uint32_t accepted = valid;
+    sendAll(connection.socket, &accepted, sizeof(accepted));
+    if (!valid) {
+        logger(EWarn,
+               "rejected worker %s, which renders a different image",
+               connection.peer);
+        return;
+    }
+    logger(EInfo, "worker %s connected", connection.peer);
+
+    std::vector<int> outstanding;
+    std::vector<Color> pixels;
+    int delivered = 0;
+    Message message;
+    while (receiveAll(connection.socket, &message, sizeof(message))) {
+        if (message.type == Message::Request) {
+            // never wait here, as the tail of the render is covered by local
+            // threads, and the worker might have results to deliver meanwhile
+            TileMessage reply = { TileMessage::NoMoreTiles, {}, {} };
+            if (const auto tile =
+                    m_queue.take(TileQueue::Renderer::Remote, false)) {
+                const Bounds2i &bounds = m_tiles[*tile];
+                reply = { *tile,
+                          { bounds.min().x(), bounds.min().y() },
+                          { bounds.max().x(), bounds.max().y() } };
+                outstanding.push_back(*tile);
+            } else if (!m_queue.finished()) {
+                reply.tile = TileMessage::NoTileYet;
+            }
+            if (!sendAll(connection.socket, &reply, sizeof(reply)))
+                break;
+            continue;
+        }
+
+        const auto it =
+            std::find(outstanding.begin(), outstanding.end(), message.tile);
+        if (message.type != Message::Result || it == outstanding.end()) {
+            logger(EWarn, "invalid message from worker %s", connection.peer);
+            break;
+        }
+        pixels.resize(m_tiles[message.tile].diagonal().product());
+        if (!receiveAll(
+                connection.socket, pixels.data(), pixels.size() * sizeof(Color)))
+            break;
+        outstanding.erase(it);
+        delivered++;
+
+        if (m_queue.claim(message.tile)) {
+            m_receiver(message.tile, pixels);
+            m_queue.complete(message.tile);
+        }
+    }
+
+    for (int tile : outstanding)
+        m_queue.release(tile);
+    logger(EInfo,
+           "worker %s disconnected after delivering %d tiles",
+           connection.peer,
+           delivered);
+}
+
+TileWorker::TileWorker(const std::string &address, uint64_t key)
+    : m_address(address) {
+    ignoreBrokenPipes();
+
+    const size_t separator = address.rfind(':');
+    if (separator == std::string::npos)
+        lightwave_throw("coordinator address \"%s\" lacks a port", address);
+    const std::string host = address.substr(0, separator);
+    const std::string port = address.substr(separator + 1);
+
+    addrinfo hints = {};
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses;
+    if (const int error = ::getaddrinfo(
+            host.c_str(), port.c_str(), &hints, &addresses)) {
+        lightwave_throw("could not resolve coordinator %s: %s",
+                        address,
+                        gai_strerror(error));
+    }
+
+    // the coordinator might still be loading the scene
+    constexpr int MaxAttempts = 120;
+    m_socket                  = -1;
+    for (int attempt = 0; attempt < MaxAttempts && m_socket < 0; attempt++) {
+        if (attempt > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        m_socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (m_socket >= 0 &&
+            ::connect(m_socket, addresses->ai_addr, addresses->ai_addrlen) !=
+                0) {
+            ::close(m_socket);
+            m_socket = -1;
+            if (attempt == 0)
+                logger(EInfo, "waiting for coordinator %s", address);
+        }
+    }
+    freeaddrinfo(addresses);
+    if (m_socket < 0)
+        lightwave_throw("could not connect to coordinator %s", address);
+    setNoDelay(m_socket);
+
+    Hello hello;
+    std::memcpy(hello.magic, HelloMagic, sizeof(HelloMagic));
+    hello.key         = key;
+    uint32_t accepted = 0;
+    if (!sendAll(m_socket, &hello, sizeof(hello)) ||
+        !receiveAll(m_socket, &accepted, sizeof(accepted)) || !accepted) {
+        ::close(m_socket);
+        lightwave_throw("coordinator %s rejected this worker, which renders a "
+                        "different image",
+                        address);
+    }
+}
+
+TileWorker::~TileWorker() { ::close(m_socket); }
+
+bool TileWorker::next(int &tile, Bounds2i &bounds) {
+    TileMessage reply;
+    while (true) {
+        {
+            // other threads may deliver their tiles between attempts
+            std::lock_guard lock(m_lock);
+            if (!m_connected)
+                return false;
+
+            const Message request = { Message::Request, -1 };
+            if (!sendAll(m_socket, &request, sizeof(request)) ||
+                !receiveAll(m_socket, &reply, sizeof(reply))) {
+                logger(EInfo, "coordinator %s closed the connection", m_address);
+                m_connected = false;
+                return false;
+            }
+        }
+        if (reply.tile != TileMessage::NoTileYet)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    if (reply.tile < 0)
+        return false;
+
+    tile   = reply.tile;
+    bounds = Bounds2i(Point2i(reply.min[0], reply.min[1]),
+                      Point2i(reply.max[0], reply.max[1]));
+    return true;
+}
+
+void TileWorker::send(int tile, const std::vector<Color> &pixels) {
+    std::lock_guard lock(m_lock);
+    if (!m_connected)
+        return;
+
+    const Message result = { Message::Result, tile };
+    if (!sendAll(m_socket, &result, sizeof(result)) ||
+        !sendAll(m_socket, pixels.data(), pixels.size() * sizeof(Color))) {
+        logger(EInfo, "coordinator %s closed the connection", m_address);
+        m_connected = false;
+        return;
+    }
+    m_tilesSent++;
+}
+
+#else
+
+TileCoordinator::TileCoordinator(uint16_t port, uint64_t key,
+                                 const std::vector<Bounds2i> &tiles,
+                                 TileQueue &queue, Receiver receiver)
+    : m_key(key), m_tiles(tiles), m_queue(queue), m_port(port) {
+    lightwave_throw("distributed rendering is not supported on this platform");
+}
+
+TileCoordinator::~TileCoordinator() {}
+
+TileWorker::TileWorker(const std::string &address, uint64_t key) {
+    lightwave_throw("distributed rendering is not supported on this platform");
+}
+
+TileWorker::~TileWorker() {}
+
+bool TileWorker::next(int &tile, Bounds2i &bounds) { return false; }
+
+void TileWorker::send(int tile, const std::vector<Color> &pixels) {}
+
+#endif
+
+} // namespace lightwave
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <lightwave/color.hpp>
+#include <lightwave/math.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace lightwave {
+
+/**
+ * @brief The tiles of a render that are still to be done, shared by the
+ * threads of the rendering process and (via a @ref TileCoordinator ) by worker
+ * processes. Once no tiles are pending, local threads also render tiles that
+ * are still out at workers, so that slow or stalled workers do not hold up the
+ * render; whichever copy is finished first is used (both are identical, as
+ * samplers are seeded by pixel and sample index).
+ */
+class TileQueue {
+public:
+    /// @brief Who is rendering a tile.
+    enum class Renderer { Local, Remote };
+
+    /// @brief Creates a queue in which all tiles are pending.
+    explicit TileQueue(int count);
+
+    /// @brief Marks a tile as done before rendering starts (e.g., when it was
+    /// restored from a checkpoint).
+    void skip(int tile);
+
+    /**
+     * @brief Hands out a tile, waiting while all remaining tiles are being
+     * rendered elsewhere (unless @c wait is @c false ).
+     * @return Nothing once all tiles are done (or the queue was closed), or if
+     * no tile is available right now and @c wait is @c false .
+     */
+    std::optional<int> take(Renderer renderer, bool wait = true);
+    /**
+     * @brief Reserves the right to deliver the pixels of a tile, which must be
+     * followed by complete() after the pixels have been stored.
+     * @return @c false if the tile has already been delivered by someone
+     * else.
+     */
+    bool claim(int tile);
+    /// @brief Marks a claimed tile as done.
+    void complete(int tile);
+    /// @brief Returns a tile of a worker that failed to deliver it.
+    void release(int tile);
+    /// @brief Makes all current and future calls to take() return nothing.
+    void close();
+    /// @brief Whether all tiles are done (or the queue was closed).
+    bool finished();
+
+private:
+    enum class State { Pending, Local, Remote, Duplicated, Claimed, Done };
+
+    std::mutex m_lock;
+    std::condition_variable m_changed;
+    std::vector<State> m_states;
+    /// @brief The pending tiles, in the order they are handed out.
+    std::vector<int> m_pending;
+    size_t m_nextPending = 0;
+    /// @brief The tiles that are not done yet.
+    int m_remaining;
+    bool m_closed = false;
+};
+
+/**
+ * @brief Hands out the tiles of a @ref TileQueue to worker processes that
+ * connect via TCP, and receives their pixels. Workers that disconnect return
+ * their unfinished tiles to the queue.
+ */
+class TileCoordinator {
+public:
+    /// @brief Receives the pixels of a tile, in row-major order.
+    using Receiver =
+        std::function<void(int tile, const std::vector<Color> &pixels)>;
+
+    /**
+     * @brief Starts listening for workers on the given port.
+     * @param key Identifies the render, and must match the key of workers
+     * (see @ref TileWorker ).
+     */
+    TileCoordinator(uint16_t port, uint64_t key,
+                    const std::vector<Bounds2i> &tiles, TileQueue &queue,
+                    Receiver receiver);
+    /// @brief Closes the queue and disconnects all workers.
+    ~TileCoordinator();
+
+    /// @brief The port the coordinator listens on, which is chosen by the
+    /// system if @c 0 was requested.
+    uint16_t port() const { return m_port; }
+
+private:
+    struct Connection;
+
+    void accept();
+    void serve(Connection &connection);
+
+    uint64_t m_key;
+    const std::vector<Bounds2i> &m_tiles;
+    TileQueue &m_queue;
+    Receiver m_receiver;
+
+    int m_socket;
+    uint16_t m_port;
+    std::atomic<bool> m_stop = false;
+    std::thread m_acceptor;
+    std::mutex m_connectionsLock;
+    std::vector<std::unique_ptr<Connection>> m_connections;
+};
+
+/**
+ * @brief The connection of a worker process to a @ref TileCoordinator , which
+ * can be used from multiple threads to render several tiles at once.
+ */
+class TileWorker {
+public:
+    /**
+     * @brief Connects to a coordinator given as "host:port", retrying for a
+     * while in case the coordinator is still loading the scene.
+     * @param key Identifies the render, see @ref TileCoordinator .
+     */
+    TileWorker(const std::string &address, uint64_t key);
+    ~TileWorker();
+
+    /// @brief Requests the next tile to render, waiting while all remaining
+    /// tiles are being rendered elsewhere.
+    /// @return @c false once there are no more tiles (or the coordinator has
+    /// gone away).
+    bool next(int &tile, Bounds2i &bounds);
+    /// @brief Sends the pixels of a tile, in row-major order.
+    void send(int tile, const std::vector<Color> &pixels);
+
+    /// @brief The number of tiles that were sent to the coordinator.
+    int tilesSent() const { return m_tilesSent; }
+
+private:
+    std::mutex m_lock;
+    int m_socket;
+    std::string m_address;
+    bool m_connected = true;
+    int m_tilesSent  = 0;
+};
+
+} // namespace lightwave
@@ -4,18 +4,33 @@
 #include <lightwave/sampler.hpp>
 #include <lightwave/warp.hpp> 
 
+#include "../shapes/mesh.hpp"
+
 namespace lightwave {
 
 void Instance::transformFrame(SurfaceEvent &surf, const Vector &wo) const {
-    surf.position       = m_transform->apply(surf.position);
+    if (m_isAffine) {
+        surf.position = m_objectToWorld.apply(surf.position);
+    } else {
+        surf.position = m_transform->apply(surf.position);
+    }
+
+    const auto toWorld = [&](const Vector &vector) {
+        return m_isAffine ? m_objectToWorld.apply(vector)
+                          : m_transform->apply(vector);
+    };
+    const auto normalToWorld = [&](const Vector &normal) {
+        return m_isAffine ? m_worldToObject.applyTransposed(normal)
+                          : m_transform->applyNormal(normal);
+    };
 
     Vector bitangent    = surf.shadingFrame().bitangent;
-    Vector world_tangent= m_transform->apply(surf.tangent);
+    Vector world_tangent= toWorld(surf.tangent);
     // compute the real pA which should be 1/(4pi*r^2) for the sphere, r is the 'scale' in xml
-    surf.pdf            /= world_tangent.cross(m_transform->apply(bitangent)).length();
+    surf.pdf            /= world_tangent.cross(toWorld(bitangent)).length();
     surf.tangent        = world_tangent.normalized();
-    surf.geometryNormal = m_transform->applyNormal(surf.geometryNormal).normalized();
-    surf.shadingNormal  = m_transform->applyNormal(surf.shadingNormal).normalized();
+    surf.geometryNormal = normalToWorld(surf.geometryNormal).normalized();
+    surf.shadingNormal  = normalToWorld(surf.shadingNormal).normalized();
     
     if (m_normal) { // newly added shading normal 
         Vector normalMap = (2.0f * m_normal->evaluate(surf.uv) - Color(1.0f)).data();
@@ -27,6 +42,11 @@ void Instance::transformFrame(SurfaceEvent &surf, const Vector &wo) const {
 
 }
 
+Ray Instance::toObject(const Ray &worldRay) const {
+    return m_isAffine ? m_worldToObject.apply(worldRay)
+                      : m_transform->inverse(worldRay);
+}
+
 inline void validateIntersection(const Intersection &its) {
     // use the following macros to make debugginer easier:
     // * assert_condition(condition, { ... });
@@ -69,6 +89,19 @@ bool Instance::checkTransparent(const Intersection &its, Sampler &rng) const {
     return false;
 }
 
+void Instance::applyAlphaMask() {
+    if (!m_alpha) {
+        return;
+    }
+
+    // besides saving texture lookups, masked meshes let rays continue to the
+    // triangles behind transparent hits
+    if (ref<Shape> masked = alphaMaskedMesh(m_shape, m_alpha)) {
+        m_shape = masked;
+        m_alpha = nullptr;
+    }
+}
+
 bool Instance::intersect(const Ray &worldRay, Intersection &its,
                          Sampler &rng) const {
 
@@ -89,10 +122,11 @@ bool Instance::intersect(const Ray &worldRay, Intersection &its,
     const Intersection oldIts = its;
     const float previousT = its.t;
     //NOT_IMPLEMENTED
-    Ray localRay = m_transform->inverse(worldRay);
+    Ray localRay = toObject(worldRay);
     // its.t = previousT * localRay.direction.length();
-    const float scale = localRay.direction.length();
-    localRay = localRay.normalized();
+    // normalize the direction, remembering how distances are scaled
+    const auto [scale, localDirection] = localRay.direction.lengthAndNormalized();
+    localRay.direction = localDirection;
     its.t = previousT * scale;
     // hints:
     // * transform the ray (do not forget to normalize!)
@@ -146,12 +180,116 @@ bool Instance::intersect(const Ray &worldRay, Intersection &its,
     return wasIntersected;
 }
 
+void Instance::completeHit(Intersection &its) const {
+    its.instance = this;
+    validateIntersection(its);
+    if (m_transform) {
+        transformFrame(its, Vector());
+    }
+}
+
+bool Instance::occluded(const Ray &worldRay, float tMax, Sampler &rng) const {
+    if (m_alpha || m_volume) {
+        // transparency and volumes depend on where exactly the shape is hit
+        return Shape::occluded(worldRay, tMax, rng);
+    }
+
+    if (!m_transform) {
+        // fast path, if no transform is needed
+        return m_shape->occluded(worldRay, tMax, rng);
+    }
+
+    Ray localRay = toObject(worldRay);
+    const auto [scale, localDirection] = localRay.direction.lengthAndNormalized();
+    localRay.direction = localDirection;
+    return m_shape->occluded(localRay, tMax * scale, rng);
+}
+
+void Instance::toObject(const RayPacket &worldPacket, RayPacket::Mask active,
+                        RayPacket &localPacket, float *scale) const {
+    localPacket.size = worldPacket.size;
+    RayPacket::forEach(active, [&](int i) {
+        Ray localRay = toObject(worldPacket.rays[i]);
+        const auto [length, localDirection] =
+            localRay.direction.lengthAndNormalized();
+        localRay.direction  = localDirection;
+        localPacket.rays[i] = localRay;
+        localPacket.rng[i]  = worldPacket.rng[i];
+        scale[i]            = length;
+    });
+}
+
+RayPacket::Mask Instance::intersect(const RayPacket &worldPacket,
+                                    RayPacket::Mask active,
+                                    Intersection *its) const {
+    if (m_alpha || m_volume) {
+        // transparency and volumes depend on where exactly the shape is hit
+        return Shape::intersect(worldPacket, active, its);
+    }
+
+    if (!m_transform) {
+        // fast path, if no transform is needed
+        const RayPacket::Mask hit = m_shape->intersect(worldPacket, active, its);
+        RayPacket::forEach(hit, [&](int i) {
+            its[i].instance = this;
+            validateIntersection(its[i]);
+        });
+        return hit;
+    }
+
+    RayPacket localPacket;
+    float scale[RayPacket::MaxSize], previousT[RayPacket::MaxSize];
+    toObject(worldPacket, active, localPacket, scale);
+    RayPacket::forEach(active, [&](int i) {
+        previousT[i] = its[i].t;
+        its[i].t *= scale[i];
+    });
+
+    const RayPacket::Mask hit = m_shape->intersect(localPacket, active, its);
+    RayPacket::forEach(active & ~hit, [&](int i) { its[i].t = previousT[i]; });
+    RayPacket::forEach(hit, [&](int i) {
+        its[i].instance = this;
+        validateIntersection(its[i]);
+
+        its[i].t /= scale[i];
+        transformFrame(its[i], -localPacket.rays[i].direction);
+    });
+    return hit;
+}
+
+RayPacket::Mask Instance::occluded(const RayPacket &worldPacket,
+                                   RayPacket::Mask active,
+                                   const float *tMax) const {
+    if (m_alpha || m_volume) {
+        // transparency and volumes depend on where exactly the shape is hit
+        return Shape::occluded(worldPacket, active, tMax);
+    }
+
+    if (!m_transform) {
+        // fast path, if no transform is needed
+        return m_shape->occluded(worldPacket, active, tMax);
+    }
+
+    RayPacket localPacket;
+    float scale[RayPacket::MaxSize], localTMax[RayPacket::MaxSize];
+    toObject(worldPacket, active, localPacket, scale);
+    RayPacket::forEach(active,
+                       [&](int i) { localTMax[i] = tMax[i] * scale[i]; });
+    return m_shape->occluded(localPacket, active, localTMax);
+}
+
 Bounds Instance::getBoundingBox() const {
     if (!m_transform) {
         // fast path
         return m_shape->getBoundingBox();
     }
 
+    if (m_isAffine) {
+        // lets the shape tighten the bounds, e.g., by transforming the boxes
+        // of its BVH nodes
+        return m_shape->getTransformedBoundingBox(m_objectToWorld);
+    }
+
     const Bounds untransformedAABB = m_shape->getBoundingBox();
     if (untransformedAABB.isUnbounded()) {
         return Bounds::full();
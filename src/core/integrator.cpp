@@ -1,13 +1,19 @@
 #include <lightwave/camera.hpp>
+#include <lightwave/hash.hpp>
 #include <lightwave/integrator.hpp>
 #include <lightwave/parallel.hpp>
 
 #include <algorithm>
 #include <chrono>
+#include <mutex>
+#include <typeinfo>
 
 #include <lightwave/iterators.hpp>
 #include <lightwave/streaming.hpp>
 
+#include "checkpoint.hpp"
+#include "distributed.hpp"
+
 namespace lightwave {
 
 void SamplingIntegrator::execute() {
@@ -19,29 +25,514 @@ void SamplingIntegrator::execute() {
     const Vector2i resolution = m_scene->camera()->resolution();
     m_image->initialize(resolution);
 
-    const float norm = 1.0f / m_sampler->samplesPerPixel();
+    if (!m_workerAddress.empty()) {
+        // the coordinator saves the image
+        renderWorker();
+        return;
+    }
+
+    bool finished;
+    if (m_adaptive) {
+        finished = renderAdaptive();
+    } else if (m_progressive) {
+        finished = renderProgressive();
+    } else {
+        finished = renderBlocks();
+    }
+
+    m_image->save();
+    if (finished && (m_checkpointInterval > 0 || m_resume)) {
+        // a finished render has nothing left to resume
+        std::error_code error;
+        std::filesystem::remove(checkpointPath(), error);
+    }
+}
+
+uint64_t SamplingIntegrator::renderKey() const {
+    hash::fnv1a hash(m_sourceHash,
+                     m_image->resolution().x(),
+                     m_image->resolution().y(),
+                     m_sampler->samplesPerPixel());
+    const std::string type = typeid(*this).name();
+    const std::string id   = m_image->id();
+    hash.update(type.data(), type.size());
+    hash.update(id.data(), id.size());
+    return hash;
+}
+
+std::filesystem::path SamplingIntegrator::checkpointPath() const {
+    return m_image->basePath() / (m_image->id() + ".checkpoint");
+}
+
+bool SamplingIntegrator::resumeCheckpoint(Checkpoint &checkpoint) const {
+    if (!m_resume)
+        return false;
+
+    const auto path     = checkpointPath();
+    const auto previous = Checkpoint::load(path);
+    if (!previous) {
+        logger(EInfo, "no checkpoint to resume from at %s", path);
+        return false;
+    }
+    if (!previous->matches(checkpoint)) {
+        // e.g., the scene was edited since, in which case the old pixels
+        // must not be mixed into the new render
+        logger(EWarn,
+               "ignoring checkpoint %s, which belongs to a different scene or "
+               "render settings",
+               path);
+        return false;
+    }
+    logger(EInfo, "resuming from checkpoint %s", path);
+    checkpoint = *previous;
+    return true;
+}
+
+bool SamplingIntegrator::renderBlocks() {
+    const Vector2i resolution = m_scene->camera()->resolution();
+    const int samplesPerPixel = m_sampler->samplesPerPixel();
+    const float norm          = 1.0f / samplesPerPixel;
+
+    std::vector<Bounds2i> blocks;
+    for (auto block : BlockSpiral(resolution, Vector2i(64)))
+        blocks.push_back(block);
+    TileQueue queue(int(blocks.size()));
+
+    // finished blocks are kept as they are, all others are rendered anew
+    Checkpoint checkpoint(
+        Checkpoint::Mode::Blocks, renderKey(), resolution, samplesPerPixel);
+    if (resumeCheckpoint(checkpoint)) {
+        std::copy(checkpoint.pixels.begin(),
+                  checkpoint.pixels.end(),
+                  m_image->data());
+    }
+    std::mutex checkpointLock;
+    Timer checkpointTimer;
 
     Streaming stream{ *m_image };
     ProgressReporter progress{ resolution.product() };
-    for_each_parallel(BlockSpiral(resolution, Vector2i(64)), [&](auto block) {
-        auto sampler = m_sampler->clone();
+    /// @brief Reports a block whose pixels are final.
+    const auto finishBlock = [&](const Bounds2i &block) {
+        progress += block.diagonal().product();
+        stream.updateBlock(block);
+
+        if (m_checkpointInterval <= 0)
+            return;
+        std::lock_guard lock(checkpointLock);
         for (auto pixel : block) {
-            Color sum;
-            for (int sample = 0; sample < m_sampler->samplesPerPixel();
-                 sample++) {
-                sampler->seed(pixel, sample);
-                auto cameraSample = m_scene->camera()->sample(pixel, *sampler);
-                sum += cameraSample.weight * Li(cameraSample.ray, *sampler);
+            const int index = pixel.y() * resolution.x() + pixel.x();
+            checkpoint.pixels[index]  = m_image->get(pixel);
+            checkpoint.samples[index] = samplesPerPixel;
+        }
+        if (checkpointTimer.getElapsedTime() >= m_checkpointInterval) {
+            checkpoint.save(checkpointPath());
+            checkpointTimer = Timer();
+        }
+    };
+    for (int i = 0; i < int(blocks.size()); i++) {
+        const Point2i first = blocks[i].min();
+        if (checkpoint.samples[first.y() * resolution.x() + first.x()] ==
+            samplesPerPixel) {
+            queue.skip(i);
+            finishBlock(blocks[i]);
+        }
+    }
+
+    // blocks can be rendered both by this process and by a worker, so this
+    // process renders into a separate image when coordinating workers
+    std::optional<Image> scratch;
+    std::unique_ptr<TileCoordinator> coordinator;
+    if (m_coordinatorPort > 0) {
+        scratch.emplace(resolution);
+        coordinator = std::make_unique<TileCoordinator>(
+            uint16_t(m_coordinatorPort),
+            renderKey(),
+            blocks,
+            queue,
+            [&](int index, const std::vector<Color> &pixels) {
+                int i = 0;
+                for (auto pixel : blocks[index])
+                    m_image->get(pixel) = pixels[i++];
+                finishBlock(blocks[index]);
+            });
+        logger(EInfo, "waiting for workers on port %d", m_coordinatorPort);
+    }
+    Image &target = scratch ? *scratch : *m_image;
+
+    ThreadPool &pool = ThreadPool::global();
+    pool.parallelFor(
+        pool.numThreads(),
+        [&](int64_t) {
+            try {
+                while (const auto index =
+                           queue.take(TileQueue::Renderer::Local)) {
+                    const Bounds2i &block = blocks[*index];
+                    renderSamples(block, 0, samplesPerPixel, target);
+                    for (auto pixel : block)
+                        target(pixel) *= norm;
+
+                    // a worker might have delivered the block already
+                    if (!queue.claim(*index))
+                        continue;
+                    if (scratch) {
+                        for (auto pixel : block)
+                            m_image->get(pixel) = target(pixel);
+                    }
+                    finishBlock(block);
+                    queue.complete(*index);
+                }
+            } catch (...) {
+                // the other threads would otherwise wait for this block
+                queue.close();
+                throw;
+            }
+        },
+        1);
+    coordinator.reset();
+    progress.finish();
+    return true;
+}
+
+void SamplingIntegrator::renderWorker() {
+    const int samplesPerPixel = m_sampler->samplesPerPixel();
+    const float norm          = 1.0f / samplesPerPixel;
+
+    TileWorker worker(m_workerAddress, renderKey());
+    logger(EInfo, "rendering blocks for coordinator %s", m_workerAddress);
+
+    Timer timer;
+    ThreadPool &pool = ThreadPool::global();
+    pool.parallelFor(
+        pool.numThreads(),
+        [&](int64_t) {
+            int index;
+            Bounds2i block;
+            std::vector<Color> pixels;
+            while (worker.next(index, block)) {
+                if (block.clip(m_image->bounds()) != block) {
+                    lightwave_throw("coordinator %s sent block %s - %s "
+                                    "outside of the image",
+                                    m_workerAddress,
+                                    block.min(),
+                                    block.max());
+                }
+                renderSamples(block, 0, samplesPerPixel, *m_image);
+                pixels.clear();
+                for (auto pixel : block)
+                    pixels.push_back(norm * m_image->get(pixel));
+                worker.send(index, pixels);
             }
-            m_image->get(pixel) = norm * sum;
+        },
+        1);
+    logger(EInfo,
+           "rendered %d blocks for coordinator %s in %.2f seconds",
+           worker.tilesSent(),
+           m_workerAddress,
+           timer.getElapsedTime());
+}
+
+bool SamplingIntegrator::renderProgressive() {
+    const Vector2i resolution = m_scene->camera()->resolution();
+    const int targetSamples   = m_sampler->samplesPerPixel();
+
+    // the image holds the sum of all samples until rendering is done, which
+    // the preview divides by the number of samples so far
+    int samples = 0;
+    Checkpoint checkpoint(Checkpoint::Mode::Progressive,
+                          renderKey(),
+                          resolution,
+                          targetSamples);
+    if (resumeCheckpoint(checkpoint)) {
+        std::copy(checkpoint.pixels.begin(),
+                  checkpoint.pixels.end(),
+                  m_image->data());
+        samples = checkpoint.samples[0];
+    }
+    const auto saveCheckpoint = [&]() {
+        std::copy(m_image->data(),
+                  m_image->data() + resolution.product(),
+                  checkpoint.pixels.begin());
+        std::fill(checkpoint.samples.begin(), checkpoint.samples.end(),
+                  samples);
+        checkpoint.save(checkpointPath());
+    };
+    Timer checkpointTimer;
+
+    Streaming stream{ *m_image };
+    stream.normalize(samples > 0 ? 1.0f / samples : 0);
+    stream.startRegularUpdates();
+
+    ProgressReporter progress{ targetSamples };
+    progress += samples;
+    Timer timer;
+    float lastPass = 0;
+    while (samples < targetSamples) {
+        // only start passes that are expected to finish within the budget
+        if (m_timeBudget > 0 && lastPass > 0 &&
+            timer.getElapsedTime() + lastPass > m_timeBudget)
+            break;
+
+        Timer passTimer;
+        const int count = std::min(m_samplesPerPass, targetSamples - samples);
+        for_each_parallel(BlockSpiral(resolution, Vector2i(64)),
+                          [&](auto block) {
+                              renderSamples(block, samples, count, *m_image);
+                          });
+        samples += count;
+        stream.normalize(1.0f / samples);
+        lastPass = passTimer.getElapsedTime();
+        progress += count;
+
+        if (m_checkpointInterval > 0 &&
+            checkpointTimer.getElapsedTime() >= m_checkpointInterval) {
+            saveCheckpoint();
+            checkpointTimer = Timer();
         }
+    }
+    stream.stopRegularUpdates();
+    progress.finish();
 
-        progress += block.diagonal().product();
-        stream.updateBlock(block);
-    });
+    const bool finished = samples >= targetSamples;
+    // a render that ran out of time can be continued with more time later
+    if (!finished && m_checkpointInterval > 0)
+        saveCheckpoint();
+
+    const float norm = 1.0f / samples;
+    for (auto pixel : m_image->bounds())
+        m_image->get(pixel) *= norm;
+    stream.normalize(1);
+    stream.update();
+
+    logger(EInfo,
+           "rendered %d of %d samples per pixel in %.2f seconds",
+           samples,
+           targetSamples,
+           timer.getElapsedTime());
+    return finished;
+}
+
+bool SamplingIntegrator::renderAdaptive() {
+    const Vector2i resolution = m_scene->camera()->resolution();
+    const int maxSamples      = m_sampler->samplesPerPixel();
+
+    struct Tile {
+        Bounds2i bounds;
+        /// @brief The samples every pixel of the tile has received so far.
+        int samples = 0;
+    };
+
+    // the image receives the mean of each tile whenever it is refined
+    Image sums(resolution), squares(resolution);
+    Image sampleCounts(resolution);
+    sampleCounts.setId(m_image->id() + "_spp");
+    sampleCounts.setBasePath(m_image->basePath());
+
+    /// @brief The mean relative standard error of the pixels of a tile.
+    const auto tileError = [&](const Tile &tile) {
+        const float n = float(tile.samples);
+        float error   = 0;
+        for (auto pixel : tile.bounds) {
+            const Color mean     = sums(pixel) / n;
+            const Color variance = (squares(pixel) / n - mean * mean) *
+                                   (n / (n - 1));
+            float standardError = 0;
+            for (int channel = 0; channel < Color::NumComponents; channel++)
+                standardError += safe_sqrt(variance[channel] / n);
+            // the offset keeps dark pixels from demanding endless samples
+            error += (standardError / 3) / (mean.mean() + 1e-2f);
+        }
+        return error / tile.bounds.diagonal().product();
+    };
+    /// @brief Updates the image and sample counts of a tile from its sums.
+    const auto resolveTile = [&](const Tile &tile) {
+        const float norm = 1.0f / tile.samples;
+        for (auto pixel : tile.bounds) {
+            m_image->get(pixel) = norm * sums(pixel);
+            sampleCounts(pixel) = Color(float(tile.samples));
+        }
+    };
+    /// @brief Whether a tile needs no further samples.
+    const auto isConverged = [&](const Tile &tile) {
+        return tile.samples >= maxSamples ||
+               tileError(tile) <= m_errorThreshold;
+    };
+
+    // checkpoints are written between rounds, when the sample counts of all
+    // tiles are consistent with their sums
+    Checkpoint checkpoint(
+        Checkpoint::Mode::Adaptive, renderKey(), resolution, maxSamples);
+    const bool resumed = resumeCheckpoint(checkpoint);
+    if (resumed) {
+        std::copy(
+            checkpoint.pixels.begin(), checkpoint.pixels.end(), sums.data());
+        std::copy(checkpoint.squares.begin(),
+                  checkpoint.squares.end(),
+                  squares.data());
+    }
+    const auto saveCheckpoint = [&]() {
+        std::copy(sums.data(),
+                  sums.data() + resolution.product(),
+                  checkpoint.pixels.begin());
+        std::copy(squares.data(),
+                  squares.data() + resolution.product(),
+                  checkpoint.squares.begin());
+        for (int i = 0; i < resolution.product(); i++)
+            checkpoint.samples[i] = int32_t(sampleCounts.data()[i].r());
+        checkpoint.save(checkpointPath());
+    };
+    Timer checkpointTimer;
+
+    std::vector<Tile> active;
+    int convergedTiles = 0;
+    for (auto block : BlockSpiral(resolution, Vector2i(AdaptiveTileSize))) {
+        Tile tile{ block };
+        if (resumed) {
+            tile.samples = checkpoint.samples[block.min().y() * resolution.x() +
+                                              block.min().x()];
+        }
+        if (tile.samples > 0) {
+            resolveTile(tile);
+            if (isConverged(tile)) {
+                convergedTiles++;
+                continue;
+            }
+        }
+        active.push_back(tile);
+    }
+
+    Streaming stream{ *m_image };
+    ProgressReporter progress{ int(active.size()) + convergedTiles };
+    progress += convergedTiles;
+    Timer timer;
+    float lastRound = 0;
+    while (!active.empty()) {
+        // like progressive rendering, the first round is always completed
+        if (m_timeBudget > 0 && lastRound > 0 &&
+            timer.getElapsedTime() + lastRound > m_timeBudget)
+            break;
+
+        // every round doubles the samples of all unconverged tiles, which
+        // keeps the result independent of the order tiles are rendered in
+        Timer roundTimer;
+        std::vector<char> converged(active.size());
+        ThreadPool::global().parallelFor(
+            int64_t(active.size()), [&](int64_t index) {
+                Tile &tile      = active[index];
+                const int count = tile.samples == 0
+                                      ? std::min(m_minSamples, maxSamples)
+                                      : std::min(tile.samples,
+                                                 maxSamples - tile.samples);
+                renderSamples(tile.bounds, tile.samples, count, sums, &squares);
+                tile.samples += count;
+                resolveTile(tile);
+                stream.updateBlock(tile.bounds);
+
+                converged[index] = isConverged(tile);
+                if (converged[index])
+                    progress += 1;
+            });
+        lastRound = roundTimer.getElapsedTime();
+
+        std::vector<Tile> remaining;
+        for (size_t i = 0; i < active.size(); i++) {
+            if (!converged[i])
+                remaining.push_back(active[i]);
+        }
+        active = std::move(remaining);
+
+        if (m_checkpointInterval > 0 &&
+            checkpointTimer.getElapsedTime() >= m_checkpointInterval) {
+            saveCheckpoint();
+            checkpointTimer = Timer();
+        }
+    }
     progress.finish();
 
-    m_image->save();
+    const bool finished = active.empty();
+    // a render that ran out of time can be continued with more time later
+    if (!finished && m_checkpointInterval > 0)
+        saveCheckpoint();
+
+    double totalSamples = 0;
+    for (auto pixel : sampleCounts.bounds())
+        totalSamples += sampleCounts(pixel).r();
+    logger(EInfo,
+           "adaptive sampling took %.1f samples per pixel on average (at "
+           "most %d) in %.2f seconds",
+           totalSamples / resolution.product(),
+           maxSamples,
+           timer.getElapsedTime());
+    sampleCounts.save();
+    return finished;
+}
+
+void SamplingIntegrator::renderSamples(const Bounds2i &block, int firstSample,
+                                       int sampleCount, Image &sums,
+                                       Image *squares) {
+    if (m_tracePackets) {
+        renderPackets(block, firstSample, sampleCount, sums, squares);
+        return;
+    }
+
+    auto sampler = m_sampler->clone();
+    for (auto pixel : block) {
+        Color &sum = sums(pixel);
+        for (int sample = firstSample; sample < firstSample + sampleCount;
+             sample++) {
+            sampler->seed(pixel, sample);
+            auto cameraSample = m_scene->camera()->sample(pixel, *sampler);
+            const Color value =
+                cameraSample.weight * Li(cameraSample.ray, *sampler);
+            sum += value;
+            if (squares)
+                (*squares)(pixel) += value * value;
+        }
+    }
+}
+
+void SamplingIntegrator::renderPackets(const Bounds2i &block, int firstSample,
+                                       int sampleCount, Image &sums,
+                                       Image *squares) {
+    // every ray of a packet has its own sampler, which is seeded exactly as
+    // for a single pixel, so that the image does not depend on which pixels
+    // are traced together
+    std::vector<ref<Sampler>> samplers(RayPacket::MaxSize);
+    for (auto &sampler : samplers)
+        sampler = m_sampler->clone();
+
+    RayPacket packet;
+    Color weights[RayPacket::MaxSize], values[RayPacket::MaxSize];
+    for (int y = block.min().y(); y < block.max().y(); y += PacketSize) {
+        for (int x = block.min().x(); x < block.max().x(); x += PacketSize) {
+            const Bounds2i tile = block.clip(
+                Bounds2i(Point2i(x, y), Point2i(x + PacketSize, y + PacketSize)));
+            packet.size = tile.diagonal().product();
+            for (int i = 0; i < packet.size; i++)
+                packet.rng[i] = samplers[i].get();
+
+            for (int sample = firstSample; sample < firstSample + sampleCount;
+                 sample++) {
+                int i = 0;
+                for (auto pixel : tile) {
+                    packet.rng[i]->seed(pixel, sample);
+                    const auto cameraSample =
+                        m_scene->camera()->sample(pixel, *packet.rng[i]);
+                    packet.rays[i] = cameraSample.ray;
+                    weights[i++]   = cameraSample.weight;
+                }
+
+                Li(packet, values);
+                i = 0;
+                for (auto pixel : tile) {
+                    const Color value = weights[i] * values[i];
+                    sums(pixel) += value;
+                    if (squares)
+                        (*squares)(pixel) += value * value;
+                    i++;
+                }
+            }
+        }
+    }
 }
 
 } // namespace lightwave
@@ -0,0 +1,53 @@
+#include "mappedfile.hpp"
+#include <lightwave/core.hpp>
+
+#include <fstream>
+
+#ifndef LW_OS_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lightwave {
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+#ifndef LW_OS_WINDOWS
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+        void *data =
+            ::mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            m_data = static_cast<const std::byte *>(data);
+            m_size = size_t(info.st_size);
+        }
+    }
+    // the mapping stays valid after the descriptor has been closed
+    ::close(fd);
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return;
+    m_buffer.resize(size_t(file.tellg()));
+    file.seekg(0);
+    if (m_buffer.empty() ||
+        !file.read(reinterpret_cast<char *>(m_buffer.data()),
+                   std::streamsize(m_buffer.size())))
+        return;
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifndef LW_OS_WINDOWS
+    if (m_data)
+        ::munmap(const_cast<std::byte *>(m_data), m_size);
+#endif
+}
+
+} // namespace lightwave
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+namespace lightwave {
+
+/**
+ * @brief Read-only view of the contents of a file. On POSIX systems, the file
+ * is memory mapped so that its pages are only read (or shared with the page
+ * cache) as they are accessed; elsewhere, it is read into memory.
+ */
+class MappedFile {
+public:
+    /// @brief Opens the given file, which results in an invalid mapping if the
+    /// file does not exist or cannot be read.
+    explicit MappedFile(const std::filesystem::path &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &)            = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /// @brief Whether the file could be opened.
+    explicit operator bool() const { return m_data != nullptr; }
+
+    /// @brief The contents of the file.
+    const std::byte *data() const { return m_data; }
+    /// @brief The size of the file in bytes.
+    size_t size() const { return m_size; }
+
+private:
+    const std::byte *m_data = nullptr;
+    size_t m_size           = 0;
+    /// @brief The contents of the file, if it could not be memory mapped.
+    std::vector<std::byte> m_buffer;
+};
+
+} // namespace lightwave
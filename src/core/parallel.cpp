@@ -0,0 +1,151 @@
+#include <lightwave/parallel.hpp>
+
+#include <cstdlib>
+
+#ifdef LW_OS_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace lightwave {
+
+struct ThreadPool::Worker {
+    /// @brief The tasks of this worker: it works at the back, thieves take
+    /// from the front.
+    std::deque<Task> tasks;
+    std::mutex lock;
+    std::thread thread;
+};
+
+/// @brief The pool that the current thread is a worker of (if any).
+static thread_local const ThreadPool *currentPool = nullptr;
+/// @brief The index of the current thread within @c currentPool .
+static thread_local int currentWorker = -1;
+
+ThreadPool::ThreadPool(int numThreads, bool pinThreads)
+    : m_queued(0), m_stop(false) {
+    numThreads = std::max(numThreads, 1);
+    m_workers.reserve(numThreads);
+    for (int i = 0; i < numThreads; i++)
+        m_workers.push_back(std::make_unique<Worker>());
+    for (int i = 0; i < numThreads; i++) {
+        m_workers[i]->thread =
+            std::thread([this, i, pinThreads]() { run(i, pinThreads); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(m_sleepLock);
+        m_stop = true;
+    }
+    m_wakeup.notify_all();
+    for (auto &worker : m_workers)
+        worker->thread.join();
+}
+
+ThreadPool &ThreadPool::global() {
+    static ThreadPool pool = []() {
+        int numThreads = int(std::thread::hardware_concurrency());
+        if (const char *threads = std::getenv("LIGHTWAVE_THREADS")) {
+            numThreads = std::atoi(threads);
+            if (numThreads < 1) {
+                logger(EWarn,
+                       "ignoring invalid LIGHTWAVE_THREADS \"%s\"",
+                       threads);
+                numThreads = int(std::thread::hardware_concurrency());
+            }
+        }
+        const char *pin = std::getenv("LIGHTWAVE_PIN_THREADS");
+        return ThreadPool(numThreads, pin && std::atoi(pin) != 0);
+    }();
+    return pool;
+}
+
+bool ThreadPool::isWorker() const { return currentPool == this; }
+
+void ThreadPool::submit(Task task) {
+    if (isWorker()) {
+        Worker &worker = *m_workers[currentWorker];
+        std::lock_guard lock(worker.lock);
+        worker.tasks.push_back(std::move(task));
+    } else {
+        std::lock_guard lock(m_externalLock);
+        m_external.push_back(std::move(task));
+    }
+    m_queued++;
+
+    // taking the lock ensures that a worker that is about to sleep either
+    // sees the task, or is already waiting to be woken up
+    { std::lock_guard lock(m_sleepLock); }
+    m_wakeup.notify_one();
+}
+
+bool ThreadPool::take(int index, Task &task) {
+    if (m_queued.load() == 0)
+        return false;
+
+    const auto takeFrom = [&](std::deque<Task> &tasks, std::mutex &lock,
+                              bool back) {
+        std::lock_guard guard(lock);
+        if (tasks.empty())
+            return false;
+        if (back) {
+            task = std::move(tasks.back());
+            tasks.pop_back();
+        } else {
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        m_queued--;
+        return true;
+    };
+
+    Worker &self = *m_workers[index];
+    if (takeFrom(self.tasks, self.lock, true))
+        return true;
+    if (takeFrom(m_external, m_externalLock, false))
+        return true;
+    // steal the oldest task of another worker, which is likely the largest
+    for (int i = 1; i < numThreads(); i++) {
+        Worker &victim = *m_workers[(index + i) % numThreads()];
+        if (takeFrom(victim.tasks, victim.lock, false))
+            return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(int index, bool pin) {
+    currentPool   = this;
+    currentWorker = index;
+
+    if (pin) {
+#ifdef LW_OS_LINUX
+        const int cores = std::max(1, int(std::thread::hardware_concurrency()));
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(index % cores, &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+            logger(EWarn, "could not pin worker %d to a core", index);
+#else
+        if (index == 0)
+            logger(EWarn, "pinning threads is not supported on this platform");
+#endif
+    }
+
+    Task task;
+    while (true) {
+        if (take(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock lock(m_sleepLock);
+        m_wakeup.wait(lock, [&]() { return m_stop || m_queued.load() > 0; });
+        if (m_stop)
+            return;
+    }
+}
+
+} // namespace lightwave
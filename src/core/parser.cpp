@@ -1,4 +1,5 @@
-#include <ctpl_stl.h>
+#include <lightwave/hash.hpp>
+#include <lightwave/parallel.hpp>
 #include <lightwave/properties.hpp>
 #include <lightwave/registry.hpp>
 #include <lightwave/transform.hpp>
@@ -9,12 +10,52 @@
 #include <istream>
 #include <memory>
 
+#include "mappedfile.hpp"
 #include "parser.hpp"
 
-ctpl::thread_pool pool(2 * std::thread::hardware_concurrency());
-
 namespace lightwave {
 
+/**
+ * @brief An object that is being constructed on the thread pool. Objects that
+ * depend on it are only queued once it is done (see then()), so that workers
+ * never block waiting for one another.
+ */
+struct SceneParser::Construction {
+    std::promise<ref<Object>> promise;
+    std::shared_future<ref<Object>> result = promise.get_future().share();
+
+    /// @brief Runs @c continuation once the object is done (right away if it
+    /// already is).
+    void then(std::function<void()> continuation) {
+        {
+            std::lock_guard guard(m_lock);
+            if (!m_done) {
+                m_continuations.push_back(std::move(continuation));
+                return;
+            }
+        }
+        continuation();
+    }
+
+    /// @brief Marks the object as done (once @c promise has been fulfilled),
+    /// and runs the continuations that were waiting for it.
+    void finish() {
+        std::vector<std::function<void()>> continuations;
+        {
+            std::lock_guard guard(m_lock);
+            m_done = true;
+            continuations.swap(m_continuations);
+        }
+        for (const auto &continuation : continuations)
+            continuation();
+    }
+
+private:
+    std::mutex m_lock;
+    bool m_done = false;
+    std::vector<std::function<void()>> m_continuations;
+};
+
 struct SceneParser::Node
     : public std::enable_shared_from_this<SceneParser::Node> {
     ref<Node> parent;
@@ -29,7 +70,7 @@ struct SceneParser::Node
 
     virtual void enter() {}
     virtual void attribute(const std::string &name, const std::string &value) {}
-    virtual void addChild(const std::shared_future<ref<Object>> &object,
+    virtual void addChild(const ref<Construction> &object,
                           const std::string &name) {
         lightwave_throw("children are not supported by this node");
     }
@@ -39,8 +80,8 @@ struct SceneParser::Node
 };
 
 struct SceneParser::RootNode : public SceneParser::Node {
-    std::map<std::string, std::shared_future<ref<Object>>> namedObjects;
-    std::vector<std::shared_future<ref<Object>>> objectFutures;
+    std::map<std::string, ref<Construction>> namedObjects;
+    std::vector<ref<Construction>> objectFutures;
     std::filesystem::path filepath;
     SceneParser &sceneParser;
 
@@ -49,11 +90,11 @@ struct SceneParser::RootNode : public SceneParser::Node {
         : Node(nullptr), filepath(filepath), sceneParser(sceneParser) {}
 
     void nameObject(const std::string &name,
-                    const std::shared_future<ref<Object>> &object) {
+                    const ref<Construction> &object) {
         namedObjects[name] = object;
     }
 
-    const std::shared_future<ref<Object>> &lookup(const std::string &name) {
+    const ref<Construction> &lookup(const std::string &name) {
         auto it = namedObjects.find(name);
         if (it == namedObjects.end()) {
             lightwave_throw("could not find an object named \"%s\"", name);
@@ -65,14 +106,14 @@ struct SceneParser::RootNode : public SceneParser::Node {
 
     RootNode &getRoot() override { return *this; }
 
-    void addChild(const std::shared_future<ref<Object>> &object,
+    void addChild(const ref<Construction> &object,
                   const std::string &name) override {
         objectFutures.push_back(object);
     }
 
     void close() override {
         for (const auto &object : objectFutures) {
-            sceneParser.m_objects.push_back(object.get());
+            sceneParser.m_objects.push_back(object->result.get());
         }
     }
 };
@@ -84,7 +125,7 @@ struct SceneParser::ObjectNode : public SceneParser::Node {
     std::string id;
     Properties properties;
 
-    std::vector<std::pair<std::string, std::shared_future<ref<Object>>>>
+    std::vector<std::pair<std::string, ref<Construction>>>
         childFutures;
 
     ref<Transform> transform;
@@ -112,7 +153,7 @@ struct SceneParser::ObjectNode : public SceneParser::Node {
         }
     }
 
-    void addChild(const std::shared_future<ref<Object>> &object,
+    void addChild(const ref<Construction> &object,
                   const std::string &childName) override {
         childFutures.push_back(std::make_pair(childName, object));
     }
@@ -120,18 +161,22 @@ struct SceneParser::ObjectNode : public SceneParser::Node {
     void close() override {
         ProgressReporter &progress = getRoot().sceneParser.m_progress;
         progress.update(0, 1);
+        properties.setSourceHash(getRoot().sceneParser.m_sourceHash);
 
-        auto self = shared_from_this();
-        std::shared_future<ref<Object>> object =
-            pool.push([this, self, &progress](int) {
-                // wait for all child objects to be constructed and add them to
+        auto self         = shared_from_this();
+        auto construction = std::make_shared<Construction>();
+        const auto construct = [this, self, construction, &progress]() {
+            try {
+                // all child objects have been constructed, add them to
                 // properties
                 for (const auto &child : childFutures) {
                     if (child.first == "") {
                         const bool needsQuery = id == "";
-                        properties.addChild(child.second.get(), needsQuery);
+                        properties.addChild(child.second->result.get(),
+                                            needsQuery);
                     } else {
-                        properties.set<Object>(child.first, child.second.get());
+                        properties.set<Object>(child.first,
+                                               child.second->result.get());
                     }
                 }
 
@@ -143,19 +188,36 @@ struct SceneParser::ObjectNode : public SceneParser::Node {
                     if (id != "")
                         object->setId(id);
                     progress += 1;
-                    return object;
+                    construction->promise.set_value(object);
                 } catch (...) {
                     lightwave_throw_nested("defined in %s:%d:%d",
                                            location.filename,
                                            location.line,
                                            location.column);
                 }
-            });
+            } catch (...) {
+                construction->promise.set_exception(std::current_exception());
+            }
+            construction->finish();
+        };
+
+        // queue the construction once the last child object is done
+        const auto remaining =
+            std::make_shared<std::atomic<int>>(int(childFutures.size()) + 1);
+        const auto childDone = [remaining, construct]() {
+            if (--*remaining == 0)
+                ThreadPool::global().submit(construct);
+        };
+        for (const auto &child : childFutures)
+            child.second->then(childDone);
+        childDone();
+
+        getRoot().sceneParser.m_constructions.push_back(construction);
         if (id != "") {
-            getRoot().nameObject(id, object);
+            getRoot().nameObject(id, construction);
         }
 
-        parent->addChild(object, name);
+        parent->addChild(construction, name);
     }
 };
 
@@ -222,13 +284,14 @@ struct SceneParser::IncludeNode : public SceneParser::Node {
         }
     }
 
-    void addChild(const std::shared_future<ref<Object>> &object,
+    void addChild(const ref<Construction> &object,
                   const std::string &name) override {
         parent->addChild(object, name);
     }
 
     void close() override {
         filepath = parent->getFilePath().remove_filename() / filename;
+        getRoot().sceneParser.hashSource(filepath);
         XMLParser(getRoot().sceneParser, filepath);
     }
 };
@@ -421,13 +484,23 @@ void SceneParser::close() {
 }
 
 void SceneParser::stop() {
-    pool.clear_queue();
-    pool.stop(true);
+    // the objects that are already queued refer to the parser
+    for (const auto &construction : m_constructions)
+        construction->result.wait();
+}
+
+void SceneParser::hashSource(const std::filesystem::path &path) {
+    hash::fnv1a hash(m_sourceHash);
+    const MappedFile file(path);
+    if (file)
+        hash.update(file.data(), file.size());
+    m_sourceHash = hash;
 }
 
 SceneParser::SceneParser(const std::filesystem::path &path)
-    : m_progress("parsing") {
+    : m_progress("parsing"), m_sourceHash(0) {
     m_stack.push(std::make_shared<RootNode>(m_objects, path, *this));
+    hashSource(path);
     XMLParser(*this, path);
     SceneParser::close();
     m_progress.finish();
@@ -20,10 +20,18 @@ protected:
     struct IncludeNode;
     struct ReferenceNode;
     struct TransformNode;
+    struct Construction;
 
     std::stack<ref<Node>> m_stack;
     std::vector<ref<Object>> m_objects;
+    /// @brief All objects that have been queued for construction.
+    std::vector<ref<Construction>> m_constructions;
     ProgressReporter m_progress;
+    /// @brief A hash of the contents of all scene files read so far.
+    uint64_t m_sourceHash;
+
+    /// @brief Folds the contents of a scene file into m_sourceHash.
+    void hashSource(const std::filesystem::path &path);
 
     std::string resolveVariables(const std::string &value);
 
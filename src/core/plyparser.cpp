@@ -34,6 +34,7 @@ struct Header {
     int NZElem            = -1;
     int UElem             = -1;
     int VElem             = -1;
+    int RadiusElem        = -1;
     int VertexPropCount   = 0;
     int IndElem           = -1;
     int MatElem           = -1;
@@ -49,6 +50,7 @@ struct Header {
     [[nodiscard]] inline bool hasUVs() const {
         return UElem >= 0 && VElem >= 0;
     }
+    [[nodiscard]] inline bool hasRadii() const { return RadiusElem >= 0; }
     [[nodiscard]] inline bool hasIndices() const { return IndElem >= 0; }
     [[nodiscard]] inline bool hasMaterials() const { return MatElem >= 0; }
 };
@@ -207,6 +209,88 @@ static inline bool isAllowedVertIndType(const std::string &str) {
     return str == "uchar" || str == "int" || str == "uint8_t" || str == "uint";
 }
 
+static Header readHeader(std::istream &stream) {
+    std::string magic;
+    stream >> magic;
+    if (magic != "ply")
+        lightwave_throw("file is not in PLY format");
+
+    std::string method;
+    Header header;
+
+    int facePropCounter = 0;
+    for (std::string line; std::getline(stream, line);) {
+        std::stringstream sstream(line);
+
+        std::string action;
+        sstream >> action;
+        if (action == "comment")
+            continue;
+        else if (action == "format") {
+            sstream >> method;
+        } else if (action == "element") {
+            std::string type;
+            sstream >> type;
+            if (type == "vertex")
+                sstream >> header.VertexCount;
+            else if (type == "face")
+                sstream >> header.FaceCount;
+        } else if (action == "property") {
+            std::string type;
+            sstream >> type;
+            if (type == "float") {
+                std::string name;
+                sstream >> name;
+                if (name == "x")
+                    header.XElem = header.VertexPropCount;
+                else if (name == "y")
+                    header.YElem = header.VertexPropCount;
+                else if (name == "z")
+                    header.ZElem = header.VertexPropCount;
+                else if (name == "nx")
+                    header.NXElem = header.VertexPropCount;
+                else if (name == "ny")
+                    header.NYElem = header.VertexPropCount;
+                else if (name == "nz")
+                    header.NZElem = header.VertexPropCount;
+                else if (name == "u" || name == "s")
+                    header.UElem = header.VertexPropCount;
+                else if (name == "v" || name == "t")
+                    header.VElem = header.VertexPropCount;
+                else if (name == "radius")
+                    header.RadiusElem = header.VertexPropCount;
+                ++header.VertexPropCount;
+            } else if (type == "list") {
+                ++facePropCounter;
+
+                std::string countType;
+                sstream >> countType;
+
+                std::string indType;
+                sstream >> indType;
+
+                std::string name;
+                sstream >> name;
+                if (!isAllowedVertIndType(countType)) {
+                    lightwave_throw(
+                        "only 'property list uchar int' is supported");
+                    continue;
+                }
+
+                if (name == "vertex_indices" || name == "vertex_index")
+                    header.IndElem = facePropCounter - 1;
+            } else {
+                lightwave_throw("only float or list properties allowed");
+            }
+        } else if (action == "end_header")
+            break;
+    }
+
+    header.SwitchEndianness = (method == "binary_big_endian");
+    header.IsAscii          = (method == "ascii");
+    return header;
+}
+
 void readPLY(const std::filesystem::path &path, std::vector<Vector3i> &indices,
              std::vector<Vertex> &vertices) {
     logger(EInfo, "loading mesh %s", path);
@@ -215,92 +299,60 @@ void readPLY(const std::filesystem::path &path, std::vector<Vector3i> &indices,
         if (!stream)
             lightwave_throw("error opening file");
 
-        // Header
-        std::string magic;
-        stream >> magic;
-        if (magic != "ply")
-            lightwave_throw("file is not in PLY format");
-
-        std::string method;
-        Header header;
-
-        int facePropCounter = 0;
-        for (std::string line; std::getline(stream, line);) {
-            std::stringstream sstream(line);
-
-            std::string action;
-            sstream >> action;
-            if (action == "comment")
-                continue;
-            else if (action == "format") {
-                sstream >> method;
-            } else if (action == "element") {
-                std::string type;
-                sstream >> type;
-                if (type == "vertex")
-                    sstream >> header.VertexCount;
-                else if (type == "face")
-                    sstream >> header.FaceCount;
-            } else if (action == "property") {
-                std::string type;
-                sstream >> type;
-                if (type == "float") {
-                    std::string name;
-                    sstream >> name;
-                    if (name == "x")
-                        header.XElem = header.VertexPropCount;
-                    else if (name == "y")
-                        header.YElem = header.VertexPropCount;
-                    else if (name == "z")
-                        header.ZElem = header.VertexPropCount;
-                    else if (name == "nx")
-                        header.NXElem = header.VertexPropCount;
-                    else if (name == "ny")
-                        header.NYElem = header.VertexPropCount;
-                    else if (name == "nz")
-                        header.NZElem = header.VertexPropCount;
-                    else if (name == "u" || name == "s")
-                        header.UElem = header.VertexPropCount;
-                    else if (name == "v" || name == "t")
-                        header.VElem = header.VertexPropCount;
-                    ++header.VertexPropCount;
-                } else if (type == "list") {
-                    ++facePropCounter;
-
-                    std::string countType;
-                    sstream >> countType;
-
-                    std::string indType;
-                    sstream >> indType;
-
-                    std::string name;
-                    sstream >> name;
-                    if (!isAllowedVertIndType(countType)) {
-                        lightwave_throw(
-                            "only 'property list uchar int' is supported");
-                        continue;
-                    }
-
-                    if (name == "vertex_indices" || name == "vertex_index")
-                        header.IndElem = facePropCounter - 1;
-                } else {
-                    lightwave_throw("only float or list properties allowed");
-                }
-            } else if (action == "end_header")
-                break;
-        }
-
-        // Content
+        const Header header = readHeader(stream);
         if (!header.hasVertices() || !header.hasIndices() ||
             header.VertexCount <= 0 || header.FaceCount <= 0)
             lightwave_throw("does not contain valid mesh data");
 
-        header.SwitchEndianness = (method == "binary_big_endian");
-        header.IsAscii          = (method == "ascii");
         readPlyContent(stream, header, indices, vertices);
     } catch (...) {
         lightwave_throw_nested("while parsing %s", path);
     }
 }
 
+void readPLY(const std::filesystem::path &path, std::vector<Point> &positions,
+             std::vector<float> &radii) {
+    logger(EInfo, "loading point cloud %s", path);
+    try {
+        std::ifstream stream(path, std::ios::in | std::ios::binary);
+        if (!stream)
+            lightwave_throw("error opening file");
+
+        const Header header = readHeader(stream);
+        if (!header.hasVertices() || header.VertexCount <= 0)
+            lightwave_throw("does not contain valid point data");
+
+        positions.resize(header.VertexCount);
+        radii.resize(header.hasRadii() ? header.VertexCount : 0);
+        std::vector<float> values(header.VertexPropCount);
+        for (int i = 0; i < header.VertexCount; ++i) {
+            if (header.IsAscii) {
+                std::string line;
+                if (!std::getline(stream, line))
+                    lightwave_throw("not enough vertices given");
+                std::stringstream sstream(line);
+                for (float &value : values)
+                    sstream >> value;
+            } else {
+                stream.read(reinterpret_cast<char *>(values.data()),
+                            values.size() * sizeof(float));
+                if (header.SwitchEndianness) {
+                    for (float &value : values)
+                        value = swap_endian<float>(value);
+                }
+            }
+            if (!stream)
+                lightwave_throw("not enough vertices given");
+
+            positions[i] = { values[header.XElem],
+                             values[header.YElem],
+                             values[header.ZElem] };
+            if (header.hasRadii())
+                radii[i] = values[header.RadiusElem];
+        }
+    } catch (...) {
+        lightwave_throw_nested("while parsing %s", path);
+    }
+}
+
 } // namespace lightwave
@@ -9,4 +9,9 @@ namespace lightwave {
 void readPLY(const std::filesystem::path &path, std::vector<Vector3i> &indices,
              std::vector<Vertex> &vertices);
 
+/// @brief Reads the vertices of a PLY point cloud, along with their "radius"
+/// property (@c radii is left empty if the file does not provide one).
+void readPLY(const std::filesystem::path &path, std::vector<Point> &positions,
+             std::vector<float> &radii);
+
 }
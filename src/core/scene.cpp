@@ -128,8 +128,32 @@ Intersection Scene::intersect(const Ray &ray, Sampler &rng) const {
 bool Scene::intersect(const Ray &ray, float tMax, Sampler &rng) const {
     PROFILE("Shadow ray")
 
-    Intersection its(-ray.direction, tMax * (1 - Epsilon));
-    return m_shape->intersect(ray, its, rng);
+    return m_shape->occluded(ray, tMax * (1 - Epsilon), rng);
+}
+
+void Scene::intersect(const RayPacket &packet, Intersection *its) const {
+    PROFILE("Intersect")
+
+    for (int i = 0; i < packet.size; i++)
+        its[i] = Intersection(-packet.rays[i].direction);
+    m_shape->intersect(packet, packet.all(), its);
+    for (int i = 0; i < packet.size; i++) {
+        if (!its[i]) {
+            its[i].background = m_background.get();
+        }
+        its[i].lightProbability = m_lightSampling->probability(its[i].light());
+    }
+}
+
+RayPacket::Mask Scene::intersect(const RayPacket &packet,
+                                 RayPacket::Mask active,
+                                 const float *tMax) const {
+    PROFILE("Shadow ray")
+
+    float limits[RayPacket::MaxSize];
+    RayPacket::forEach(active,
+                       [&](int i) { limits[i] = tMax[i] * (1 - Epsilon); });
+    return m_shape->occluded(packet, active, limits);
 }
 
 LightSample Scene::sampleLight(Sampler &rng) const {
@@ -3,11 +3,23 @@
 namespace lightwave {
     class AlbedoIntegrator : public SamplingIntegrator {
     public:
-        AlbedoIntegrator(const Properties &properties) : SamplingIntegrator(properties) {}
+        AlbedoIntegrator(const Properties &properties) : SamplingIntegrator(properties) {
+            m_tracePackets = properties.get<bool>("packets", true);
+        }
 
         Color Li(const Ray &ray, Sampler &rng) override {
-            Intersection its = m_scene->intersect(ray, rng);
+            return shade(m_scene->intersect(ray, rng));
+        }
+
+        void Li(const RayPacket &packet, Color *result) override {
+            Intersection its[RayPacket::MaxSize];
+            m_scene->intersect(packet, its);
+            for (int i = 0; i < packet.size; i++)
+                result[i] = shade(its[i]);
+        }
 
+        /// @brief Returns the albedo of the surface that has been hit.
+        Color shade(const Intersection &its) const {
             // Check if we hit an object and that the object is a bsdf
             if (!its || !its.instance->bsdf()) return Color(0.f);
 
@@ -23,11 +23,24 @@ public:
         });
         m_scale = properties.get<float>("scale", 1.f);
         // clang-format on
+        // packets do not record traversal statistics
+        m_tracePackets = properties.get<bool>("packets", true) &&
+                         m_variable != AovBvh;
     }
 
     Color Li(const Ray &ray, Sampler &rng) override {
-        Intersection its = m_scene->intersect(ray, rng);
+        return shade(m_scene->intersect(ray, rng));
+    }
+
+    void Li(const RayPacket &packet, Color *result) override {
+        Intersection its[RayPacket::MaxSize];
+        m_scene->intersect(packet, its);
+        for (int i = 0; i < packet.size; i++)
+            result[i] = shade(its[i]);
+    }
 
+    /// @brief Returns the value of the visualized variable for a hit.
+    Color shade(const Intersection &its) const {
         switch (m_variable) {
         case AovNormals:
             return its ? (Color(its.shadingNormal) + Color(1)) / 2
@@ -6,29 +6,42 @@
 namespace lightwave {
 
 class DirectLightIntegrator final : public SamplingIntegrator {
+    /// @brief A sampled light whose visibility still needs to be tested.
+    struct PendingLight {
+        /// @brief The ray from the surface towards the light.
+        Ray shadowRay;
+        /// @brief The distance to the light along the shadow ray.
+        float distance;
+        /// @brief The contribution of the light if it is visible.
+        Color contribution;
+    };
+
 public:
     DirectLightIntegrator(const Properties &properties)
         : SamplingIntegrator(properties) {
         // No additional properties are needed; everything is initialized by SamplingIntegrator
+        m_tracePackets = properties.get<bool>("packets", true);
     }
 
     /**
-     * @brief Estimates the radiance along the given ray using direct illumination.
-     * 
-     * @param ray The ray to trace into the scene.
+     * @brief Estimates the direct illumination at the first intersection of
+     * a ray, except for testing the visibility of the sampled light source
+     * (so that shadow rays can also be traced as packets).
+     *
+     * @param its The first intersection of the ray.
      * @param rng The random number generator for sampling.
-     * @return The computed radiance.
+     * @param directLight Receives the radiance found so far.
+     * @param light Receives the light sample, whose contribution needs to be
+     * added if it is visible.
+     * @return Whether a light has been sampled.
      */
-    Color Li(const Ray &ray, Sampler &rng) override {
-        Color directLight = Color(0.0f);
-        // Step a: Find the first intersection
-        Intersection its = m_scene->intersect(ray.normalized(), rng);
-
+    bool shade(const Intersection &its, Sampler &rng, Color &directLight,
+               PendingLight &light) const {
         EmissionEval eval = its.evaluateEmission();
         directLight += Color(eval.value);
         if (!its) {
             // If no surface interaction, use the environment map (background light)
-            return directLight;
+            return false;
         }
 
         ///BSDF sample
@@ -41,36 +54,85 @@ public:
         }
 
         //Light sources
-        if (m_scene->hasLights()){
-            // light sample
-            const LightSample lightsample = m_scene->sampleLight(rng);
-            if (!lightsample || !lightsample.light) {
-                return directLight; // No valid light sample available
-            }
+        if (!m_scene->hasLights()){
+            return false;
+        }
 
-            // Get direct light
-            DirectLightSample directSample = lightsample.light->sampleDirect(its.position, rng);
-            if (directSample.isInvalid()) {
-                return directLight;
-            }
-            
-            // move the ray towards the point light a bit to avoid self-intersection
-            Ray ShadowRay(its.position, directSample.wi);
-            ShadowRay = ShadowRay.normalized();
-            if (m_scene->intersect(ShadowRay, directSample.distance, rng)) {
-                return directLight; // Light is occluded, no contribution
-            }
+        // light sample
+        const LightSample lightsample = m_scene->sampleLight(rng);
+        if (!lightsample || !lightsample.light) {
+            return false; // No valid light sample available
+        }
 
-            // Compute light contribution with BSDF
-            Color fr_cos = its.evaluateBsdf(directSample.wi).value;
-            // float light_num = lightsample.probability > 0 ? 1 / lightsample.probability : 1.f;
-            // std::cout << "\nE: " << directSample.weight*directSample.pdf << " ,pdf: " << directSample.pdf 
-            //           << ", output: " << fr_cos * directSample.weight / lightsample.probability << std::endl;
-            directLight += fr_cos * directSample.weight / lightsample.probability;
+        // Get direct light
+        DirectLightSample directSample = lightsample.light->sampleDirect(its.position, rng);
+        if (directSample.isInvalid()) {
+            return false;
         }
 
+        // move the ray towards the point light a bit to avoid self-intersection
+        Ray ShadowRay(its.position, directSample.wi);
+        light.shadowRay = ShadowRay.normalized();
+        light.distance  = directSample.distance;
+
+        // Compute light contribution with BSDF
+        Color fr_cos = its.evaluateBsdf(directSample.wi).value;
+        light.contribution = fr_cos * directSample.weight / lightsample.probability;
+        return true;
+    }
+
+    /**
+     * @brief Estimates the radiance along the given ray using direct illumination.
+     * 
+     * @param ray The ray to trace into the scene.
+     * @param rng The random number generator for sampling.
+     * @return The computed radiance.
+     */
+    Color Li(const Ray &ray, Sampler &rng) override {
+        Color directLight = Color(0.0f);
+        // Step a: Find the first intersection
+        Intersection its = m_scene->intersect(ray.normalized(), rng);
+
+        PendingLight light;
+        if (shade(its, rng, directLight, light) &&
+            !m_scene->intersect(light.shadowRay, light.distance, rng)) {
+            directLight += light.contribution;
+        }
         return directLight;
     }
+
+    /**
+     * @brief Estimates the radiance along a packet of camera rays, tracing
+     * the first intersections and the shadow rays as packets.
+     */
+    void Li(const RayPacket &cameraRays, Color *result) override {
+        RayPacket packet = cameraRays;
+        for (int i = 0; i < packet.size; i++)
+            packet.rays[i] = packet.rays[i].normalized();
+
+        Intersection its[RayPacket::MaxSize];
+        m_scene->intersect(packet, its);
+
+        // the packet is reused for the shadow rays
+        float distances[RayPacket::MaxSize];
+        Color contributions[RayPacket::MaxSize];
+        RayPacket::Mask pending = 0;
+        for (int i = 0; i < packet.size; i++) {
+            result[i] = Color(0.0f);
+            PendingLight light;
+            if (shade(its[i], *packet.rng[i], result[i], light)) {
+                packet.rays[i]   = light.shadowRay;
+                distances[i]     = light.distance;
+                contributions[i] = light.contribution;
+                pending |= RayPacket::Mask(1) << i;
+            }
+        }
+
+        const RayPacket::Mask occluded =
+            m_scene->intersect(packet, pending, distances);
+        RayPacket::forEach(pending & ~occluded,
+                           [&](int i) { result[i] += contributions[i]; });
+    }
         
 
     std::string toString() const override {
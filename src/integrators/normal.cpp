@@ -10,6 +10,14 @@ public:
         : SamplingIntegrator(properties) {
 
         remap = properties.get<bool>("remap", true);    
+        m_tracePackets = properties.get<bool>("packets", true);
+    }
+
+    /// @brief Returns the color visualizing the normal of a hit.
+    Color shade(const Intersection &its) const {
+        Vector normal    = its ? its.shadingNormal : Vector(0.5f, 0.5f, 0.5f);
+        
+        return this->remap ? Color((normal + Vector(1)) / 2) : Color(normal);
     }
 
     /**
@@ -18,10 +26,15 @@ public:
      * potentially with multiple samples for each pixel.
      */
     Color Li(const Ray &ray, Sampler &rng) override {
-        Intersection its = m_scene->intersect(ray, rng);
-        Vector normal    = its ? its.shadingNormal : Vector(0.5f, 0.5f, 0.5f);
-        
-        return this->remap ? Color((normal + Vector(1)) / 2) : Color(normal);
+        return shade(m_scene->intersect(ray, rng));
+    }
+
+    /// @brief Finds the first hits of a whole packet of camera rays at once.
+    void Li(const RayPacket &packet, Color *result) override {
+        Intersection its[RayPacket::MaxSize];
+        m_scene->intersect(packet, its);
+        for (int i = 0; i < packet.size; i++)
+            result[i] = shade(its[i]);
     }
 
     /// @brief An optional textual representation of this class, which can be
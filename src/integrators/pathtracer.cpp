@@ -53,7 +53,7 @@ public:
             //BSDF sample
             const BsdfSample bsdf_sample = its.sampleBsdf(rng);
             if (!bsdf_sample.isInvalid()){
-                currentRay = Ray(its.position, bsdf_sample.wi).normalized();
+                currentRay = Ray(its.position, bsdf_sample.wi, currentRay.depth + 1).normalized();
                 // update variables
                 weight *= bsdf_sample.weight;
                 etaScale *= sqr(bsdf_sample.eta);
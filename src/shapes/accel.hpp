@@ -1,10 +1,28 @@
 #pragma once
 
 #include <lightwave/core.hpp>
+#include <lightwave/hash.hpp>
 #include <lightwave/math.hpp>
+#include <lightwave/parallel.hpp>
+#include <lightwave/properties.hpp>
 #include <lightwave/shape.hpp>
 
+#include "../core/mappedfile.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <new>
 #include <numeric>
+#include <span>
+#include <tuple>
 
 namespace lightwave {
 
@@ -13,20 +31,28 @@ namespace lightwave {
  * triangle meshes), and hence benefit from building an acceleration structure
  * over their children.
  *
- * To use this class, you will need to implement the following methods:
- * - numberOfPrimitives()           -- report the number of individual children
- * that the shape has
- * - intersect(primitiveIndex, ...) -- intersect a single child (identified by
- * the given index) for the given ray
- * - getBoundingBox(primitiveIndex) -- return the bounding box of a single child
- * (used for building the BVH)
- * - getCentroid(primitiveIndex)    -- return the centroid of a single child
- * (used for building the BVH)
+ * The BVH is built over the children reported by a primitive source (see
+ * buildAccelerationStructure()), and is traversed through traverse(), which
+ * calls back into the shape to intersect the children of each leaf that is
+ * reached. Both are templates, so that no virtual calls are needed per child.
+ * Most shapes will want to use @ref Bvh , which implements intersection for
+ * children that can be intersected individually.
  *
- * @example For a simple example of how to use this class, look at @ref
- * shapes/group.cpp
- * @see Group
- * @see TriangleMesh
+ * The binary BVH can optionally be collapsed into a 4-wide or 8-wide BVH
+ * (selected via the @c bvhWidth property), whose nodes store the bounding
+ * boxes of all their children in SoA form so that they can be tested for
+ * intersection with a handful of SIMD instructions. To save memory, the child
+ * boxes of the wide BVH can additionally be quantized to 8 or 16 bits relative
+ * to the bounds of their parent (selected via the @c bvhQuantization
+ * property).
+ *
+ * For very large shapes, where the SAH build would delay the first image,
+ * the binary BVH can instead be built from Morton codes in (almost) linear
+ * time (selected via the @c bvhBuilder property).
+ *
+ * @see Bvh
+ * @see TriangleMesh , which stores its triangles in leaf order and tests them
+ * several at a time.
  */
 class AccelerationStructure : public Shape {
     /// @brief The datatype used to index BVH nodes and the primitive index
@@ -71,8 +97,41 @@ class AccelerationStructure : public Shape {
         }
     };
 
+    /// @brief The size of a cache line, which nodes are aligned to.
+    static constexpr size_t CacheLine = 64;
+
+    /**
+     * @brief Allocates the binary BVH nodes so that the root occupies the
+     * second half of a cache line. Since siblings are stored next to each
+     * other starting at index 1, every pair of siblings then occupies exactly
+     * one cache line (instead of mostly straddling two), which is all that
+     * traversal needs to fetch per visited node.
+     */
+    template <typename T> struct NodeAllocator {
+        static_assert(2 * sizeof(T) == CacheLine,
+                      "a pair of BVH nodes must fill a cache line");
+        typedef T value_type;
+
+        NodeAllocator() = default;
+        template <typename U> NodeAllocator(const NodeAllocator<U> &) {}
+
+        T *allocate(size_t count) {
+            std::byte *memory = static_cast<std::byte *>(::operator new(
+                (count + 1) * sizeof(T), std::align_val_t(CacheLine)));
+            return reinterpret_cast<T *>(memory + sizeof(T));
+        }
+        void deallocate(T *nodes, size_t) {
+            ::operator delete(reinterpret_cast<std::byte *>(nodes) - sizeof(T),
+                              std::align_val_t(CacheLine));
+        }
+
+        template <typename U> bool operator==(const NodeAllocator<U> &) const {
+            return true;
+        }
+    };
+
     /// @brief A list of all BVH nodes.
-    std::vector<Node> m_nodes;
+    std::vector<Node, NodeAllocator<Node>> m_nodes;
     /**
      * @brief Mapping from internal @c NodeIndex to @c primitiveIndex as used by
      * all interface methods. For efficient storage, we assume that children of
@@ -84,6 +143,222 @@ class AccelerationStructure : public Shape {
      */
     std::vector<int> m_primitiveIndices;
 
+    /**
+     * @brief A node of a wide BVH, which stores the bounding boxes of up to
+     * @c Width children in structure-of-arrays layout.
+     * @note Unused child slots have empty bounding boxes, which can never be
+     * hit by a ray.
+     * @note Nodes are aligned to cache lines, so that a 4-wide (8-wide) node
+     * spans exactly two (four) of them.
+     */
+    template <int Width> struct alignas(CacheLine) WideNode {
+        static_assert(Width % simd::Lanes == 0,
+                      "the width of a wide BVH must be a multiple of the SIMD "
+                      "width");
+
+        /// @brief The lower corners of the child bounding boxes, per axis.
+        alignas(16) float min[3][Width];
+        /// @brief The upper corners of the child bounding boxes, per axis.
+        alignas(16) float max[3][Width];
+        /// @brief For inner children: the index of the child node in the list
+        /// of wide nodes. For leaf children: the first index in
+        /// m_primitiveIndices.
+        NodeIndex child[Width];
+        /// @brief For leaf children: the number of primitives, or 0 to
+        /// indicate that the child is an inner node.
+        NodeIndex primitiveCount[Width];
+
+        /// @brief Assigns the bounding box of a child slot.
+        void setBounds(int slot, const Bounds &bounds) {
+            for (int dim = 0; dim < 3; dim++) {
+                min[dim][slot] = bounds.min()[dim];
+                max[dim][slot] = bounds.max()[dim];
+            }
+        }
+
+        /// @brief Returns the bounding box of a child slot.
+        Bounds childBounds(int slot) const {
+            return { Point(min[0][slot], min[1][slot], min[2][slot]),
+                     Point(max[0][slot], max[1][slot], max[2][slot]) };
+        }
+    };
+
+    /**
+     * @brief A node of a wide BVH whose child bounding boxes are quantized to
+     * @c Quantized (8 or 16 bit unsigned integers) relative to the bounds of
+     * the node itself. This shrinks a 4-wide node from 128 to 84 (8 bit) or
+     * 108 bytes (16 bit), and an 8-wide node from 256 to 140 or 188 bytes.
+     * @note Child boxes are rounded outwards, so that they still enclose the
+     * children after decoding.
+     */
+    template <int Width, typename Quantized> struct QuantizedWideNode {
+        /// @brief The number of quantization steps across the node bounds.
+        static constexpr int Levels = std::numeric_limits<Quantized>::max();
+
+        /// @brief The lower corner of the node bounds.
+        float origin[3];
+        /// @brief The size of one quantization step, per axis.
+        float scale[3];
+        /// @brief The lower corners of the child boxes in quantization steps,
+        /// per axis.
+        Quantized min[3][Width];
+        /// @brief The upper corners of the child boxes in quantization steps,
+        /// per axis.
+        Quantized max[3][Width];
+        /// @brief See @ref WideNode::child .
+        NodeIndex child[Width];
+        /// @brief See @ref WideNode::primitiveCount .
+        NodeIndex primitiveCount[Width];
+        /// @brief A bit mask of the child slots that are in use.
+        uint8_t validMask;
+
+        /**
+         * @brief Compresses a wide node with full precision bounding boxes.
+         * @return @c false if the node cannot be quantized (because it has
+         * unbounded children).
+         */
+        bool encode(const WideNode<Width> &node) {
+            validMask = 0;
+            for (int slot = 0; slot < Width; slot++) {
+                child[slot]          = node.child[slot];
+                primitiveCount[slot] = node.primitiveCount[slot];
+                if (primitiveCount[slot] != -1)
+                    validMask |= 1 << slot;
+            }
+
+            for (int dim = 0; dim < 3; dim++) {
+                float lo = Infinity, hi = -Infinity;
+                for (int slot = 0; slot < Width; slot++) {
+                    if (validMask & (1 << slot)) {
+                        lo = std::min(lo, node.min[dim][slot]);
+                        hi = std::max(hi, node.max[dim][slot]);
+                    }
+                }
+                if (!std::isfinite(lo) || !std::isfinite(hi))
+                    return false;
+
+                // make sure that the largest quantized value still covers
+                // the upper bound despite rounding
+                float step = (hi - lo) / Levels;
+                while (lo + Levels * step < hi)
+                    step = std::nextafter(step, Infinity);
+                origin[dim] = lo;
+                scale[dim]  = step;
+
+                for (int slot = 0; slot < Width; slot++) {
+                    if (!(validMask & (1 << slot))) {
+                        min[dim][slot] = Levels;
+                        max[dim][slot] = 0;
+                        continue;
+                    }
+
+                    const float childMin = node.min[dim][slot];
+                    const float childMax = node.max[dim][slot];
+                    int qmin = 0, qmax = 0;
+                    if (step > 0) {
+                        qmin = clamp(int(std::floor((childMin - lo) / step)),
+                                     0, Levels);
+                        qmax = clamp(int(std::ceil((childMax - lo) / step)),
+                                     0, Levels);
+                    }
+                    // guard against rounding, decoding happens as below
+                    while (qmin > 0 && lo + qmin * step > childMin)
+                        qmin--;
+                    while (qmax < Levels && lo + qmax * step < childMax)
+                        qmax++;
+                    min[dim][slot] = Quantized(qmin);
+                    max[dim][slot] = Quantized(qmax);
+                }
+            }
+            return true;
+        }
+
+        /// @brief Returns the (conservatively decoded) bounding box of a
+        /// child slot.
+        Bounds childBounds(int slot) const {
+            Bounds bounds;
+            for (int dim = 0; dim < 3; dim++) {
+                // decode exactly like encode() checks the rounding
+                bounds.min()[dim] = origin[dim] + min[dim][slot] * scale[dim];
+                bounds.max()[dim] = origin[dim] + max[dim][slot] * scale[dim];
+            }
+            return bounds;
+        }
+    };
+
+    /**
+     * @brief The number of children per node that are used for traversal (2
+     * for the binary BVH, or 4 or 8 for a collapsed wide BVH).
+     */
+    int m_width = 2;
+    /// @brief The collapsed 4-wide BVH (only populated if m_width is 4).
+    std::vector<WideNode<4>> m_wideNodes4;
+    /// @brief The collapsed 8-wide BVH (only populated if m_width is 8).
+    std::vector<WideNode<8>> m_wideNodes8;
+
+    /**
+     * @brief The number of bits that child bounding boxes of the wide BVH are
+     * quantized to (8 or 16), or 0 to store them with full precision.
+     */
+    int m_quantization = 0;
+    /// @brief The quantized wide BVHs (only the one matching m_width and
+    /// m_quantization is populated).
+    std::tuple<std::vector<QuantizedWideNode<4, uint8_t>>,
+               std::vector<QuantizedWideNode<4, uint16_t>>,
+               std::vector<QuantizedWideNode<8, uint8_t>>,
+               std::vector<QuantizedWideNode<8, uint16_t>>>
+        m_quantizedNodes;
+
+    /// @brief The algorithms that the binary BVH can be built with.
+    enum class BuildStrategy {
+        /// @brief Top-down binned SAH (best trees, slowest build).
+        Sah,
+        /// @brief Linear BVH over the Morton codes of the primitive centroids.
+        Lbvh,
+        /// @brief LBVH whose top levels are built using the SAH.
+        Hlbvh,
+    };
+    /// @brief The algorithm the binary BVH is built with (selected via the
+    /// @c bvhBuilder property).
+    BuildStrategy m_builder = BuildStrategy::Sah;
+    /// @brief Whether the nodes of the binary BVH are renumbered in
+    /// depth-first order after the build (see reorderNodes()), which can be
+    /// disabled via the @c bvhReorder property to compare both layouts.
+    bool m_reorderNodes = true;
+
+    /// @brief Returns the list of quantized wide nodes for a given width and
+    /// bit depth.
+    template <int Width, typename Quantized>
+    std::vector<QuantizedWideNode<Width, Quantized>> &quantizedNodes() {
+        return std::get<std::vector<QuantizedWideNode<Width, Quantized>>>(
+            m_quantizedNodes);
+    }
+
+    /// @brief Returns the list of quantized wide nodes for a given width and
+    /// bit depth.
+    template <int Width, typename Quantized>
+    const std::vector<QuantizedWideNode<Width, Quantized>> &
+    quantizedNodes() const {
+        return std::get<std::vector<QuantizedWideNode<Width, Quantized>>>(
+            m_quantizedNodes);
+    }
+
+    /// @brief Returns the list of wide nodes for a given width.
+    template <int Width> std::vector<WideNode<Width>> &wideNodes() {
+        if constexpr (Width == 4)
+            return m_wideNodes4;
+        else
+            return m_wideNodes8;
+    }
+
+    /// @brief Returns the list of wide nodes for a given width.
+    template <int Width> const std::vector<WideNode<Width>> &wideNodes() const {
+        if constexpr (Width == 4)
+            return m_wideNodes4;
+        else
+            return m_wideNodes8;
+    }
+
     /// @brief Returns the root BVH node.
     const Node &rootNode() const {
         // by convention, this is always the first element of m_nodes
@@ -91,68 +366,342 @@ class AccelerationStructure : public Shape {
     }
 
     /**
-     * @brief Intersects a BVH node, recursing into children (for internal
-     * nodes), or intersecting all primitives (for leaf nodes).
+     * @brief The maximum depth of the BVH, which also bounds the size of the
+     * traversal stack. Nodes at this depth are not subdivided any further.
      */
-    bool intersectNode(const Node &node, const Ray &ray, Intersection &its,
-                       Sampler &rng) const {
-        // update the statistic tracking how many BVH nodes have been tested for
-        // intersection
-        its.stats.bvhCounter++;
+    static constexpr int MaxDepth = 64;
+
+    /**
+     * @brief Ray quantities that are precomputed once per traversal, so that
+     * the slab tests of the individual nodes can avoid divisions and branches.
+     */
+    struct TraversalRay {
+        /// @brief The origin of the ray.
+        Point origin;
+        /// @brief The component-wise reciprocal of the ray direction.
+        Vector invDirection;
+        /// @brief For each axis, whether the ray direction is negative (in
+        /// which case the near slab is given by the maximum of the box).
+        bool isNegative[3];
+
+        TraversalRay(const Ray &ray) : origin(ray.origin) {
+            for (int dim = 0; dim < 3; dim++) {
+                invDirection[dim] = 1 / ray.direction[dim];
+                isNegative[dim]   = invDirection[dim] < 0;
+            }
+        }
+    };
+
+    /// @brief An entry of the traversal stack: a node that still needs to be
+    /// visited, along with the distance at which its bounding box is entered.
+    struct StackEntry {
+        NodeIndex node;
+        float t;
+    };
+
+    /**
+     * @brief Intersects the BVH with a ray, visiting the children of internal
+     * nodes in the order they are intersected in (which helps prune a lot of
+     * unnecessary intersection tests), and intersecting all primitives of the
+     * leaf nodes that are reached.
+     * @note Instead of recursing, nodes that are still to be visited are kept
+     * on a small fixed-size stack.
+     * @tparam AnyHit If set, the traversal returns as soon as any leaf reports
+     * a hit (used for shadow rays).
+     * @param intersectLeaf Called with the range of a leaf in
+     * m_primitiveIndices as @code intersectLeaf(first, count) @endcode ,
+     * and reports whether a hit closer than @c its.t has been found (in which
+     * case @c its.t must have been updated, unless @c AnyHit is set).
+     */
+    template <bool AnyHit, typename IntersectLeaf>
+    bool traverseNodes(const Ray &ray, Intersection &its,
+                       IntersectLeaf &&intersectLeaf) const {
+        const TraversalRay tray(ray);
+        if (!(intersectAABB(rootNode().aabb, tray) < its.t))
+            return false; // test root bounding box for potential hit
+
+        StackEntry stack[MaxDepth];
+        int stackSize = 0;
 
         bool wasIntersected = false;
-        if (node.isLeaf()) {
-            for (NodeIndex i = 0; i < node.primitiveCount; i++) {
+        const Node *node    = &rootNode();
+        while (true) {
+            // update the statistic tracking how many BVH nodes have been
+            // tested for intersection
+            its.stats.bvhCounter++;
+
+            if (node->isLeaf()) {
                 // update the statistic tracking how many children have been
                 // tested for intersection
-                its.stats.primCounter++;
-                // test the child for intersection
-                wasIntersected |= intersect(
-                    m_primitiveIndices[node.leftFirst + i], ray, its, rng);
-            }
-        } else { // internal node
-            // test which bounding box is intersected first by the ray.
-            // this allows us to traverse the children in the order they are
-            // intersected in, which can help prune a lot of unnecessary
-            // intersection tests.
-            const auto leftT =
-                intersectAABB(m_nodes[node.leftChildIndex()].aabb, ray);
-            const auto rightT =
-                intersectAABB(m_nodes[node.rightChildIndex()].aabb, ray);
-            if (leftT < rightT) { // left child is hit first; test left child
-                                  // first, then right child
-                if (leftT < its.t)
-                    wasIntersected |= intersectNode(
-                        m_nodes[node.leftChildIndex()], ray, its, rng);
-                if (rightT < its.t)
-                    wasIntersected |= intersectNode(
-                        m_nodes[node.rightChildIndex()], ray, its, rng);
-            } else { // right child is hit first; test right child first, then
-                     // left child
-                if (rightT < its.t)
-                    wasIntersected |= intersectNode(
-                        m_nodes[node.rightChildIndex()], ray, its, rng);
-                if (leftT < its.t)
-                    wasIntersected |= intersectNode(
-                        m_nodes[node.leftChildIndex()], ray, its, rng);
+                its.stats.primCounter += node->primitiveCount;
+                // test the children for intersection
+                if (intersectLeaf(node->leftFirst, node->primitiveCount)) {
+                    if constexpr (AnyHit)
+                        return true;
+                    wasIntersected = true;
+                }
+            } else { // internal node
+                const Node *nearChild = &m_nodes[node->leftChildIndex()];
+                const Node *farChild  = &m_nodes[node->rightChildIndex()];
+                float nearT           = intersectAABB(nearChild->aabb, tray);
+                float farT            = intersectAABB(farChild->aabb, tray);
+                if (farT < nearT) {
+                    // right child is hit first; test right child first, then
+                    // left child
+                    std::swap(nearChild, farChild);
+                    std::swap(nearT, farT);
+                }
+
+                if (nearT < its.t) {
+                    if (farT < its.t) {
+                        // defer the far child until the near child is done
+                        stack[stackSize++] = { NodeIndex(farChild - &m_nodes[0]),
+                                               farT };
+                    }
+                    node = nearChild;
+                    continue;
+                }
+            }
+
+            // pop the next node that might still contain a closer hit
+            node = nullptr;
+            while (stackSize > 0) {
+                const StackEntry &entry = stack[--stackSize];
+                if (entry.t < its.t) {
+                    node = &m_nodes[entry.node];
+                    break;
+                }
+            }
+            if (!node)
+                break;
+        }
+        return wasIntersected;
+    }
+
+    /**
+     * @brief Intersects the collapsed wide BVH with a ray. All children of a
+     * node are tested at once, and the children that are hit are visited in
+     * the order they are intersected in.
+     * @param nodes Either full precision or quantized wide nodes.
+     * @see traverseNodes() for the meaning of the other parameters.
+     */
+    template <int Width, bool AnyHit, typename WideNodeType,
+              typename IntersectLeaf>
+    bool traverseWideNodes(const std::vector<WideNodeType> &nodes,
+                           const Ray &ray, Intersection &its,
+                           IntersectLeaf &&intersectLeaf) const {
+        const TraversalRay tray(ray);
+
+        /// @brief A child that still needs to be visited.
+        struct WideStackEntry {
+            NodeIndex child;
+            NodeIndex primitiveCount;
+            float t;
+        };
+        // every level of the tree can defer all but one of its children
+        WideStackEntry stack[MaxDepth * (Width - 1) + 1];
+        int stackSize = 0;
+
+        bool wasIntersected = false;
+        NodeIndex nodeIndex = 0;
+        while (true) {
+            // update the statistic tracking how many BVH nodes have been
+            // tested for intersection
+            its.stats.bvhCounter++;
+
+            const WideNodeType &node = nodes[nodeIndex];
+            float tNear[Width];
+            int hitMask = intersectWideAABB(node, tray, its.t, tNear);
+
+            // push the children that were hit, so that the closest one ends
+            // up on top of the stack
+            const int firstEntry = stackSize;
+            while (hitMask) {
+                const int slot = std::countr_zero(unsigned(hitMask));
+                hitMask &= hitMask - 1;
+
+                WideStackEntry entry = { node.child[slot],
+                                         node.primitiveCount[slot],
+                                         tNear[slot] };
+                int i = stackSize++;
+                while (i > firstEntry && stack[i - 1].t < entry.t) {
+                    stack[i] = stack[i - 1];
+                    i--;
+                }
+                stack[i] = entry;
+            }
+
+            // pop the next inner node that might still contain a closer hit,
+            // intersecting any leaves we encounter along the way
+            nodeIndex = -1;
+            while (stackSize > 0) {
+                const WideStackEntry entry = stack[--stackSize];
+                if (!(entry.t < its.t))
+                    continue;
+                if (entry.primitiveCount == 0) {
+                    nodeIndex = entry.child;
+                    break;
+                }
+
+                its.stats.bvhCounter++;
+                its.stats.primCounter += entry.primitiveCount;
+                if (intersectLeaf(entry.child, entry.primitiveCount)) {
+                    if constexpr (AnyHit)
+                        return true;
+                    wasIntersected = true;
+                }
             }
+            if (nodeIndex < 0)
+                break;
         }
         return wasIntersected;
     }
 
-    /// @brief Performs a slab test to intersect a bounding box with a ray,
-    /// returning Infinity in case the ray misses.
-    float intersectAABB(const Bounds &bounds, const Ray &ray) const {
-        const auto t1 = (bounds.min() - ray.origin) / ray.direction;
-        // intersect all axes at once with the maximum slabs of the bounding box
-        const auto t2 = (bounds.max() - ray.origin) / ray.direction;
+    /**
+     * @brief Performs the slab test for all children of a wide node at once.
+     * @param tMax Children that are entered beyond this distance are reported
+     * as missed.
+     * @param tNear Receives the entry distance for each child.
+     * @param slabDistance Returns the distances along the ray to the lower (or
+     * upper, if the last argument is set) slabs of four children along an
+     * axis, as in @code slabDistance(dim, firstChild, upper) @endcode .
+     * @return A bit mask of the children that were hit.
+     */
+    template <int Width, typename SlabDistance>
+    int intersectSlabs(const TraversalRay &ray, float tMax, float *tNear,
+                       SlabDistance &&slabDistance) const {
+        using simd::Float4;
+
+        const Float4 epsilon = Float4::broadcast(Epsilon);
+        const Float4 limit   = Float4::broadcast(tMax);
+
+        int hitMask = 0;
+        for (int lane = 0; lane < Width; lane += simd::Lanes) {
+            Float4 entry = Float4::broadcast(-Infinity);
+            Float4 exit  = Float4::broadcast(+Infinity);
+            for (int dim = 0; dim < 3; dim++) {
+                entry = max(entry, slabDistance(dim, lane, ray.isNegative[dim]));
+                exit  = min(exit, slabDistance(dim, lane, !ray.isNegative[dim]));
+            }
+            entry.store(tNear + lane);
+
+            const simd::Mask4 hit =
+                (entry <= exit) & (exit >= epsilon) & (entry < limit);
+            hitMask |= hit.bits() << lane;
+        }
+        return hitMask;
+    }
+
+    /// @brief Performs the slab test for all children of a wide node at once,
+    /// see @ref intersectSlabs .
+    template <int Width>
+    int intersectWideAABB(const WideNode<Width> &node, const TraversalRay &ray,
+                          float tMax, float *tNear) const {
+        using simd::Float4;
+
+        Float4 origin[3], invDirection[3];
+        for (int dim = 0; dim < 3; dim++) {
+            origin[dim]       = Float4::broadcast(ray.origin[dim]);
+            invDirection[dim] = Float4::broadcast(ray.invDirection[dim]);
+        }
+        return intersectSlabs<Width>(
+            ray, tMax, tNear, [&](int dim, int lane, bool upper) {
+                const Float4 slab = Float4::load(
+                    (upper ? node.max[dim] : node.min[dim]) + lane);
+                return (slab - origin[dim]) * invDirection[dim];
+            });
+    }
+
+    /**
+     * @brief Performs the slab test for all children of a quantized wide node
+     * at once. Instead of decoding the child boxes, the ray is transformed
+     * into the quantized space of the node, so that each slab only costs a
+     * conversion and a multiply-add.
+     * @note Along axes the ray is parallel to, folding the infinite reciprocal
+     * into the transform would yield NaNs (e.g., @c 0*inf ), which the slab
+     * test treats as misses. The slabs of such axes are decoded first, and
+     * behave exactly as in the unquantized traversal.
+     */
+    template <int Width, typename Quantized>
+    int intersectWideAABB(const QuantizedWideNode<Width, Quantized> &node,
+                          const TraversalRay &ray, float tMax,
+                          float *tNear) const {
+        using simd::Float4;
+
+        // origin + q * scale = o + t * d  <=>  t = q * a + b
+        Float4 a[3], b[3], invDirection[3];
+        bool decode[3];
+        for (int dim = 0; dim < 3; dim++) {
+            decode[dim] = !std::isfinite(ray.invDirection[dim]);
+            const float factor = decode[dim] ? 1 : ray.invDirection[dim];
+            a[dim] = Float4::broadcast(node.scale[dim] * factor);
+            b[dim] = Float4::broadcast((node.origin[dim] - ray.origin[dim]) *
+                                       factor);
+            invDirection[dim] = Float4::broadcast(ray.invDirection[dim]);
+        }
+        return node.validMask &
+               intersectSlabs<Width>(
+                   ray, tMax, tNear, [&](int dim, int lane, bool upper) {
+                       const Float4 slab = Float4::load(
+                           (upper ? node.max[dim] : node.min[dim]) + lane);
+                       const Float4 t = slab * a[dim] + b[dim];
+                       return decode[dim] ? t * invDirection[dim] : t;
+                   });
+    }
+
+    /**
+     * @brief Traverses the wide BVH of the given width, in whichever format it
+     * has been stored.
+     */
+    template <int Width, bool AnyHit, typename IntersectLeaf>
+    bool traverseWidth(const Ray &ray, Intersection &its,
+                       IntersectLeaf &&intersectLeaf) const {
+        switch (m_quantization) {
+        case 8:
+            return traverseWideNodes<Width, AnyHit>(
+                quantizedNodes<Width, uint8_t>(), ray, its, intersectLeaf);
+        case 16:
+            return traverseWideNodes<Width, AnyHit>(
+                quantizedNodes<Width, uint16_t>(), ray, its, intersectLeaf);
+        default:
+            return traverseWideNodes<Width, AnyHit>(
+                wideNodes<Width>(), ray, its, intersectLeaf);
+        }
+    }
+
+    /// @brief Traverses the BVH of the width that is used for traversal, see
+    /// traverse().
+    template <bool AnyHit, typename IntersectLeaf>
+    bool traverseTree(const Ray &ray, Intersection &its,
+                      IntersectLeaf &&intersectLeaf) const {
+        switch (m_width) {
+        case 4:
+            return traverseWidth<4, AnyHit>(ray, its, intersectLeaf);
+        case 8:
+            return traverseWidth<8, AnyHit>(ray, its, intersectLeaf);
+        default:
+            return traverseNodes<AnyHit>(ray, its, intersectLeaf);
+        }
+    }
 
-        // the elementwiseMin picks the near slab for each axis, of which we
-        // then take the maximum
-        const auto tNear = elementwiseMin(t1, t2).maxComponent();
-        // the elementwiseMax picks the far slab for each axis, of which we then
-        // take the minimum
-        const auto tFar = elementwiseMax(t1, t2).minComponent();
+    /**
+     * @brief Performs a slab test to intersect a bounding box with a ray,
+     * returning Infinity in case the ray misses.
+     * @note The sign of the ray direction selects which corner of the box
+     * forms the near and far slab of each axis, so that a single
+     * multiplication per slab suffices.
+     */
+    float intersectAABB(const Bounds &bounds, const TraversalRay &ray) const {
+        float tNear = -Infinity;
+        float tFar  = +Infinity;
+        for (int dim = 0; dim < 3; dim++) {
+            const float nearSlab =
+                ray.isNegative[dim] ? bounds.max()[dim] : bounds.min()[dim];
+            const float farSlab =
+                ray.isNegative[dim] ? bounds.min()[dim] : bounds.max()[dim];
+            tNear = max(tNear, (nearSlab - ray.origin[dim]) * ray.invDirection[dim]);
+            tFar  = min(tFar, (farSlab - ray.origin[dim]) * ray.invDirection[dim]);
+        }
 
         if (tFar < tNear)
             return Infinity; // the ray does not intersect the bounding box
@@ -163,13 +712,430 @@ class AccelerationStructure : public Shape {
                       // (may also be negative!)
     }
 
-    /// @brief Computes the axis aligned bounding box for a leaf BVH node
-    void computeAABB(Node &node) {
-        node.aabb = Bounds::empty();
+    /**
+     * @brief The rays of a packet in structure-of-arrays layout, so that the
+     * slab tests of a node can be performed for four rays at once. Rays that
+     * are not part of the traversal are never hit, as their @c tMax is
+     * negative.
+     */
+    struct TraversalPacket {
+        /// @brief The origins of the rays, per axis.
+        alignas(16) float origin[3][RayPacket::MaxSize];
+        /// @brief The component-wise reciprocals of the ray directions, per
+        /// axis.
+        alignas(16) float invDirection[3][RayPacket::MaxSize];
+        /// @brief The distance up to which hits are of interest, per ray.
+        alignas(16) float tMax[RayPacket::MaxSize];
+
+        /**
+         * @brief Whether the directions of all rays lie in the same octant
+         * (and are not parallel to any axis), in which case the ranges below
+         * can be used to cull nodes that are missed by all rays at once.
+         */
+        bool isCoherent;
+        /// @brief The range of ray origins, per axis.
+        float originMin[3], originMax[3];
+        /// @brief The range of reciprocal ray directions, per axis.
+        float invDirectionMin[3], invDirectionMax[3];
+        /// @brief The largest @c tMax of all rays.
+        float tMaxBound;
+
+        TraversalPacket(const RayPacket &packet, RayPacket::Mask active,
+                        const float *maxDistances) {
+            // only groups of rays that contain active rays are ever loaded
+            constexpr RayPacket::Mask LaneBits = (1 << simd::Lanes) - 1;
+            for (RayPacket::Mask remaining = active; remaining;) {
+                const int first =
+                    std::countr_zero(remaining) & ~(simd::Lanes - 1);
+                remaining &= ~(LaneBits << first);
+                for (int i = first; i < first + simd::Lanes; i++) {
+                    for (int dim = 0; dim < 3; dim++) {
+                        origin[dim][i]       = 0;
+                        invDirection[dim][i] = 0;
+                    }
+                    tMax[i] = -Infinity;
+                }
+            }
+
+            isCoherent = true;
+            tMaxBound  = -Infinity;
+            for (int dim = 0; dim < 3; dim++) {
+                originMin[dim] = invDirectionMin[dim] = +Infinity;
+                originMax[dim] = invDirectionMax[dim] = -Infinity;
+            }
+            RayPacket::forEach(active, [&](int i) {
+                const Ray &ray = packet.rays[i];
+                for (int dim = 0; dim < 3; dim++) {
+                    origin[dim][i]       = ray.origin[dim];
+                    invDirection[dim][i] = 1 / ray.direction[dim];
+                    originMin[dim] = min(originMin[dim], origin[dim][i]);
+                    originMax[dim] = max(originMax[dim], origin[dim][i]);
+                    invDirectionMin[dim] =
+                        min(invDirectionMin[dim], invDirection[dim][i]);
+                    invDirectionMax[dim] =
+                        max(invDirectionMax[dim], invDirection[dim][i]);
+                }
+                tMax[i]   = maxDistances[i];
+                tMaxBound = max(tMaxBound, tMax[i]);
+            });
+            for (int dim = 0; dim < 3; dim++) {
+                isCoherent &= std::isfinite(invDirectionMin[dim]) &&
+                              std::isfinite(invDirectionMax[dim]) &&
+                              (invDirectionMin[dim] > 0) ==
+                                  (invDirectionMax[dim] > 0);
+            }
+        }
+    };
+
+    /**
+     * @brief Conservatively tests whether a bounding box might be hit by any
+     * ray of a coherent packet, using interval arithmetic over the ranges of
+     * the ray origins and directions (i.e., testing the box against the
+     * frustum enclosing all rays).
+     */
+    static bool intersectInterval(const Bounds &bounds,
+                                  const TraversalPacket &packet) {
+        float entryMin = -Infinity;
+        float exitMax  = +Infinity;
+        for (int dim = 0; dim < 3; dim++) {
+            const bool isNegative = packet.invDirectionMax[dim] < 0;
+            const float nearSlab =
+                isNegative ? bounds.max()[dim] : bounds.min()[dim];
+            const float farSlab =
+                isNegative ? bounds.min()[dim] : bounds.max()[dim];
+
+            // the slab distance (slab - o) * 1/d is monotonic in both o and
+            // 1/d, hence its extrema lie at the corners of their ranges
+            const auto range = [&](float slab, float &lo, float &hi) {
+                const float a = slab - packet.originMax[dim];
+                const float b = slab - packet.originMin[dim];
+                const float c[4] = { a * packet.invDirectionMin[dim],
+                                     a * packet.invDirectionMax[dim],
+                                     b * packet.invDirectionMin[dim],
+                                     b * packet.invDirectionMax[dim] };
+                lo = std::min({ c[0], c[1], c[2], c[3] });
+                hi = std::max({ c[0], c[1], c[2], c[3] });
+            };
+            float lo, hi;
+            range(nearSlab, lo, hi);
+            entryMin = max(entryMin, lo);
+            range(farSlab, lo, hi);
+            exitMax = min(exitMax, hi);
+        }
+        return entryMin <= exitMax && exitMax >= Epsilon &&
+               entryMin < packet.tMaxBound;
+    }
+
+    /**
+     * @brief Performs the slab test of a bounding box for the rays of a
+     * packet that are selected by @c rays , four rays at a time.
+     * @param tNear Receives the smallest distance at which any of the rays
+     * enters the bounding box.
+     * @return A bit mask of the rays that hit the bounding box closer than
+     * their @c tMax .
+     */
+    static RayPacket::Mask intersectPacketAABB(const Bounds &bounds,
+                                               const TraversalPacket &packet,
+                                               RayPacket::Mask rays,
+                                               float &tNear) {
+        using simd::Float4;
+
+        tNear = Infinity;
+        if (containsNoPoints(bounds) ||
+            (packet.isCoherent && !intersectInterval(bounds, packet)))
+            return 0;
+
+        Float4 lower[3], upper[3];
+        for (int dim = 0; dim < 3; dim++) {
+            lower[dim] = Float4::broadcast(bounds.min()[dim]);
+            upper[dim] = Float4::broadcast(bounds.max()[dim]);
+        }
+        const Float4 epsilon = Float4::broadcast(Epsilon);
+
+        RayPacket::Mask hit = 0;
+        constexpr RayPacket::Mask LaneBits = (1 << simd::Lanes) - 1;
+        for (RayPacket::Mask remaining = rays; remaining;) {
+            const int first = std::countr_zero(remaining) & ~(simd::Lanes - 1);
+            remaining &= ~(LaneBits << first);
+
+            // the rays of a packet may point in different directions, so
+            // the near and far slabs are sorted per lane
+            Float4 entry = Float4::broadcast(-Infinity);
+            Float4 exit  = Float4::broadcast(+Infinity);
+            for (int dim = 0; dim < 3; dim++) {
+                const Float4 origin = Float4::load(packet.origin[dim] + first);
+                const Float4 invDirection =
+                    Float4::load(packet.invDirection[dim] + first);
+                const Float4 t0 = (lower[dim] - origin) * invDirection;
+                const Float4 t1 = (upper[dim] - origin) * invDirection;
+                entry = max(entry, min(t0, t1));
+                exit  = min(exit, max(t0, t1));
+            }
+
+            const simd::Mask4 mask =
+                (entry <= exit) & (exit >= epsilon) &
+                (entry < Float4::load(packet.tMax + first));
+            const RayPacket::Mask lanes =
+                RayPacket::Mask(mask.bits()) & (rays >> first) & LaneBits;
+            if (!lanes)
+                continue;
+
+            hit |= lanes << first;
+            float entries[simd::Lanes];
+            entry.store(entries);
+            for (int lane = 0; lane < simd::Lanes; lane++) {
+                if (lanes & (1 << lane))
+                    tNear = min(tNear, entries[lane]);
+            }
+        }
+        return hit;
+    }
+
+    /**
+     * @brief Packets with fewer active rays than this are traversed one ray
+     * at a time (e.g., once rays of a packet have spread across many small
+     * instances).
+     */
+    static constexpr int MinPacketRays = 4;
+
+    /// @brief A node (or leaf) that some rays of a packet still need to
+    /// visit.
+    struct PacketStackEntry {
+        /// @brief The index of the node for inner nodes, or the first index
+        /// in m_primitiveIndices for leaves.
+        NodeIndex child;
+        /// @brief For leaves: the number of primitives, or 0 for inner nodes.
+        NodeIndex primitiveCount;
+        /// @brief The rays that hit the bounding box of the node.
+        RayPacket::Mask rays;
+        /// @brief The smallest distance at which any of these rays enters
+        /// the bounding box.
+        float t;
+        /// @brief The bounding box of the node.
+        Bounds bounds;
+        /// @brief The number of leaves that had reported hits when the node
+        /// was pushed.
+        int hitCount;
+    };
+
+    /**
+     * @brief Intersects the BVH with a packet of rays. Each node is fetched
+     * once for all rays that reach it, and its children are tested against
+     * four rays at a time (after culling them for the whole packet using
+     * intersectInterval() where possible). Children are visited in the order
+     * of the closest distance at which any of the rays enters them.
+     * @tparam Width The maximum number of children per node.
+     * @param root The entry for the root node, whose bounding box has
+     * already been tested.
+     * @param forEachChild Called as @code forEachChild(node, visit) @endcode
+     * for inner nodes, and calls @code visit(bounds, child, primitiveCount)
+     * @endcode for each of their children (see PacketStackEntry).
+     * @param intersectLeaf See traversePacket().
+     * @return A bit mask of the rays for which @c intersectLeaf reported a
+     * hit.
+     */
+    template <int Width, bool AnyHit, typename ForEachChild,
+              typename IntersectLeaf>
+    RayPacket::Mask traversePacketNodes(TraversalPacket &packet,
+                                        PacketStackEntry root, float *tMax,
+                                        ForEachChild &&forEachChild,
+                                        IntersectLeaf &&intersectLeaf) const {
+        // every level of the tree can defer all but one of its children
+        PacketStackEntry stack[MaxDepth * (Width - 1) + 1];
+        int stackSize      = 0;
+        stack[stackSize++] = root;
+
+        RayPacket::Mask active         = root.rays;
+        RayPacket::Mask wasIntersected = 0;
+        int hitCount                   = 0;
+        while (stackSize > 0) {
+            PacketStackEntry entry = stack[--stackSize];
+            if constexpr (AnyHit) {
+                // skip rays that have been found to be occluded
+                entry.rays &= active;
+            } else if (entry.hitCount != hitCount) {
+                // some rays might have found a hit closer than the node
+                // since it was pushed, which is worth testing for before
+                // descending into it
+                entry.rays = intersectPacketAABB(
+                    entry.bounds, packet, entry.rays, entry.t);
+            }
+            if (!entry.rays)
+                continue;
+
+            if (entry.primitiveCount > 0) {
+                const RayPacket::Mask hit = intersectLeaf(
+                    entry.child, entry.primitiveCount, entry.rays);
+                if (!hit)
+                    continue;
+                wasIntersected |= hit;
+                hitCount++;
+                if constexpr (AnyHit) {
+                    active &= ~hit;
+                    if (!active)
+                        break;
+                } else {
+                    RayPacket::forEach(
+                        hit, [&](int i) { packet.tMax[i] = tMax[i]; });
+                }
+                continue;
+            }
+
+            // push the children that were hit, so that the closest one ends
+            // up on top of the stack
+            const int firstEntry = stackSize;
+            forEachChild(entry.child,
+                         [&](const Bounds &bounds, NodeIndex child,
+                             NodeIndex primitiveCount) {
+                             float t;
+                             const RayPacket::Mask rays = intersectPacketAABB(
+                                 bounds, packet, entry.rays, t);
+                             if (!rays)
+                                 return;
+
+                             int i = stackSize++;
+                             while (i > firstEntry && stack[i - 1].t < t) {
+                                 stack[i] = stack[i - 1];
+                                 i--;
+                             }
+                             stack[i] = { child, primitiveCount, rays,
+                                          t,     bounds,         hitCount };
+                         });
+        }
+        return wasIntersected;
+    }
+
+    /**
+     * @brief Intersects the wide BVH of the given width with a packet of
+     * rays, in whichever format it has been stored.
+     */
+    template <int Width, bool AnyHit, typename IntersectLeaf>
+    RayPacket::Mask traversePacketWidth(TraversalPacket &packet,
+                                        PacketStackEntry root, float *tMax,
+                                        IntersectLeaf &&intersectLeaf) const {
+        const auto traverseWith = [&](const auto &nodes) {
+            return traversePacketNodes<Width, AnyHit>(
+                packet,
+                root,
+                tMax,
+                [&](NodeIndex index, auto &&visit) {
+                    const auto &node = nodes[index];
+                    for (int slot = 0; slot < Width; slot++) {
+                        if (node.primitiveCount[slot] != -1)
+                            visit(node.childBounds(slot),
+                                  node.child[slot],
+                                  node.primitiveCount[slot]);
+                    }
+                },
+                intersectLeaf);
+        };
+        switch (m_quantization) {
+        case 8:
+            return traverseWith(quantizedNodes<Width, uint8_t>());
+        case 16:
+            return traverseWith(quantizedNodes<Width, uint16_t>());
+        default:
+            return traverseWith(wideNodes<Width>());
+        }
+    }
+
+    /**
+     * @brief A primitive as seen by the BVH builder. The bounding box and
+     * centroid of each primitive are queried only once and cached here, and
+     * the builder re-orders these references instead of m_primitiveIndices.
+     */
+    struct BuildReference {
+        /// @brief The bounding box of the primitive.
+        Bounds bounds;
+        /// @brief The centroid of the primitive.
+        Point centroid;
+        /// @brief The index of the primitive as used by the interface methods.
+        int primitiveIndex;
+    };
+
+    /// @brief State shared by all threads that take part in a BVH build.
+    struct BuildState {
+        /// @brief The primitive references, re-ordered so that the children of
+        /// each node are contiguous.
+        std::vector<BuildReference> references;
+        /// @brief The bounding box of the primitive centroids of each node.
+        std::vector<Bounds> centroidBounds;
+        /// @brief The number of entries of m_nodes that are already in use.
+        std::atomic<NodeIndex> nodeCount;
+        /// @brief The number of threads available for building (querying this
+        /// is surprisingly expensive, hence we cache it).
+        int numThreads;
+        /// @brief Subtrees whose root lies above this depth are built on
+        /// separate threads.
+        int parallelDepth;
+        /// @brief For spatial split builds: the number of additional
+        /// references that may still be created by splitting primitives.
+        int64_t remainingDuplicates = 0;
+        /// @brief For spatial split builds: the surface area of the root node.
+        float rootArea = 0;
+    };
+
+    /// @brief The cost of traversing a node relative to the cost of
+    /// intersecting a single primitive, as assumed by the SAH.
+    static constexpr float TraversalCost = 0.125f;
+
+    /**
+     * @brief Spatial splits are only considered for nodes whose object split
+     * yields children that overlap in an area larger than this fraction of
+     * the root node's surface area (the alpha parameter of Stich et al.).
+     */
+    static constexpr float SpatialSplitOverlap = 1e-5f;
+
+    /// @brief Nodes with at least this many primitives are binned using
+    /// multiple threads.
+    static constexpr NodeIndex ParallelBinningThreshold = 1 << 16;
+    /// @brief Nodes with at least this many primitives hand one of their
+    /// subtrees to another thread.
+    static constexpr NodeIndex ParallelSubtreeThreshold = 1 << 12;
+
+    /// @brief Returns the number of chunks that a range of @c count items is
+    /// split into for parallel processing.
+    static int chunkCount(const BuildState &state, NodeIndex count,
+                          NodeIndex grainSize) {
+        return std::max(1, std::min(state.numThreads, int(count / grainSize)));
+    }
+
+    /**
+     * @brief Splits the range from @c first to @c last into @c numChunks
+     * contiguous chunks and invokes @code f(chunk, chunkFirst, chunkLast)
+     * @endcode for each of them concurrently.
+     */
+    template <typename Function>
+    static void parallelChunks(int numChunks, NodeIndex first, NodeIndex last,
+                               Function f) {
+        if (numChunks <= 1) {
+            f(0, first, last);
+            return;
+        }
+
+        const auto bound = [&](int chunk) {
+            return NodeIndex(first + int64_t(last - first) * chunk / numChunks);
+        };
+
+        ThreadPool::global().parallelFor(numChunks, [&](int64_t chunk) {
+            f(int(chunk), bound(int(chunk)), bound(int(chunk) + 1));
+        });
+    }
+
+    /**
+     * @brief Computes the axis aligned bounding box for a leaf BVH node, as
+     * well as the bounding box of the centroids of its primitives (used for
+     * binning).
+     */
+    void computeAABB(BuildState &state, NodeIndex nodeIndex) {
+        Node &node     = m_nodes[nodeIndex];
+        node.aabb      = Bounds::empty();
+        Bounds &centroids = state.centroidBounds[nodeIndex];
+        centroids      = Bounds::empty();
         for (NodeIndex i = 0; i < node.primitiveCount; i++) {
-            const Bounds childAABB =
-                getBoundingBox(m_primitiveIndices[node.leftFirst + i]);
-            node.aabb.extend(childAABB); // extend the bounding box
+            const BuildReference &ref = state.references[node.leftFirst + i];
+            node.aabb.extend(ref.bounds); // extend the bounding box
+            centroids.extend(ref.centroid);
         }
     }
 
@@ -181,68 +1147,94 @@ class AccelerationStructure : public Shape {
     }
 
     /**
-     * For a given node, computes split axis and split position that minimize
-     * the surface area heuristic.
-     * @param node The BVH node to compute the split for.
+     * For a given set of primitives, computes split axis and split position
+     * that minimize the surface area heuristic.
+     * @param references The primitives of the BVH node to compute the split
+     * for.
+     * @param aabb The bounding box of the BVH node.
+     * @param all_centroids The bounding box of the centroids of the primitives.
      * @param out bestSplitAxis The optimal split axis, or -1 if no useful split
      * exists
      * @param out bestSplitPosition The optimal split position, undefined if no
      * useful split exists
+     * @return The SAH cost of the split (relative to the cost of intersecting
+     * a single primitive), or Infinity if no useful split exists.
      */
-    void binning(const Node &node, int &bestSplitAxis,
-                 float &bestSplitPosition) {
-        // NOT_IMPLEMENTED        
+    float binning(const BuildState &state,
+                  std::span<const BuildReference> references,
+                  const Bounds &aabb, const Bounds &all_centroids,
+                  int &bestSplitAxis, float &bestSplitPosition) {
         constexpr int NumBins = 16; // Number of bins for SAH
         struct Bin {
             Bounds bounds = Bounds::empty();
             int count = 0;
         };
+        typedef std::array<std::array<Bin, NumBins>, Bounds::Dimension> BinSet;
 
         bestSplitAxis = -1;
         bestSplitPosition = 0;
         float bestCost = Infinity;
 
         // Check if the bounding box is valid
-        if (node.aabb.isEmpty() || node.primitiveCount <= 1) {
-            return; // No split is needed for empty or single-primitive nodes
+        if (aabb.isEmpty() || references.size() <= 1) {
+            return bestCost; // No split is needed for empty or single-primitive nodes
+        }
+
+        const NodeIndex count = NodeIndex(references.size());
+        const int numChunks =
+            chunkCount(state, count, ParallelBinningThreshold);
+
+        float minCoord[Bounds::Dimension];
+        float scale[Bounds::Dimension];
+        for (int axis = 0; axis < Bounds::Dimension; ++axis) {
+            minCoord[axis]    = all_centroids.min()[axis];
+            const float range = all_centroids.max()[axis] - minCoord[axis];
+            // axes with negligible range are skipped
+            scale[axis] = range <= Epsilon ? 0 : NumBins / range;
         }
 
-        // Get all centroids
-        Bounds all_centroids;
-        for (int i = 0; i < node.primitiveCount; ++i){
-            int primitiveIndex = m_primitiveIndices[node.leftFirst + i];
-            Point centroid = getCentroid(primitiveIndex);
-            all_centroids.extend(centroid);
+        // Bin assignment: Group primitives into bins (for all axes in a single
+        // pass, and in parallel for large nodes)
+        // avoid a heap allocation for the common case of small nodes
+        BinSet localBins;
+        std::vector<BinSet> parallelBins;
+        std::span<BinSet> chunkBins(&localBins, 1);
+        if (numChunks > 1) {
+            parallelBins.resize(numChunks);
+            chunkBins = parallelBins;
         }
+        parallelChunks(
+            numChunks, 0, count,
+            [&](int chunk, NodeIndex begin, NodeIndex end) {
+                BinSet &bins = chunkBins[chunk];
+                for (NodeIndex i = begin; i < end; ++i) {
+                    const BuildReference &ref = references[i];
+                    for (int axis = 0; axis < Bounds::Dimension; ++axis) {
+                        if (scale[axis] == 0)
+                            continue;
+                        int binIndex = int((ref.centroid[axis] - minCoord[axis]) *
+                                           scale[axis]);
+                        binIndex = clamp(binIndex, 0, NumBins - 1);
+
+                        bins[axis][binIndex].count++;
+                        bins[axis][binIndex].bounds.extend(ref.bounds);
+                    }
+                }
+            });
 
         // Iterate over each axis to find the best split
+        const float totalSurfaceArea = surfaceArea(aabb);
         for (int axis = 0; axis < Bounds::Dimension; ++axis) {
-            // float minCoord = node.aabb.min()[axis];
-            // float maxCoord = node.aabb.max()[axis];
-            float minCoord = all_centroids.min()[axis];
-            float maxCoord = all_centroids.max()[axis];
-            float range = maxCoord - minCoord;
-
-            if (range <= Epsilon) {
+            if (scale[axis] == 0) {
                 continue; // Skip axis with negligible range
             }
 
-            float scale = NumBins / range;
             Bin bins[NumBins] = {};
-
-            // Bin assignment: Group primitives into bins
-            for (int i = 0; i < node.primitiveCount; ++i) {
-                int primitiveIndex = m_primitiveIndices[node.leftFirst + i];
-                if (primitiveIndex < 0 || primitiveIndex >= int(m_primitiveIndices.size())) {
-                    continue; // Ignore invalid primitive indices
+            for (const BinSet &chunk : chunkBins) {
+                for (int i = 0; i < NumBins; ++i) {
+                    bins[i].count += chunk[axis][i].count;
+                    bins[i].bounds.extend(chunk[axis][i].bounds);
                 }
-
-                Point centroid = getCentroid(primitiveIndex);
-                int binIndex = int((centroid[axis] - minCoord) * scale);
-                binIndex = clamp(binIndex, 0, NumBins - 1);
-
-                bins[binIndex].count++;
-                bins[binIndex].bounds.extend(getBoundingBox(primitiveIndex));
             }
 
             // Compute cumulative data for SAH evaluation
@@ -268,17 +1260,16 @@ class AccelerationStructure : public Shape {
             }
 
             // Evaluate split cost using SAH
-            float totalSurfaceArea = surfaceArea(node.aabb);
             for (int i = 0; i < NumBins - 1; ++i) {
                 float leftArea = surfaceArea(leftBounds[i]);
                 float rightArea = surfaceArea(rightBounds[i + 1]);
 
-                float splitCost = 0.125f + (leftCounts[i] * leftArea + rightCounts[i + 1] * rightArea) / totalSurfaceArea;
+                float splitCost = TraversalCost + (leftCounts[i] * leftArea + rightCounts[i + 1] * rightArea) / totalSurfaceArea;
 
                 if (splitCost < bestCost) {
                     bestCost = splitCost;
                     bestSplitAxis = axis;
-                    bestSplitPosition = minCoord + (i + 1) / scale;
+                    bestSplitPosition = minCoord[axis] + (i + 1) / scale[axis];
                 }
             }
         }
@@ -287,15 +1278,21 @@ class AccelerationStructure : public Shape {
         if (bestSplitAxis == -1) {
             std::cerr << "Warning: No valid split found for node. Assigning default split.\n";
             bestSplitAxis = 0; // Default to the first axis
-            bestSplitPosition = (node.aabb.min()[0] + node.aabb.max()[0]) / 2.0f;
+            bestSplitPosition = (aabb.min()[0] + aabb.max()[0]) / 2.0f;
         }
 
+        return bestCost;
         } // end code
 
     /// @brief Attempts to subdivide a given BVH node.
-    void subdivide(Node &parent) {
-        // only subdivide if enough children are available.
-        if (parent.primitiveCount <= 2) {
+    void subdivide(BuildState &state, NodeIndex nodeIndex, int depth = 1) {
+        // nodes are pre-allocated, so this reference stays valid even while
+        // other threads are adding nodes
+        Node &parent = m_nodes[nodeIndex];
+
+        // only subdivide if enough children are available, and the traversal
+        // stack can still accommodate another level.
+        if (parent.primitiveCount <= m_maxLeafSize || depth >= MaxDepth) {
             return;
         }
 
@@ -306,7 +1303,14 @@ class AccelerationStructure : public Shape {
         float splitPosition;
         if (UseSAH) {
             // pick split axis and position using binned SAH
-            binning(parent, splitAxis, splitPosition);
+            binning(state,
+                    std::span(state.references)
+                        .subspan(parent.firstPrimitiveIndex(),
+                                 parent.primitiveCount),
+                    parent.aabb,
+                    state.centroidBounds[nodeIndex],
+                    splitAxis,
+                    splitPosition);
         } else {
             // split in the middle of the longest axis
             splitAxis     = parent.aabb.diagonal().maxComponentIndex();
@@ -326,13 +1330,14 @@ class AccelerationStructure : public Shape {
         NodeIndex lastLeftIndex   = parent.lastPrimitiveIndex();
 
         // partition algorithm (you might remember this from quicksort)
+        auto &references = state.references;
         while (firstRightIndex <= lastLeftIndex) {
-            if (getCentroid(m_primitiveIndices[firstRightIndex])[splitAxis] <
+            if (references[firstRightIndex].centroid[splitAxis] <
                 splitPosition) {
                 firstRightIndex++;
             } else {
-                std::swap(m_primitiveIndices[firstRightIndex],
-                          m_primitiveIndices[lastLeftIndex--]);
+                std::swap(references[firstRightIndex],
+                          references[lastLeftIndex--]);
             }
         }
 
@@ -346,76 +1351,2027 @@ class AccelerationStructure : public Shape {
         }
 
         // the two children will always be contiguous in our m_nodes list
-        const NodeIndex leftChildIndex  = (NodeIndex) (m_nodes.size() + 0);
-        const NodeIndex rightChildIndex = (NodeIndex) (m_nodes.size() + 1);
+        const NodeIndex leftChildIndex  = state.nodeCount.fetch_add(2);
+        const NodeIndex rightChildIndex = leftChildIndex + 1;
+        const bool buildInParallel =
+            depth < state.parallelDepth &&
+            parent.primitiveCount >= ParallelSubtreeThreshold;
         parent.primitiveCount = 0; // mark the parent node as internal node
         parent.leftFirst      = leftChildIndex;
 
-        m_nodes.emplace_back();
         m_nodes[leftChildIndex].leftFirst      = firstLeftIndex;
         m_nodes[leftChildIndex].primitiveCount = leftCount;
 
-        m_nodes.emplace_back();
         m_nodes[rightChildIndex].leftFirst      = firstRightIndex;
         m_nodes[rightChildIndex].primitiveCount = rightCount;
 
-        // first, process the left child node (and all of its children)
-        computeAABB(m_nodes[leftChildIndex]);
-        subdivide(m_nodes[leftChildIndex]);
-        // then, process the right child node (and all of its children)
-        computeAABB(m_nodes[rightChildIndex]);
-        subdivide(m_nodes[rightChildIndex]);
+        computeAABB(state, leftChildIndex);
+        computeAABB(state, rightChildIndex);
+
+        if (buildInParallel) {
+            // hand the left child (and all of its children) to another thread,
+            // while this thread takes care of the right child
+            ThreadPool::global().parallelFor(2, [&](int64_t child) {
+                subdivide(state,
+                          child ? rightChildIndex : leftChildIndex,
+                          depth + 1);
+            });
+        } else {
+            // first, process the left child node (and all of its children)
+            subdivide(state, leftChildIndex, depth + 1);
+            // then, process the right child node (and all of its children)
+            subdivide(state, rightChildIndex, depth + 1);
+        }
     }
 
-protected:
-    /// @brief Returns the number of children (individual shapes) that are part
-    /// of this acceleration structure.
-    virtual int numberOfPrimitives() const = 0;
-    /// @brief Intersect a single child (identified by the index) with the given
-    /// ray.
-    virtual bool intersect(int primitiveIndex, const Ray &ray,
-                           Intersection &its, Sampler &rng) const = 0;
-    /// @brief Returns the axis aligned bounding box of the given child.
-    virtual Bounds getBoundingBox(int primitiveIndex) const = 0;
-    /// @brief Returns the centroid of the given child.
-    virtual Point getCentroid(int primitiveIndex) const = 0;
-
-    /// @brief Builds the acceleration structure.
-    void buildAccelerationStructure() {
-        Timer buildTimer;
+    /**
+     * @brief For a given set of primitives, computes the spatial split (i.e.,
+     * a split that may cut primitives into two parts) that minimizes the
+     * surface area heuristic. Primitives are chopped into the bins they
+     * overlap, so that the bins only grow by the parts of the primitives that
+     * actually lie within them.
+     * @param out bestSplitAxis The optimal split axis, or -1 if no useful split
+     * exists
+     * @param out bestSplitPosition The optimal split position, undefined if no
+     * useful split exists
+     * @return The SAH cost of the split, or Infinity if no useful split
+     * exists.
+     */
+    template <typename PrimitiveSource>
+    float spatialBinning(const PrimitiveSource &source,
+                         std::span<const BuildReference> references,
+                         const Bounds &aabb, int &bestSplitAxis,
+                         float &bestSplitPosition) const {
+        constexpr int NumBins = 16;
+        struct Bin {
+            Bounds bounds = Bounds::empty();
+            /// @brief The number of references that start in this bin.
+            int entries = 0;
+            /// @brief The number of references that end in this bin.
+            int exits = 0;
+        };
 
-        // fill primitive indices with 0 to primitiveCount - 1
-        m_primitiveIndices.resize(numberOfPrimitives());
-        std::iota(m_primitiveIndices.begin(), m_primitiveIndices.end(), 0);
+        bestSplitAxis  = -1;
+        float bestCost = Infinity;
 
-        // create root node
-        auto &root          = m_nodes.emplace_back();
-        root.leftFirst      = 0;
-        root.primitiveCount = numberOfPrimitives();
-        computeAABB(root);
-        subdivide(root);
+        const float totalSurfaceArea = surfaceArea(aabb);
+        for (int axis = 0; axis < Bounds::Dimension; ++axis) {
+            const float minCoord = aabb.min()[axis];
+            const float range    = aabb.max()[axis] - minCoord;
+            if (range <= Epsilon) {
+                continue; // Skip axis with negligible range
+            }
+            const float scale = NumBins / range;
 
-        logger(EInfo,
-               "built BVH with %ld nodes for %ld primitives in %.1f ms",
-               m_nodes.size(),
-               numberOfPrimitives(),
-               buildTimer.getElapsedTime() * 1000);
-    }
+            Bin bins[NumBins] = {};
+            for (const BuildReference &ref : references) {
+                const int firstBin = clamp(
+                    int((ref.bounds.min()[axis] - minCoord) * scale),
+                    0, NumBins - 1);
+                const int lastBin = clamp(
+                    int((ref.bounds.max()[axis] - minCoord) * scale),
+                    firstBin, NumBins - 1);
 
-public:
-    bool intersect(const Ray &ray, Intersection &its,
-                   Sampler &rng) const override {
+                // chop the primitive at every bin boundary it straddles
+                Bounds remainder = ref.bounds;
+                for (int bin = firstBin; bin < lastBin; ++bin) {
+                    Bounds left, right;
+                    source.splitPrimitive(ref.primitiveIndex, axis,
+                                          minCoord + (bin + 1) / scale,
+                                          remainder, left, right);
+                    bins[bin].bounds.extend(left);
+                    remainder = right;
+                }
+                bins[lastBin].bounds.extend(remainder);
+                bins[firstBin].entries++;
+                bins[lastBin].exits++;
+            }
+
+            Bounds rightBounds[NumBins] = {};
+            int rightCounts[NumBins] = {0};
+            rightBounds[NumBins - 1] = bins[NumBins - 1].bounds;
+            rightCounts[NumBins - 1] = bins[NumBins - 1].exits;
+            for (int i = NumBins - 2; i >= 0; --i) {
+                rightBounds[i] = rightBounds[i + 1];
+                rightBounds[i].extend(bins[i].bounds);
+                rightCounts[i] = rightCounts[i + 1] + bins[i].exits;
+            }
+
+            Bounds leftBounds = Bounds::empty();
+            int leftCount     = 0;
+            for (int i = 0; i < NumBins - 1; ++i) {
+                leftBounds.extend(bins[i].bounds);
+                leftCount += bins[i].entries;
+                if (leftCount == 0 || rightCounts[i + 1] == 0)
+                    continue;
+
+                const float splitCost =
+                    TraversalCost + (leftCount * surfaceArea(leftBounds) +
+                              rightCounts[i + 1] *
+                                  surfaceArea(rightBounds[i + 1])) /
+                                 totalSurfaceArea;
+                if (splitCost < bestCost) {
+                    bestCost          = splitCost;
+                    bestSplitAxis     = axis;
+                    bestSplitPosition = minCoord + (i + 1) / scale;
+                }
+            }
+        }
+
+        return bestCost;
+    }
+
+    /**
+     * @brief Subdivides a BVH node considering both object splits and spatial
+     * splits (SBVH, Stich et al. 2009). Since spatial splits duplicate
+     * references, every node owns its own list of references, and the
+     * references of leaf nodes are appended to @c state.references .
+     */
+    template <typename PrimitiveSource>
+    void subdivideSpatial(const PrimitiveSource &source, BuildState &state,
+                          NodeIndex nodeIndex,
+                          std::vector<BuildReference> &&references,
+                          int depth = 1) {
+        Node &node = m_nodes[nodeIndex];
+        node.aabb  = Bounds::empty();
+        Bounds centroids;
+        for (const BuildReference &ref : references) {
+            node.aabb.extend(ref.bounds);
+            centroids.extend(ref.centroid);
+        }
+
+        const auto makeLeaf = [&]() {
+            node.leftFirst      = NodeIndex(state.references.size());
+            node.primitiveCount = NodeIndex(references.size());
+            state.references.insert(
+                state.references.end(), references.begin(), references.end());
+        };
+
+        // only subdivide if enough children are available, and the traversal
+        // stack can still accommodate another level.
+        if (references.size() <= size_t(m_maxLeafSize) || depth >= MaxDepth) {
+            makeLeaf();
+            return;
+        }
+
+        // find the best object split
+        int splitAxis;
+        float splitPosition;
+        const float objectCost = binning(
+            state, references, node.aabb, centroids, splitAxis, splitPosition);
+        if (splitAxis == -1) {
+            makeLeaf();
+            return;
+        }
+
+        std::vector<BuildReference> left, right;
+        Bounds leftBounds, rightBounds;
+        for (const BuildReference &ref : references) {
+            if (ref.centroid[splitAxis] < splitPosition) {
+                left.push_back(ref);
+                leftBounds.extend(ref.bounds);
+            } else {
+                right.push_back(ref);
+                rightBounds.extend(ref.bounds);
+            }
+        }
+
+        // spatial splits only pay off if the children of the object split
+        // overlap noticeably
+        const Bounds childOverlap = overlap(leftBounds, rightBounds);
+        if (state.remainingDuplicates > 0 && !containsNoPoints(childOverlap) &&
+            surfaceArea(childOverlap) > SpatialSplitOverlap * state.rootArea) {
+            int spatialAxis;
+            float spatialPosition;
+            const float spatialCost = spatialBinning(
+                source, references, node.aabb, spatialAxis, spatialPosition);
+
+            if (spatialAxis != -1 && spatialCost < objectCost) {
+                std::vector<BuildReference> spatialLeft, spatialRight;
+                int64_t duplicates = 0;
+                for (const BuildReference &ref : references) {
+                    if (ref.bounds.max()[spatialAxis] <= spatialPosition) {
+                        spatialLeft.push_back(ref);
+                    } else if (ref.bounds.min()[spatialAxis] >=
+                               spatialPosition) {
+                        spatialRight.push_back(ref);
+                    } else {
+                        // the primitive straddles the split plane, hence
+                        // each child receives the part on its side
+                        Bounds leftPart, rightPart;
+                        source.splitPrimitive(ref.primitiveIndex,
+                                              spatialAxis, spatialPosition,
+                                              ref.bounds, leftPart, rightPart);
+                        const bool inLeft  = !containsNoPoints(leftPart);
+                        const bool inRight = !containsNoPoints(rightPart);
+                        if (inLeft)
+                            spatialLeft.push_back(
+                                { leftPart, leftPart.center(),
+                                  ref.primitiveIndex });
+                        if (inRight)
+                            spatialRight.push_back(
+                                { rightPart, rightPart.center(),
+                                  ref.primitiveIndex });
+                        if (inLeft && inRight)
+                            duplicates++;
+                    }
+                }
+
+                if (duplicates <= state.remainingDuplicates &&
+                    !spatialLeft.empty() && !spatialRight.empty()) {
+                    state.remainingDuplicates -= duplicates;
+                    left  = std::move(spatialLeft);
+                    right = std::move(spatialRight);
+                }
+            }
+        }
+
+        if (left.empty() || right.empty()) {
+            // if either child gets no primitives, we abort subdividing
+            makeLeaf();
+            return;
+        }
+
+        // release the memory of this node before descending
+        references.clear();
+        references.shrink_to_fit();
+
+        // the two children will always be contiguous in our m_nodes list
+        const NodeIndex leftChildIndex = state.nodeCount.fetch_add(2);
+        node.primitiveCount = 0; // mark the parent node as internal node
+        node.leftFirst      = leftChildIndex;
+
+        subdivideSpatial(source, state, leftChildIndex, std::move(left),
+                         depth + 1);
+        subdivideSpatial(source, state, leftChildIndex + 1, std::move(right),
+                         depth + 1);
+    }
+
+    /// @brief A run of Morton sorted references that share the leading
+    /// @ref HlbvhClusterBits bits of their codes.
+    struct MortonCluster {
+        NodeIndex first;
+        NodeIndex count;
+    };
+
+    /**
+     * @brief The number of leading Morton code bits that group references
+     * into the clusters of the HLBVH builder, over which the top levels of
+     * the tree are built using the SAH (12 bits yield up to 4096 clusters).
+     */
+    static constexpr int HlbvhClusterBits = 12;
+
+    /// @brief Inserts two zero bits after each of the lower 21 bits of @c x
+    /// (so that three of these can be interleaved into a Morton code).
+    static uint64_t spreadBits(uint64_t x) {
+        x &= 0x1fffff;
+        x = (x | x << 32) & 0x1f00000000ffff;
+        x = (x | x << 16) & 0x1f0000ff0000ff;
+        x = (x | x << 8) & 0x100f00f00f00f00f;
+        x = (x | x << 4) & 0x10c30c30c30c30c3;
+        x = (x | x << 2) & 0x1249249249249249;
+        return x;
+    }
+
+    /**
+     * @brief Sorts keys by a range of their bits using a parallel LSD radix
+     * sort with 11 bit digits. For each digit, every chunk counts its keys
+     * per bucket and then scatters them to the positions given by the prefix
+     * sum over all chunks, which keeps the sort stable.
+     * @param firstBit The lowest bit that the keys are sorted by.
+     * @param lastBit The bit above the highest bit that the keys are sorted
+     * by.
+     */
+    static void radixSort(const BuildState &state, std::vector<uint64_t> &keys,
+                          int firstBit, int lastBit) {
+        constexpr int DigitBits = 11;
+        constexpr int Buckets   = 1 << DigitBits;
+
+        const NodeIndex count = NodeIndex(keys.size());
+        if (count < 2)
+            return; // already sorted
+        const int numChunks =
+            chunkCount(state, count, ParallelSubtreeThreshold);
+        std::vector<uint64_t> buffer(keys.size());
+        std::vector<std::array<NodeIndex, Buckets>> offsets(numChunks);
+
+        for (int shift = firstBit; shift < lastBit; shift += DigitBits) {
+            const auto digit = [&](uint64_t key) {
+                return int(key >> shift) & (Buckets - 1);
+            };
+
+            parallelChunks(numChunks, 0, count,
+                           [&](int chunk, NodeIndex begin, NodeIndex end) {
+                               auto &histogram = offsets[chunk];
+                               histogram.fill(0);
+                               for (NodeIndex i = begin; i < end; i++)
+                                   histogram[digit(keys[i])]++;
+                           });
+
+            // skip the pass if all keys share this digit (e.g., the unused
+            // high bits), which only the histograms of all chunks together
+            // can tell
+            NodeIndex sharedDigitCount = 0;
+            for (const auto &histogram : offsets)
+                sharedDigitCount += histogram[digit(keys[0])];
+            if (sharedDigitCount == count)
+                continue;
+
+            // turn the histograms into output positions
+            NodeIndex position = 0;
+            for (int bucket = 0; bucket < Buckets; bucket++) {
+                for (auto &histogram : offsets) {
+                    const NodeIndex bucketCount = histogram[bucket];
+                    histogram[bucket]           = position;
+                    position += bucketCount;
+                }
+            }
+
+            parallelChunks(numChunks, 0, count,
+                           [&](int chunk, NodeIndex begin, NodeIndex end) {
+                               auto &histogram = offsets[chunk];
+                               for (NodeIndex i = begin; i < end; i++)
+                                   buffer[histogram[digit(keys[i])]++] =
+                                       keys[i];
+                           });
+            keys.swap(buffer);
+        }
+    }
+
+    /**
+     * @brief Emits the subtree over a range of Morton sorted references into
+     * a given node. Each range is split where the highest bit in which its
+     * keys differ flips, i.e., in the middle of the part of the Morton curve
+     * it covers (references within the same cell are told apart by the index
+     * bits of their keys). Finding the split is a binary search, and no
+     * references need to be moved, so the hierarchy is emitted in (almost)
+     * linear time.
+     * @param keys The sorted keys of @c state.references (see buildMorton()).
+     * @return The bounding box of the subtree.
+     */
+    Bounds emitMorton(BuildState &state, std::span<const uint64_t> keys,
+                      NodeIndex nodeIndex, NodeIndex first, NodeIndex count,
+                      int depth) {
+        // nodes are pre-allocated, so this reference stays valid even while
+        // other threads are adding nodes
+        Node &node = m_nodes[nodeIndex];
+
+        if (count <= m_maxLeafSize || depth >= MaxDepth) {
+            node.leftFirst      = first;
+            node.primitiveCount = count;
+            node.aabb           = Bounds::empty();
+            for (NodeIndex i = first; i < first + count; i++)
+                node.aabb.extend(state.references[i].bounds);
+            return node.aabb;
+        }
+
+        // keys are unique, and all keys of the range agree above this bit
+        const int bit =
+            std::bit_width(keys[first] ^ keys[first + count - 1]) - 1;
+        const NodeIndex split = NodeIndex(
+            std::partition_point(
+                keys.begin() + first, keys.begin() + first + count,
+                [&](uint64_t key) { return !((key >> bit) & 1); }) -
+            keys.begin());
+
+        // the two children will always be contiguous in our m_nodes list
+        const NodeIndex leftChildIndex = state.nodeCount.fetch_add(2);
+        node.primitiveCount = 0; // mark the node as internal node
+        node.leftFirst      = leftChildIndex;
+
+        const auto emitLeft = [&]() {
+            return emitMorton(state, keys, leftChildIndex, first,
+                              split - first, depth + 1);
+        };
+        const auto emitRight = [&]() {
+            return emitMorton(state, keys, leftChildIndex + 1, split,
+                              first + count - split, depth + 1);
+        };
+
+        if (depth < state.parallelDepth && count >= ParallelSubtreeThreshold) {
+            Bounds bounds[2];
+            ThreadPool::global().parallelFor(2, [&](int64_t child) {
+                bounds[child] = child ? emitRight() : emitLeft();
+            });
+            node.aabb = bounds[0];
+            node.aabb.extend(bounds[1]);
+        } else {
+            node.aabb = emitLeft();
+            node.aabb.extend(emitRight());
+        }
+        return node.aabb;
+    }
+
+    /**
+     * @brief Builds the top levels of an HLBVH by partitioning the clusters
+     * with the binned SAH over their bounding boxes. Clusters that end up in
+     * a node on their own are recorded in @c leaves , so that their LBVH
+     * subtrees can be emitted in parallel afterwards.
+     * @param clusters The bounds of the clusters, with @c primitiveIndex
+     * referring to the clusters they describe.
+     */
+    void buildClusterTree(
+        BuildState &state, std::span<BuildReference> clusters,
+        NodeIndex nodeIndex, int depth,
+        std::vector<std::tuple<NodeIndex, NodeIndex, int>> &leaves) {
+        if (clusters.size() == 1) {
+            leaves.emplace_back(nodeIndex, clusters.front().primitiveIndex,
+                                depth);
+            return;
+        }
+
+        Node &node = m_nodes[nodeIndex];
+        node.aabb  = Bounds::empty();
+        Bounds centroids;
+        for (const BuildReference &cluster : clusters) {
+            node.aabb.extend(cluster.bounds);
+            centroids.extend(cluster.centroid);
+        }
+
+        // clusters follow the Morton curve, so halving their list is a
+        // reasonable fallback that also limits the depth of the top levels
+        // (which leaves room for the subtrees below)
+        size_t split = clusters.size() / 2;
+        if (depth < 2 * HlbvhClusterBits &&
+            !(centroids.diagonal().maxComponent() <= Epsilon)) {
+            int splitAxis;
+            float splitPosition;
+            binning(state, clusters, node.aabb, centroids, splitAxis,
+                    splitPosition);
+            const size_t firstRight =
+                std::partition(clusters.begin(), clusters.end(),
+                               [&](const BuildReference &cluster) {
+                                   return cluster.centroid[splitAxis] <
+                                          splitPosition;
+                               }) -
+                clusters.begin();
+            if (firstRight > 0 && firstRight < clusters.size())
+                split = firstRight;
+        }
+
+        const NodeIndex leftChildIndex = state.nodeCount.fetch_add(2);
+        node.primitiveCount = 0; // mark the node as internal node
+        node.leftFirst      = leftChildIndex;
+        buildClusterTree(state, clusters.first(split), leftChildIndex,
+                         depth + 1, leaves);
+        buildClusterTree(state, clusters.subspan(split), leftChildIndex + 1,
+                         depth + 1, leaves);
+    }
+
+    /**
+     * @brief Builds the binary BVH from the Morton codes of the primitive
+     * centroids (LBVH, Lauterbach et al. 2009), with the top levels
+     * optionally built using the SAH (HLBVH, Pantaleoni and Luebke 2010).
+     * This trades some traversal performance for build times that are
+     * dominated by a few linear passes over the primitives.
+     */
+    void buildMorton(BuildState &state) {
+        const NodeIndex count = NodeIndex(state.references.size());
+        if (count == 0) {
+            m_nodes.front() = { Bounds::empty(), 0, 0 };
+            return;
+        }
+        const int numChunks =
+            chunkCount(state, count, ParallelSubtreeThreshold);
+
+        // the Morton codes are relative to the bounds of the centroids
+        std::vector<Bounds> chunkCentroids(numChunks);
+        parallelChunks(numChunks, 0, count,
+                       [&](int chunk, NodeIndex begin, NodeIndex end) {
+                           for (NodeIndex i = begin; i < end; i++)
+                               chunkCentroids[chunk].extend(
+                                   state.references[i].centroid);
+                       });
+        Bounds centroids;
+        for (const Bounds &bounds : chunkCentroids)
+            centroids.extend(bounds);
+
+        // the keys we sort hold the Morton code above the index of the
+        // reference, which makes them unique and halves the memory traffic of
+        // the sort (compared to separate codes and indices), at the cost of
+        // coarser codes for large meshes (between 30 and 63 bits)
+        const int indexBits = std::bit_width(unsigned(count));
+        const int axisBits  = std::clamp((64 - indexBits) / 3, 10, 21);
+        const int codeBits  = 3 * axisBits;
+        const uint64_t indexMask = (uint64_t(1) << indexBits) - 1;
+        const float cells        = float((1 << axisBits) - 1);
+        float scale[Bounds::Dimension];
+        for (int dim = 0; dim < Bounds::Dimension; dim++) {
+            const float range = centroids.max()[dim] - centroids.min()[dim];
+            scale[dim] = range > 0 && std::isfinite(range) ? cells / range : 0;
+        }
+
+        std::vector<uint64_t> keys(count);
+        parallelChunks(
+            numChunks, 0, count,
+            [&](int, NodeIndex begin, NodeIndex end) {
+                for (NodeIndex i = begin; i < end; i++) {
+                    const Point &centroid = state.references[i].centroid;
+                    uint64_t code         = 0;
+                    for (int dim = 0; dim < Bounds::Dimension; dim++) {
+                        const float offset =
+                            (centroid[dim] - centroids.min()[dim]) * scale[dim];
+                        // also catches NaN for unbounded primitives
+                        const uint64_t cell =
+                            offset > 0 ? uint64_t(std::min(offset, cells)) : 0;
+                        code |= spreadBits(cell) << (2 - dim);
+                    }
+                    keys[i] = code << indexBits | uint64_t(i);
+                }
+            });
+        // the keys start out sorted by index, so the stable sort only needs
+        // to look at the bits of the codes
+        radixSort(state, keys, indexBits, indexBits + codeBits);
+
+        // re-order the references along the Morton curve
+        std::vector<BuildReference> references(count);
+        parallelChunks(numChunks, 0, count,
+                       [&](int, NodeIndex begin, NodeIndex end) {
+                           for (NodeIndex i = begin; i < end; i++)
+                               references[i] =
+                                   state.references[keys[i] & indexMask];
+                       });
+        state.references = std::move(references);
+
+        if (m_builder == BuildStrategy::Lbvh) {
+            emitMorton(state, keys, 0, 0, count, 1);
+            return;
+        }
+
+        // find the clusters of the HLBVH, i.e., the runs of keys whose codes
+        // agree on their leading bits
+        const int clusterShift = indexBits + codeBits - HlbvhClusterBits;
+        std::vector<MortonCluster> clusters;
+        for (NodeIndex first = 0; first < count;) {
+            const NodeIndex last = NodeIndex(
+                std::upper_bound(keys.begin() + first, keys.end(),
+                                 keys[first] >> clusterShift,
+                                 [&](uint64_t prefix, uint64_t key) {
+                                     return prefix < (key >> clusterShift);
+                                 }) -
+                keys.begin());
+            clusters.push_back({ first, last - first });
+            first = last;
+        }
+
+        std::vector<BuildReference> clusterBounds(clusters.size());
+        parallelChunks(
+            chunkCount(state, NodeIndex(clusters.size()), 64), 0,
+            NodeIndex(clusters.size()),
+            [&](int, NodeIndex begin, NodeIndex end) {
+                for (NodeIndex c = begin; c < end; c++) {
+                    Bounds bounds = Bounds::empty();
+                    for (NodeIndex i = 0; i < clusters[c].count; i++)
+                        bounds.extend(
+                            state.references[clusters[c].first + i].bounds);
+                    clusterBounds[c] = { bounds, bounds.center(), c };
+                }
+            });
+
+        std::vector<std::tuple<NodeIndex, NodeIndex, int>> leaves;
+        buildClusterTree(state, clusterBounds, 0, 1, leaves);
+
+        // emit the subtrees of the clusters, with each thread picking the
+        // next cluster as soon as it is done with its previous one
+        std::atomic<size_t> nextLeaf = 0;
+        parallelChunks(
+            chunkCount(state, NodeIndex(leaves.size()), 1), 0,
+            NodeIndex(leaves.size()), [&](int, NodeIndex, NodeIndex) {
+                for (size_t leaf; (leaf = nextLeaf++) < leaves.size();) {
+                    const auto [nodeIndex, cluster, depth] = leaves[leaf];
+                    emitMorton(state, keys, nodeIndex,
+                               clusters[cluster].first,
+                               clusters[cluster].count, depth);
+                }
+            });
+    }
+
+    /**
+     * @brief Renumbers the nodes of the binary BVH in depth-first order: the
+     * pair of children of a node is followed by the subtree of the left
+     * child, and then by the subtree of the right child. Parallel builds (and
+     * the HLBVH, which builds its top levels first) claim nodes from a shared
+     * counter, which would otherwise scatter subtrees across memory.
+     */
+    void reorderNodes() {
+        if (m_nodes.size() == 1)
+            // a single (possibly empty) leaf
+            return;
+
+        decltype(m_nodes) nodes(m_nodes.size());
+        nodes.front() = m_nodes.front();
+
+        // pairs of new and old indices of inner nodes whose children still
+        // need to be placed
+        std::vector<std::pair<NodeIndex, NodeIndex>> stack = { { 0, 0 } };
+        NodeIndex nodeCount = 1;
+        while (!stack.empty()) {
+            const auto [index, oldIndex] = stack.back();
+            stack.pop_back();
+            const Node &node = m_nodes[oldIndex];
+            if (node.isLeaf())
+                continue;
+
+            const NodeIndex leftChildIndex = nodeCount;
+            nodeCount += 2;
+            nodes[index].leftFirst      = leftChildIndex;
+            nodes[leftChildIndex]       = m_nodes[node.leftChildIndex()];
+            nodes[leftChildIndex + 1]   = m_nodes[node.rightChildIndex()];
+            // the left child is taken from the stack first
+            stack.emplace_back(leftChildIndex + 1, node.rightChildIndex());
+            stack.emplace_back(leftChildIndex, node.leftChildIndex());
+        }
+        m_nodes = std::move(nodes);
+    }
+
+    /**
+     * @brief Converts the binary BVH into a wide BVH, by repeatedly replacing
+     * the inner child with the largest surface area by its own two children
+     * until each wide node has @c Width children (or only leaves remain).
+     */
+    template <int Width> void collapse() {
+        auto &nodes = wideNodes<Width>();
+        nodes.clear();
+        if (m_primitiveIndices.empty())
+            return; // the root of an empty BVH is not a valid node
+        nodes.emplace_back();
+        collapseNode<Width>(0, 0);
+        nodes.shrink_to_fit();
+    }
+
+    /**
+     * @brief Replaces the wide BVH of the given width by its quantized
+     * version (see m_quantization).
+     * @return @c false if quantization is not possible.
+     */
+    template <int Width> bool quantize() {
+        return m_quantization == 8 ? quantize<Width, uint8_t>()
+                                   : quantize<Width, uint16_t>();
+    }
+
+    template <int Width, typename Quantized> bool quantize() {
+        auto &nodes     = wideNodes<Width>();
+        auto &quantized = quantizedNodes<Width, Quantized>();
+        quantized.resize(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (!quantized[i].encode(nodes[i])) {
+                quantized.clear();
+                return false;
+            }
+        }
+        nodes.clear();
+        nodes.shrink_to_fit();
+        return true;
+    }
+
+    /**
+     * @brief Calls @c f with the list of wide nodes that is used for traversal
+     * (i.e., the one matching m_width and m_quantization). Must not be called
+     * for the binary BVH.
+     */
+    template <typename Self, typename Function>
+    static void visitWideNodes(Self &self, Function &&f) {
+        if (self.m_width == 4)
+            visitWideNodesOfWidth<4>(self, f);
+        else
+            visitWideNodesOfWidth<8>(self, f);
+    }
+
+    template <int Width, typename Self, typename Function>
+    static void visitWideNodesOfWidth(Self &self, Function &&f) {
+        switch (self.m_quantization) {
+        case 8:
+            f(self.template quantizedNodes<Width, uint8_t>());
+            break;
+        case 16:
+            f(self.template quantizedNodes<Width, uint16_t>());
+            break;
+        default:
+            f(self.template wideNodes<Width>());
+        }
+    }
+
+    /// @brief Reports the number and size of the nodes that are used for
+    /// traversal.
+    void nodeMemory(size_t &count, size_t &size) const {
+        const auto report = [&](const auto &nodes) {
+            count = nodes.size();
+            size  = sizeof(nodes[0]);
+        };
+        if (m_width == 2)
+            report(m_nodes);
+        else
+            visitWideNodes(*this, report);
+    }
+
+    /**
+     * @brief The number of levels of the binary BVH whose bounding boxes are
+     * transformed individually by getTransformedBoundingBox() (wide BVHs use
+     * a correspondingly smaller number of levels).
+     */
+    static constexpr int TransformedBoundsDepth = 6;
+
+    /// @brief Calls @c f with the bounding boxes of the nodes at the given
+    /// depth below a node of the binary BVH (or of leaves above that depth).
+    template <typename Function>
+    void visitBinaryBounds(NodeIndex nodeIndex, int levels,
+                           Function &f) const {
+        const Node &node = m_nodes[nodeIndex];
+        if (node.isLeaf() || levels == 0) {
+            f(node.aabb);
+            return;
+        }
+        visitBinaryBounds(node.leftChildIndex(), levels - 1, f);
+        visitBinaryBounds(node.rightChildIndex(), levels - 1, f);
+    }
+
+    /// @brief Calls @c f with the bounding boxes of the children at the given
+    /// depth below a node of the wide BVH (or of leaves above that depth).
+    template <typename WideNodeType, typename Function>
+    void visitWideBounds(const std::vector<WideNodeType> &nodes,
+                         NodeIndex nodeIndex, int levels, Function &f) const {
+        const WideNodeType &node = nodes[nodeIndex];
+        for (int slot = 0; slot < int(std::size(node.child)); slot++) {
+            if (node.primitiveCount[slot] == -1)
+                continue; // unused slot
+            if (node.primitiveCount[slot] == 0 && levels > 1)
+                visitWideBounds(nodes, node.child[slot], levels - 1, f);
+            else
+                f(node.childBounds(slot));
+        }
+    }
+
+    /// @brief Returns the union of the bounding boxes of the children of a
+    /// leaf, as reported by @c source .
+    template <typename PrimitiveSource>
+    Bounds leafBounds(const PrimitiveSource &source, NodeIndex first,
+                      NodeIndex count) const {
+        Bounds bounds;
+        for (NodeIndex i = first; i < first + count; i++)
+            bounds.extend(source.getBoundingBox(m_primitiveIndices[i]));
+        return bounds;
+    }
+
+    /// @brief Returns the number of chunks that refitting @c count nodes is
+    /// split into.
+    static int refitChunks(size_t count) {
+        const int numThreads =
+            ThreadPool::global().numThreads();
+        return std::max(
+            1, std::min(numThreads, int(count / ParallelSubtreeThreshold)));
+    }
+
+    /**
+     * @brief Recomputes the bounding boxes of the binary BVH. Leaves are
+     * refit in parallel, since querying their children dominates the cost.
+     * Inner nodes are refit afterwards in a single backwards sweep, which
+     * works because children are always stored after their parents.
+     */
+    template <typename PrimitiveSource>
+    bool refitNodes(const PrimitiveSource &source) {
+        const NodeIndex nodeCount = NodeIndex(m_nodes.size());
+        parallelChunks(refitChunks(m_nodes.size()), 0, nodeCount,
+                       [&](int, NodeIndex begin, NodeIndex end) {
+                           for (NodeIndex i = begin; i < end; i++) {
+                               Node &node = m_nodes[i];
+                               if (node.isLeaf())
+                                   node.aabb = leafBounds(source,
+                                                          node.leftFirst,
+                                                          node.primitiveCount);
+                           }
+                       });
+        for (NodeIndex i = nodeCount - 1; i >= 0; i--) {
+            Node &node = m_nodes[i];
+            if (node.isLeaf())
+                continue;
+            node.aabb = m_nodes[node.leftChildIndex()].aabb;
+            node.aabb.extend(m_nodes[node.rightChildIndex()].aabb);
+        }
+        return true;
+    }
+
+    /// @brief Returns the union of the bounding boxes of all children of a
+    /// wide node.
+    template <typename WideNodeType>
+    static Bounds wideNodeBounds(const WideNodeType &node) {
+        Bounds bounds;
+        for (int slot = 0; slot < int(std::size(node.child)); slot++) {
+            if (node.primitiveCount[slot] != -1)
+                bounds.extend(node.childBounds(slot));
+        }
+        return bounds;
+    }
+
+    /// @brief Recomputes the bounding boxes of the wide BVH, analogous to
+    /// refitNodes().
+    template <int Width, typename PrimitiveSource>
+    bool refitWideNodes(const PrimitiveSource &source,
+                        std::vector<WideNode<Width>> &nodes) {
+        const NodeIndex nodeCount = NodeIndex(nodes.size());
+        parallelChunks(refitChunks(nodes.size()), 0, nodeCount,
+                       [&](int, NodeIndex begin, NodeIndex end) {
+                           for (NodeIndex i = begin; i < end; i++) {
+                               WideNode<Width> &node = nodes[i];
+                               for (int slot = 0; slot < Width; slot++) {
+                                   if (node.primitiveCount[slot] > 0)
+                                       node.setBounds(
+                                           slot,
+                                           leafBounds(
+                                               source,
+                                               node.child[slot],
+                                               node.primitiveCount[slot]));
+                               }
+                           }
+                       });
+        for (NodeIndex i = nodeCount - 1; i >= 0; i--) {
+            WideNode<Width> &node = nodes[i];
+            for (int slot = 0; slot < Width; slot++) {
+                if (node.primitiveCount[slot] == 0)
+                    node.setBounds(slot,
+                                   wideNodeBounds(nodes[node.child[slot]]));
+            }
+        }
+        m_nodes.front().aabb = wideNodeBounds(nodes.front());
+        return true;
+    }
+
+    /**
+     * @brief Recomputes the bounding boxes of the quantized wide BVH, by
+     * refitting a full precision copy of it and quantizing that again.
+     * @return @c false if quantization is no longer possible.
+     */
+    template <int Width, typename Quantized, typename PrimitiveSource>
+    bool refitWideNodes(const PrimitiveSource &source,
+                        std::vector<QuantizedWideNode<Width, Quantized>> &quantized) {
+        std::vector<WideNode<Width>> nodes(quantized.size());
+        for (size_t i = 0; i < nodes.size(); i++) {
+            for (int slot = 0; slot < Width; slot++) {
+                nodes[i].setBounds(slot, Bounds::empty());
+                nodes[i].child[slot]          = quantized[i].child[slot];
+                nodes[i].primitiveCount[slot] = quantized[i].primitiveCount[slot];
+            }
+        }
+        refitWideNodes(source, nodes);
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (!quantized[i].encode(nodes[i]))
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Computes the SAH cost of the BVH used for traversal, relative to
+     * the cost of intersecting a single child and normalized by the surface
+     * area of the root (which makes costs comparable across refits).
+     */
+    float sahCost() const {
+        const float rootArea = surfaceArea(rootNode().aabb);
+        if (m_primitiveIndices.empty() || !(rootArea > 0))
+            return 0;
+
+        double cost = 0;
+        if (m_width == 2) {
+            for (const Node &node : m_nodes) {
+                cost += surfaceArea(node.aabb) *
+                        (node.isLeaf() ? node.primitiveCount : TraversalCost);
+            }
+        } else {
+            visitWideNodes(*this, [&](const auto &nodes) {
+                for (const auto &node : nodes) {
+                    cost += TraversalCost * surfaceArea(wideNodeBounds(node));
+                    for (int slot = 0; slot < int(std::size(node.child));
+                         slot++) {
+                        if (node.primitiveCount[slot] > 0)
+                            cost += surfaceArea(node.childBounds(slot)) *
+                                    node.primitiveCount[slot];
+                    }
+                }
+            });
+        }
+        return float(cost / rootArea);
+    }
+
+    /**
+     * @brief The SAH cost (see sahCost()) of the BVH as it was built, i.e.,
+     * before any refits.
+     */
+    float m_builtCost = 0;
+    /**
+     * @brief Refitting rebuilds the BVH instead once its SAH cost exceeds
+     * this multiple of m_builtCost.
+     */
+    float m_rebuildThreshold;
+
+    /// @brief The traversal statistics of one kind of ray, updated
+    /// concurrently by the render threads.
+    struct TraversalCounters {
+        std::atomic<uint64_t> traversals{ 0 };
+        std::atomic<uint64_t> nodes{ 0 };
+        std::atomic<uint64_t> primitives{ 0 };
+    };
+    /// @brief The traversal statistics of this BVH, per kind of ray (only
+    /// recorded while statistics are collected).
+    mutable std::array<TraversalCounters, 3> m_traversalCounters;
+
+    /// @brief Whether traversal statistics are currently recorded, see
+    /// collectStatistics().
+    static inline std::atomic<bool> s_collectStatistics{ false };
+    /// @brief Guards s_instances.
+    static inline std::mutex s_instancesMutex;
+    /// @brief All acceleration structures that currently exist, in the order
+    /// they were created.
+    static inline std::vector<const AccelerationStructure *> s_instances;
+
+    /**
+     * @brief The version of the BVH cache format. Since cached BVHs are reused
+     * as long as the primitives and build settings match, this needs to be
+     * bumped whenever the builder or the layout of the nodes changes.
+     */
+    static constexpr uint32_t CacheVersion = 3;
+
+    /// @brief The header of a cached BVH, which is followed by m_nodes,
+    /// m_primitiveIndices and the wide nodes (if any), in that order (the
+    /// payload).
+    struct CacheHeader {
+        char magic[8];
+        /// @brief See cacheKey().
+        uint64_t key;
+        /// @brief The quantization that was used (which can differ from the
+        /// requested one, see buildAccelerationStructure()).
+        int32_t quantization;
+        int32_t padding;
+        uint64_t nodeCount;
+        uint64_t primitiveIndexCount;
+        uint64_t wideNodeCount;
+        /// @brief A hash of the payload, since traversal trusts the node and
+        /// primitive indices it contains.
+        uint64_t checksum;
+    };
+    static constexpr char CacheMagic[8] = "lw-bvh";
+
+    /**
+     * @brief Identifies a BVH by the primitives it is built over (summarized
+     * by @c contentHash ) and everything that influences how it is built.
+     */
+    uint64_t cacheKey(uint64_t contentHash, NodeIndex primitiveCount) const {
+        return hash::fnv1a(contentHash,
+                           CacheVersion,
+                           primitiveCount,
+                           m_width,
+                           m_quantization,
+                           int(m_builder),
+                           m_reorderNodes,
+                           m_maxLeafSize,
+                           m_leafAlignment,
+                           std::bit_cast<uint32_t>(m_duplicationBudget),
+                           uint32_t(sizeof(Node)));
+    }
+
+    /**
+     * @brief Attempts to load the BVH from a cache file written by
+     * saveCache().
+     * @return @c false if the file does not exist, belongs to a different key,
+     * or is damaged.
+     */
+    bool loadCache(const std::filesystem::path &file, uint64_t key,
+                   NodeIndex primitiveCount) {
+        const MappedFile mapping(file);
+        if (!mapping || mapping.size() < sizeof(CacheHeader))
+            return false;
+        CacheHeader header;
+        std::memcpy(&header, mapping.data(), sizeof(header));
+        if (std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0 ||
+            header.key != key)
+            return false;
+        const uint64_t checksum = hash::fnv1a().update(
+            mapping.data() + sizeof(header), mapping.size() - sizeof(header));
+        // the build falls back to unquantized nodes if quantization fails
+        if (checksum != header.checksum ||
+            (header.quantization != 0 &&
+             header.quantization != m_quantization)) {
+            logger(EWarn, "ignoring damaged BVH cache %s", file);
+            return false;
+        }
+
+        size_t offset  = sizeof(header);
+        const auto read = [&](auto &list, uint64_t count) {
+            const size_t available = mapping.size() - offset;
+            if (count > available / sizeof(list[0]))
+                return false;
+            list.resize(count);
+            std::memcpy(list.data(), mapping.data() + offset,
+                        count * sizeof(list[0]));
+            offset += count * sizeof(list[0]);
+            return true;
+        };
+
+        const int requestedQuantization = m_quantization;
+        m_quantization = header.quantization;
+        bool valid = read(m_nodes, header.nodeCount) &&
+                     read(m_primitiveIndices, header.primitiveIndexCount);
+        if (valid && m_width != 2) {
+            visitWideNodes(*this, [&](auto &nodes) {
+                valid = read(nodes, header.wideNodeCount);
+            });
+        }
+        valid = valid && offset == mapping.size() && !m_nodes.empty() &&
+                std::all_of(m_primitiveIndices.begin(),
+                            m_primitiveIndices.end(),
+                            [&](int index) {
+                                return index >= -1 && index < primitiveCount;
+                            });
+        if (!valid) {
+            logger(EWarn, "ignoring damaged BVH cache %s", file);
+            m_quantization = requestedQuantization;
+            m_nodes.clear();
+            m_primitiveIndices.clear();
+            if (m_width != 2)
+                visitWideNodes(*this, [](auto &nodes) { nodes.clear(); });
+        }
+        return valid;
+    }
+
+    /**
+     * @brief Writes the BVH to a cache file. The file is written under a
+     * temporary name first, so that renders running concurrently never see a
+     * partially written cache.
+     */
+    void saveCache(const std::filesystem::path &file, uint64_t key) const {
+        CacheHeader header = {};
+        std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+        header.key                 = key;
+        header.quantization        = m_quantization;
+        header.nodeCount           = m_nodes.size();
+        header.primitiveIndexCount = m_primitiveIndices.size();
+        if (m_width != 2) {
+            visitWideNodes(*this, [&](const auto &nodes) {
+                header.wideNodeCount = nodes.size();
+            });
+        }
+
+        std::error_code error;
+        std::filesystem::create_directories(file.parent_path(), error);
+        std::filesystem::path temporary = file;
+        temporary += "." +
+                     std::to_string(std::chrono::steady_clock::now()
+                                        .time_since_epoch()
+                                        .count()) +
+                     ".tmp";
+
+        hash::fnv1a checksum;
+        const auto hashList = [&](const auto &list) {
+            checksum.update(list.data(), list.size() * sizeof(list[0]));
+        };
+        hashList(m_nodes);
+        hashList(m_primitiveIndices);
+        if (m_width != 2)
+            visitWideNodes(*this, hashList);
+        header.checksum = checksum;
+
+        std::ofstream stream(temporary, std::ios::binary);
+        const auto write = [&](const auto &list) {
+            stream.write(reinterpret_cast<const char *>(list.data()),
+                         std::streamsize(list.size() * sizeof(list[0])));
+        };
+        stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        write(m_nodes);
+        write(m_primitiveIndices);
+        if (m_width != 2)
+            visitWideNodes(*this, write);
+        stream.close();
+
+        if (stream)
+            std::filesystem::rename(temporary, file, error);
+        if (!stream || error) {
+            logger(EWarn, "could not write BVH cache %s", file);
+            std::filesystem::remove(temporary, error);
+        }
+    }
+
+    /// @brief Populates the given wide node from the given binary node.
+    template <int Width>
+    void collapseNode(NodeIndex wideIndex, NodeIndex binaryIndex) {
+        NodeIndex children[Width];
+        int childCount = 0;
+
+        const Node &node = m_nodes[binaryIndex];
+        if (node.isLeaf()) {
+            // only happens for the root node
+            children[childCount++] = binaryIndex;
+        } else {
+            children[childCount++] = node.leftChildIndex();
+            children[childCount++] = node.rightChildIndex();
+            while (childCount < Width) {
+                int best        = -1;
+                float bestArea = -1;
+                for (int i = 0; i < childCount; i++) {
+                    const Node &child = m_nodes[children[i]];
+                    if (child.isLeaf())
+                        continue;
+                    const float area = surfaceArea(child.aabb);
+                    if (area > bestArea) {
+                        best     = i;
+                        bestArea = area;
+                    }
+                }
+                if (best < 0)
+                    break; // all children are leaves
+
+                const Node &expanded     = m_nodes[children[best]];
+                children[best]           = expanded.leftChildIndex();
+                children[childCount++]   = expanded.rightChildIndex();
+            }
+        }
+
+        auto &nodes = wideNodes<Width>();
+        for (int slot = 0; slot < Width; slot++) {
+            // note that the reference might be invalidated by recursion, hence
+            // we index into the list every time
+            if (slot >= childCount) {
+                nodes[wideIndex].setBounds(slot, Bounds::empty());
+                nodes[wideIndex].child[slot]          = 0;
+                nodes[wideIndex].primitiveCount[slot] = -1;
+                continue;
+            }
+
+            const Node &child = m_nodes[children[slot]];
+            nodes[wideIndex].setBounds(slot, child.aabb);
+            if (child.isLeaf()) {
+                nodes[wideIndex].child[slot]          = child.firstPrimitiveIndex();
+                nodes[wideIndex].primitiveCount[slot] = child.primitiveCount;
+            } else {
+                const NodeIndex childIndex = NodeIndex(nodes.size());
+                nodes.emplace_back();
+                nodes[wideIndex].child[slot]          = childIndex;
+                nodes[wideIndex].primitiveCount[slot] = 0;
+                collapseNode<Width>(childIndex, children[slot]);
+            }
+        }
+    }
+
+protected:
+    /**
+     * @brief Reads the options of the acceleration structure.
+     * @param properties The properties of the shape, which may specify
+     * @c bvhWidth (2, 4 or 8) to select the branching factor of the BVH used
+     * for traversal, @c bvhQuantization (0, 8 or 16) to store the child
+     * boxes of a wide BVH with the given number of bits,
+     * @c bvhBuilder ("sah", "lbvh" or "hlbvh") to select the algorithm that
+     * builds the binary BVH, @c bvhReorder to disable renumbering its nodes
+     * (see reorderNodes()), and @c bvhRebuildThreshold (see
+     * refitAccelerationStructure()).
+     */
+    AccelerationStructure(const Properties &properties) {
+        m_width = properties.get<int>("bvhWidth", 2);
+        if (m_width != 2 && m_width != 4 && m_width != 8) {
+            lightwave_throw("unsupported bvhWidth %d (must be 2, 4 or 8)",
+                            m_width);
+        }
+        m_quantization = properties.get<int>("bvhQuantization", 0);
+        if (m_quantization != 0 && m_quantization != 8 &&
+            m_quantization != 16) {
+            lightwave_throw(
+                "unsupported bvhQuantization %d (must be 0, 8 or 16)",
+                m_quantization);
+        }
+        if (m_quantization && m_width == 2) {
+            lightwave_throw("bvhQuantization requires a bvhWidth of 4 or 8");
+        }
+        // clang-format off
+        m_builder = properties.getEnum<BuildStrategy>("bvhBuilder", BuildStrategy::Sah, {
+            { "sah", BuildStrategy::Sah },
+            { "lbvh", BuildStrategy::Lbvh },
+            { "hlbvh", BuildStrategy::Hlbvh },
+        });
+        // clang-format on
+        m_reorderNodes     = properties.get<bool>("bvhReorder", true);
+        m_rebuildThreshold = properties.get<float>("bvhRebuildThreshold", 1.5f);
+
+        std::lock_guard lock(s_instancesMutex);
+        s_instances.push_back(this);
+    }
+
+    ~AccelerationStructure() {
+        std::lock_guard lock(s_instancesMutex);
+        std::erase(s_instances, this);
+    }
+
+    /**
+     * @brief Splits the part of a child that lies within @c bounds at an axis
+     * aligned plane by simply splitting the bounding box, and reports the
+     * bounding boxes of the parts on either side (used for spatial splits).
+     * @note Shapes can provide tighter bounds by implementing their own
+     * splitPrimitive() that actually clips their children, which needs to
+     * report an empty bounding box for a side that the child does not reach.
+     */
+    static void splitBounds(int axis, float position, const Bounds &bounds,
+                            Bounds &left, Bounds &right) {
+        left  = bounds;
+        right = bounds;
+        left.max()[axis]  = min(left.max()[axis], position);
+        right.min()[axis] = max(right.min()[axis], position);
+    }
+
+    /**
+     * @brief The order in which the leaves of the BVH reference primitives:
+     * each leaf covers a contiguous range of this list. Shapes can use this to
+     * store data needed for intersection in leaf order (note that children
+     * might be referenced more than once if spatial splits are used).
+     */
+    const std::vector<int> &leafPrimitiveIndices() const {
+        return m_primitiveIndices;
+    }
+
+    /**
+     * @brief Traverses the BVH, calling @c intersectLeaf for each leaf that
+     * might contain a hit closer than @c its.t .
+     * @note While statistics are collected (see collectStatistics()), the
+     * nodes and children visited are also recorded per kind of ray.
+     * @see traverseNodes() for the meaning of the parameters.
+     */
+    template <bool AnyHit, typename IntersectLeaf>
+    bool traverse(const Ray &ray, Intersection &its,
+                  IntersectLeaf &&intersectLeaf) const {
         if (m_primitiveIndices.empty())
             return false; // exit early if no children exist
-        if (intersectAABB(rootNode().aabb, ray) <
-            its.t) // test root bounding box for potential hit
-            return intersectNode(rootNode(), ray, its, rng);
+        if (!s_collectStatistics.load(std::memory_order_relaxed))
+            return traverseTree<AnyHit>(ray, its, intersectLeaf);
+
+        // the statistics in its.stats also include the nodes of nested
+        // acceleration structures (e.g., of the meshes in a group), which we
+        // subtract again so that every BVH only reports its own work
+        const auto before = its.stats;
+        int nestedNodes = 0, nestedPrimitives = 0;
+        const bool wasIntersected = traverseTree<AnyHit>(
+            ray, its, [&](int first, int count) {
+                const auto beforeLeaf = its.stats;
+                const bool hit        = intersectLeaf(first, count);
+                nestedNodes += its.stats.bvhCounter - beforeLeaf.bvhCounter;
+                nestedPrimitives +=
+                    its.stats.primCounter - beforeLeaf.primCounter;
+                return hit;
+            });
+
+        const RayKind kind = AnyHit || ray.shadow ? RayKind::Shadow
+                             : ray.depth == 0     ? RayKind::Camera
+                                                  : RayKind::Indirect;
+        TraversalCounters &counters = m_traversalCounters[int(kind)];
+        counters.traversals.fetch_add(1, std::memory_order_relaxed);
+        counters.nodes.fetch_add(
+            its.stats.bvhCounter - before.bvhCounter - nestedNodes,
+            std::memory_order_relaxed);
+        counters.primitives.fetch_add(
+            its.stats.primCounter - before.primCounter - nestedPrimitives,
+            std::memory_order_relaxed);
+        return wasIntersected;
+    }
+
+    /**
+     * @brief Traverses the BVH with the rays of a packet that are selected by
+     * @c active , calling @c intersectLeaf for each leaf that some of them
+     * might hit closer than their @c tMax .
+     * @note While statistics are collected, the rays are traversed one by one
+     * so that they are recorded like those of traverse().
+     * @tparam AnyHit If set, rays are no longer traversed once any leaf
+     * reports a hit for them (used for shadow rays).
+     * @param tMax The distance up to which hits are of interest, per ray.
+     * @param intersectLeaf Called with the range of a leaf in
+     * m_primitiveIndices and the rays that reach it as @code
+     * intersectLeaf(first, count, rays) @endcode , and returns a bit mask of
+     * the rays for which a hit closer than @c tMax[i] has been found (in
+     * which case @c tMax[i] must have been lowered, unless @c AnyHit is set).
+     * @return A bit mask of the rays for which @c intersectLeaf reported a
+     * hit.
+     */
+    template <bool AnyHit, typename IntersectLeaf>
+    RayPacket::Mask traversePacket(const RayPacket &rays,
+                                   RayPacket::Mask active, float *tMax,
+                                   IntersectLeaf &&intersectLeaf) const {
+        if (m_primitiveIndices.empty() || !active)
+            return 0; // exit early if no children exist
+
+        if (std::popcount(active) < MinPacketRays ||
+            s_collectStatistics.load(std::memory_order_relaxed)) {
+            // too few rays to amortize the setup of a packet traversal (or
+            // statistics need to be recorded per ray)
+            RayPacket::Mask wasIntersected = 0;
+            RayPacket::forEach(active, [&](int i) {
+                const RayPacket::Mask ray = RayPacket::Mask(1) << i;
+                Intersection its(-rays.rays[i].direction, tMax[i]);
+                if (traverse<AnyHit>(
+                        rays.rays[i], its, [&](int first, int count) {
+                            if (!intersectLeaf(first, count, ray))
+                                return false;
+                            its.t = tMax[i];
+                            return true;
+                        }))
+                    wasIntersected |= ray;
+            });
+            return wasIntersected;
+        }
+
+        TraversalPacket packet(rays, active, tMax);
+        PacketStackEntry root = { 0, 0, 0, 0, rootNode().aabb, 0 };
+        root.rays = intersectPacketAABB(root.bounds, packet, active, root.t);
+        if (!root.rays)
+            return 0;
+
+        switch (m_width) {
+        case 4:
+            return traversePacketWidth<4, AnyHit>(
+                packet, root, tMax, intersectLeaf);
+        case 8:
+            return traversePacketWidth<8, AnyHit>(
+                packet, root, tMax, intersectLeaf);
+        default:
+            if (rootNode().isLeaf()) {
+                root.child          = rootNode().leftFirst;
+                root.primitiveCount = rootNode().primitiveCount;
+            }
+            return traversePacketNodes<2, AnyHit>(
+                packet,
+                root,
+                tMax,
+                [&](NodeIndex index, auto &&visit) {
+                    const Node &node = m_nodes[index];
+                    for (NodeIndex i = node.leftChildIndex();
+                         i <= node.rightChildIndex();
+                         i++) {
+                        const Node &child = m_nodes[i];
+                        visit(child.aabb,
+                              child.isLeaf() ? child.leftFirst : i,
+                              child.primitiveCount);
+                    }
+                },
+                intersectLeaf);
+        }
+    }
+
+    /**
+     * @brief Returns whether a bounding box does not contain any point.
+     * @note Unlike @ref Bounds::isEmpty , flat bounding boxes (such as those of
+     * axis aligned triangles) are not considered empty.
+     */
+    static bool containsNoPoints(const Bounds &bounds) {
+        for (int dim = 0; dim < Bounds::Dimension; dim++) {
+            if (bounds.min()[dim] > bounds.max()[dim])
+                return true;
+        }
         return false;
     }
 
+    /// @brief Returns the region in which two bounding boxes overlap.
+    static Bounds overlap(const Bounds &a, const Bounds &b) {
+        const Point min = elementwiseMax(a.min(), b.min());
+        const Point max = elementwiseMin(a.max(), b.max());
+        for (int dim = 0; dim < Bounds::Dimension; dim++) {
+            if (min[dim] > max[dim])
+                return Bounds::empty();
+        }
+        return { min, max };
+    }
+
+    /**
+     * @brief The number of additional references (as a fraction of the number
+     * of children) that spatial splits may create, or zero to build the BVH
+     * using object splits only.
+     */
+    float m_duplicationBudget = 0;
+    /// @brief Nodes with at most this many children are not subdivided any
+    /// further.
+    int m_maxLeafSize = 2;
+    /**
+     * @brief Each leaf starts at a multiple of this in @ref
+     * leafPrimitiveIndices , with unused entries set to -1 (useful for shapes
+     * that test several children of a leaf at once).
+     */
+    int m_leafAlignment = 1;
+
+    /**
+     * @brief Builds the acceleration structure over the children reported by
+     * @c source , which needs to provide the following methods:
+     * - numberOfPrimitives()           -- the number of individual children
+     * - getBoundingBox(primitiveIndex) -- the bounding box of a single child
+     * - getCentroid(primitiveIndex)    -- the centroid of a single child
+     * - splitPrimitive(...)            -- only used for spatial splits, see
+     * @ref splitBounds
+     */
+    template <typename PrimitiveSource>
+    void buildAccelerationStructure(const PrimitiveSource &source) {
+        Timer buildTimer;
+
+        const NodeIndex primitiveCount = source.numberOfPrimitives();
+        BuildState state;
+        state.numThreads = ThreadPool::global().numThreads();
+        state.parallelDepth =
+            state.numThreads > 1
+                ? int(std::bit_width(unsigned(state.numThreads))) + 1
+                : 0;
+
+        // query the bounding box and centroid of every primitive exactly once
+        state.references.resize(primitiveCount);
+        parallelChunks(chunkCount(state, primitiveCount, ParallelSubtreeThreshold),
+                       0,
+                       primitiveCount,
+                       [&](int, NodeIndex begin, NodeIndex end) {
+                           for (NodeIndex i = begin; i < end; i++) {
+                               state.references[i] = {
+                                   source.getBoundingBox(i),
+                                   source.getCentroid(i), i
+                               };
+                           }
+                       });
+
+        if (m_duplicationBudget > 0 && m_builder != BuildStrategy::Sah) {
+            logger(EWarn,
+                   "spatial splits require bvhBuilder \"sah\", ignoring them");
+        }
+
+        // a binary tree with one reference per leaf has at most 2n - 1 nodes,
+        // which we allocate up front so that threads can claim nodes without
+        // invalidating references held by other threads
+        const int64_t duplicationBudget =
+            m_builder == BuildStrategy::Sah
+                ? int64_t(m_duplicationBudget * primitiveCount)
+                : 0;
+        m_nodes.clear();
+        m_nodes.resize(
+            std::max<int64_t>(2 * (primitiveCount + duplicationBudget) - 1, 1));
+        state.nodeCount = 1;
+
+        if (duplicationBudget > 0) {
+            // spatial split build
+            std::vector<BuildReference> references =
+                std::move(state.references);
+            state.references.clear();
+            state.references.reserve(references.size());
+            state.remainingDuplicates = duplicationBudget;
+
+            Bounds rootBounds;
+            for (const BuildReference &ref : references)
+                rootBounds.extend(ref.bounds);
+            state.rootArea = surfaceArea(rootBounds);
+
+            subdivideSpatial(source, state, 0, std::move(references));
+        } else if (m_builder != BuildStrategy::Sah) {
+            // Morton code build (in parallel)
+            buildMorton(state);
+        } else {
+            // object split build (in-place and in parallel)
+            state.centroidBounds.resize(m_nodes.size());
+
+            // create root node
+            auto &root          = m_nodes.front();
+            root.leftFirst      = 0;
+            root.primitiveCount = primitiveCount;
+            computeAABB(state, 0);
+            subdivide(state, 0);
+        }
+
+        m_nodes.resize(state.nodeCount);
+        m_nodes.shrink_to_fit();
+        if (m_reorderNodes)
+            reorderNodes();
+
+        if (m_leafAlignment > 1) {
+            // lay out the leaves so that each of them starts at a multiple of
+            // m_leafAlignment, padding the gaps with -1
+            m_primitiveIndices.clear();
+            m_primitiveIndices.reserve(state.references.size());
+            for (Node &node : m_nodes) {
+                if (!node.isLeaf())
+                    continue;
+                const NodeIndex first = node.leftFirst;
+                node.leftFirst = NodeIndex(m_primitiveIndices.size());
+                for (NodeIndex i = 0; i < node.primitiveCount; i++)
+                    m_primitiveIndices.push_back(
+                        state.references[first + i].primitiveIndex);
+                const size_t padding =
+                    (m_leafAlignment - node.primitiveCount % m_leafAlignment) %
+                    m_leafAlignment;
+                m_primitiveIndices.insert(
+                    m_primitiveIndices.end(), padding, -1);
+            }
+        } else {
+            m_primitiveIndices.resize(state.references.size());
+            for (size_t i = 0; i < state.references.size(); i++)
+                m_primitiveIndices[i] = state.references[i].primitiveIndex;
+        }
+
+        if (m_width == 4)
+            collapse<4>();
+        else if (m_width == 8)
+            collapse<8>();
+
+        if (m_quantization && !(m_width == 4 ? quantize<4>() : quantize<8>())) {
+            logger(EWarn,
+                   "cannot quantize BVH with unbounded children, using full "
+                   "precision nodes instead");
+            m_quantization = 0;
+        }
+
+        if (m_width != 2) {
+            // only the bounds of the root are needed from the binary BVH
+            m_nodes.resize(1);
+            m_nodes.shrink_to_fit();
+        }
+
+        m_builtCost = sahCost();
+
+        size_t nodeCount, nodeSize;
+        nodeMemory(nodeCount, nodeSize);
+        logger(EInfo,
+               "built BVH%d with %ld nodes for %ld primitives in %.1f ms",
+               m_width,
+               nodeCount,
+               primitiveCount,
+               buildTimer.getElapsedTime() * 1000);
+        logger(EInfo,
+               "BVH memory: %.2f MiB for nodes (%ld bytes each), %.2f MiB for "
+               "primitive indices",
+               nodeCount * nodeSize / (1024.0 * 1024.0),
+               nodeSize,
+               m_primitiveIndices.size() * sizeof(int) / (1024.0 * 1024.0));
+        if (duplicationBudget > 0) {
+            logger(EInfo,
+                   "spatial splits created %ld additional references",
+                   state.references.size() - primitiveCount);
+        }
+    }
+
+    /**
+     * @brief The directory in which BVHs are cached across runs (see
+     * buildAccelerationStructure(source, cacheDirectory, contentHash) ),
+     * given either for individual shapes via @c bvhCache or (via the
+     * environment variable @c LIGHTWAVE_BVH_CACHE ) for all shapes of all
+     * scenes.
+     * @return An empty path if caching is disabled, which an empty
+     * @c bvhCache does even if the environment enables it.
+     */
+    static std::filesystem::path cacheDirectory(const Properties &properties) {
+        if (properties.has("bvhCache")) {
+            // an empty value must not be resolved to the scene directory
+            const std::string directory =
+                properties.get<std::string>("bvhCache");
+            if (directory.empty())
+                return {};
+            return properties.basePath() / directory;
+        }
+        const char *sharedCache = std::getenv("LIGHTWAVE_BVH_CACHE");
+        return sharedCache ? sharedCache : "";
+    }
+
+    /**
+     * @brief Like buildAccelerationStructure(source), but reuses the BVH from
+     * an earlier run if @c cacheDirectory contains one that was built over
+     * the same primitives with the same settings. Otherwise, the BVH is built
+     * and stored in @c cacheDirectory for later runs.
+     * @param cacheDirectory The directory holding cached BVHs, or an empty
+     * path to disable caching.
+     * @param contentHash A hash of everything the bounding boxes of the
+     * primitives depend on (e.g., the vertex positions and indices of a mesh).
+     */
+    template <typename PrimitiveSource>
+    void buildAccelerationStructure(const PrimitiveSource &source,
+                                    const std::filesystem::path &cacheDirectory,
+                                    uint64_t contentHash) {
+        if (cacheDirectory.empty()) {
+            buildAccelerationStructure(source);
+            return;
+        }
+
+        Timer loadTimer;
+        const NodeIndex primitiveCount = source.numberOfPrimitives();
+        const uint64_t key = cacheKey(contentHash, primitiveCount);
+        char name[32];
+        std::snprintf(
+            name, sizeof(name), "%016llx.bvh", (unsigned long long) key);
+        const std::filesystem::path file = cacheDirectory / name;
+
+        if (loadCache(file, key, primitiveCount)) {
+            m_builtCost = sahCost();
+
+            size_t nodeCount, nodeSize;
+            nodeMemory(nodeCount, nodeSize);
+            logger(EInfo,
+                   "loaded BVH%d with %ld nodes for %ld primitives from %s in "
+                   "%.1f ms",
+                   m_width,
+                   nodeCount,
+                   primitiveCount,
+                   file,
+                   loadTimer.getElapsedTime() * 1000);
+            return;
+        }
+
+        buildAccelerationStructure(source);
+        saveCache(file, key);
+    }
+
+    /**
+     * @brief Updates the bounding boxes of the BVH after the children reported
+     * by @c source have moved (e.g., for the next frame of an animation),
+     * keeping the topology of the tree. This is much cheaper than building a
+     * new BVH, but the tree degrades as the children move further from where
+     * they were when it was built. Hence, the BVH is rebuilt from scratch
+     * instead once refitting has increased its SAH cost beyond @c
+     * bvhRebuildThreshold times its original cost.
+     * @note Primitives that were split by spatial splits are refit with their
+     * full bounding boxes, which is valid but less tight.
+     * @return @c true if the BVH was refit, @c false if it was rebuilt.
+     */
+    template <typename PrimitiveSource>
+    bool refitAccelerationStructure(const PrimitiveSource &source) {
+        Timer refitTimer;
+        if (m_primitiveIndices.empty())
+            return true; // nothing to refit
+
+        bool refitted;
+        if (m_width == 2) {
+            refitted = refitNodes(source);
+        } else {
+            visitWideNodes(*this, [&](auto &nodes) {
+                refitted = refitWideNodes(source, nodes);
+            });
+        }
+
+        const float cost = refitted ? sahCost() : Infinity;
+        if (!(cost <= m_rebuildThreshold * m_builtCost)) {
+            logger(EInfo,
+                   "rebuilding BVH%d, since refitting increased its SAH cost "
+                   "from %.2f to %.2f",
+                   m_width,
+                   m_builtCost,
+                   cost);
+            buildAccelerationStructure(source);
+            return false;
+        }
+
+        logger(EInfo,
+               "refit BVH%d in %.1f ms (SAH cost %.2f, %.2f when built)",
+               m_width,
+               refitTimer.getElapsedTime() * 1000,
+               cost,
+               m_builtCost);
+        return true;
+    }
+
+public:
     Bounds getBoundingBox() const override { return rootNode().aabb; }
 
+    /// @brief Transforms the bounding boxes of the top levels of the BVH
+    /// individually, which is considerably tighter for rotated shapes.
+    Bounds getTransformedBoundingBox(
+        const AffineTransform &transform) const override {
+        if (m_primitiveIndices.empty())
+            return Bounds::empty();
+
+        Bounds result;
+        const auto extend = [&](const Bounds &bounds) {
+            result.extend(transform.apply(bounds));
+        };
+        if (m_width == 2) {
+            visitBinaryBounds(0, TransformedBoundsDepth, extend);
+        } else {
+            // each level of a wide BVH spans log2(width) binary levels
+            const int levels = std::max(
+                1, TransformedBoundsDepth / std::countr_zero(unsigned(m_width)));
+            visitWideNodes(*this, [&](const auto &nodes) {
+                visitWideBounds(nodes, 0, levels, extend);
+            });
+        }
+        return result;
+    }
+
     Point getCentroid() const override { return rootNode().aabb.center(); }
+
+    /// @brief The kinds of rays that traversal statistics are recorded for.
+    enum class RayKind {
+        /// @brief Rays leaving the camera (i.e., rays with depth 0).
+        Camera,
+        /// @brief Rays testing for occlusion (see @ref Shape::occluded ),
+        /// including those that are forwarded to intersect (see @ref
+        /// Ray::shadow ).
+        Shadow,
+        /// @brief Rays of later bounces (i.e., rays with depth > 0).
+        Indirect,
+    };
+
+    /// @brief Metrics describing the quality of a BVH, see quality().
+    struct Quality {
+        /// @brief The branching factor of the BVH used for traversal.
+        int width;
+        /// @brief The number of bits child boxes are quantized to, or 0.
+        int quantization;
+        /// @brief The algorithm the binary BVH was built with.
+        const char *builder;
+        /// @brief The number of nodes (including leaves for binary BVHs).
+        size_t nodeCount;
+        /// @brief The number of leaves.
+        size_t leafCount = 0;
+        /// @brief The number of children referenced by the leaves (which can
+        /// exceed the number of children if spatial splits are used).
+        size_t referenceCount = 0;
+        /// @brief The memory used by the nodes, in bytes.
+        size_t nodeBytes;
+        /// @brief The memory used by the primitive index remapping, in bytes.
+        size_t indexBytes;
+        /// @brief The SAH cost, see sahCost().
+        float sahCost;
+        /**
+         * @brief The surface area of the regions in which siblings overlap,
+         * relative to the surface area of their parents (0 for a BVH whose
+         * siblings are disjoint).
+         */
+        float overlapRatio = 0;
+        /// @brief The number of leaves for each number of children.
+        std::vector<size_t> leafSizes;
+        /// @brief The number of leaves at each depth (in nodes of the BVH
+        /// used for traversal, with the root at depth 0).
+        std::vector<size_t> leafDepths;
+    };
+
+    /// @brief The traversal statistics of one kind of ray.
+    struct TraversalStatistics {
+        /// @brief The number of times the BVH has been traversed (for shared
+        /// shapes, this counts every instance a ray is tested against).
+        uint64_t traversals;
+        /// @brief The number of nodes visited, excluding the nodes of nested
+        /// acceleration structures.
+        uint64_t nodes;
+        /// @brief The number of children tested for intersection.
+        uint64_t primitives;
+    };
+
+    /// @brief Computes the quality metrics of the BVH used for traversal.
+    Quality quality() const {
+        Quality result;
+        result.width        = m_width;
+        result.quantization = m_quantization;
+        result.builder      = m_builder == BuildStrategy::Lbvh    ? "lbvh"
+                              : m_builder == BuildStrategy::Hlbvh ? "hlbvh"
+                                                                  : "sah";
+        size_t nodeSize;
+        nodeMemory(result.nodeCount, nodeSize);
+        result.nodeBytes  = result.nodeCount * nodeSize;
+        result.indexBytes = m_primitiveIndices.size() * sizeof(int);
+        result.sahCost    = sahCost();
+        if (m_primitiveIndices.empty())
+            return result;
+
+        const auto addLeaf = [&](int depth, NodeIndex primitiveCount) {
+            const auto add = [](std::vector<size_t> &histogram, size_t bin) {
+                if (histogram.size() <= bin)
+                    histogram.resize(bin + 1);
+                histogram[bin]++;
+            };
+            add(result.leafSizes, primitiveCount);
+            add(result.leafDepths, depth);
+            result.leafCount++;
+            result.referenceCount += primitiveCount;
+        };
+
+        double overlapArea = 0, parentArea = 0;
+        const auto addSiblings = [&](const Bounds &parent,
+                                     std::span<const Bounds> children) {
+            const float area = surfaceArea(parent);
+            if (!std::isfinite(area))
+                return; // unbounded children
+            parentArea += area;
+            for (size_t i = 0; i < children.size(); i++) {
+                for (size_t j = i + 1; j < children.size(); j++) {
+                    const Bounds common = overlap(children[i], children[j]);
+                    if (!containsNoPoints(common))
+                        overlapArea += surfaceArea(common);
+                }
+            }
+        };
+
+        std::vector<std::pair<NodeIndex, int>> stack = { { 0, 0 } };
+        if (m_width == 2) {
+            while (!stack.empty()) {
+                const auto [nodeIndex, depth] = stack.back();
+                stack.pop_back();
+                const Node &node = m_nodes[nodeIndex];
+                if (node.isLeaf()) {
+                    addLeaf(depth, node.primitiveCount);
+                    continue;
+                }
+                const Bounds children[] = {
+                    m_nodes[node.leftChildIndex()].aabb,
+                    m_nodes[node.rightChildIndex()].aabb
+                };
+                addSiblings(node.aabb, children);
+                stack.push_back({ node.leftChildIndex(), depth + 1 });
+                stack.push_back({ node.rightChildIndex(), depth + 1 });
+            }
+        } else {
+            visitWideNodes(*this, [&](const auto &nodes) {
+                while (!stack.empty()) {
+                    const auto [nodeIndex, depth] = stack.back();
+                    stack.pop_back();
+                    const auto &node = nodes[nodeIndex];
+                    std::vector<Bounds> children;
+                    for (int slot = 0; slot < int(std::size(node.child));
+                         slot++) {
+                        if (node.primitiveCount[slot] == -1)
+                            continue; // unused slot
+                        children.push_back(node.childBounds(slot));
+                        if (node.primitiveCount[slot] > 0)
+                            addLeaf(depth + 1, node.primitiveCount[slot]);
+                        else
+                            stack.push_back({ node.child[slot], depth + 1 });
+                    }
+                    addSiblings(wideNodeBounds(node), children);
+                }
+            });
+        }
+        if (parentArea > 0)
+            result.overlapRatio = float(overlapArea / parentArea);
+        return result;
+    }
+
+    /// @brief Returns the traversal statistics recorded for a kind of ray.
+    TraversalStatistics statistics(RayKind kind) const {
+        const TraversalCounters &counters = m_traversalCounters[int(kind)];
+        return { counters.traversals.load(), counters.nodes.load(),
+                 counters.primitives.load() };
+    }
+
+    /**
+     * @brief Starts (or stops) recording traversal statistics for all
+     * acceleration structures, resetting the statistics recorded so far when
+     * started.
+     * @note Recording statistics slows down rendering noticeably, and makes
+     * ray packets fall back to tracing rays one by one.
+     */
+    static void collectStatistics(bool enable) {
+        if (enable) {
+            std::lock_guard lock(s_instancesMutex);
+            for (const AccelerationStructure *instance : s_instances) {
+                for (TraversalCounters &counters :
+                     instance->m_traversalCounters) {
+                    counters.traversals = 0;
+                    counters.nodes      = 0;
+                    counters.primitives = 0;
+                }
+            }
+        }
+        s_collectStatistics = enable;
+    }
+
+    /// @brief Returns all acceleration structures that currently exist, in
+    /// the order they were created.
+    static std::vector<const AccelerationStructure *> instances() {
+        std::lock_guard lock(s_instancesMutex);
+        return s_instances;
+    }
+
+    /// @brief A short name that identifies the BVH in reports (defaults to
+    /// the id of the shape, if it has one).
+    virtual std::string reportName() const { return id(); }
+};
+
+/**
+ * @brief A BVH over children that are intersected individually (e.g., the
+ * shapes of a @ref Group ). The children are provided by @c PrimitiveSource ,
+ * which derives from this class and implements the methods required by @ref
+ * AccelerationStructure::buildAccelerationStructure , as well as:
+ * - intersect(primitiveIndex, ...) -- intersect a single child (identified by
+ * the given index) for the given ray
+ * - occluded(primitiveIndex, ...)  -- optionally, test a single child for
+ * occlusion without computing details about the hit
+ * - intersectPacket(primitiveIndex, ...) and occludedPacket(primitiveIndex,
+ * ...) -- optionally, the same for several rays of a packet at once
+ *
+ * Since the children are accessed through the template parameter instead of
+ * virtual methods, the leaf loops of the traversal are fully inlined.
+ *
+ * @example For a simple example of how to use this class, look at @ref
+ * shapes/group.cpp
+ */
+template <typename PrimitiveSource>
+class Bvh : public AccelerationStructure {
+    /// @brief Returns the shape that provides the children.
+    const PrimitiveSource &source() const {
+        return static_cast<const PrimitiveSource &>(*this);
+    }
+
+protected:
+    Bvh(const Properties &properties) : AccelerationStructure(properties) {}
+
+    /// @brief Builds the BVH over the children of @c PrimitiveSource .
+    void buildAccelerationStructure() {
+        AccelerationStructure::buildAccelerationStructure(source());
+    }
+
+    /// @brief Refits the BVH after the children of @c PrimitiveSource have
+    /// moved, see @ref AccelerationStructure::refitAccelerationStructure .
+    bool refitAccelerationStructure() {
+        return AccelerationStructure::refitAccelerationStructure(source());
+    }
+
+    /// @brief The default spatial split, see @ref splitBounds .
+    void splitPrimitive(int primitiveIndex, int axis, float position,
+                        const Bounds &bounds, Bounds &left,
+                        Bounds &right) const {
+        splitBounds(axis, position, bounds, left, right);
+    }
+
+    /// @brief The default occlusion test for a single child, which performs a
+    /// full intersection.
+    bool occluded(int primitiveIndex, const Ray &ray, float tMax,
+                  Sampler &rng) const {
+        Intersection its(-ray.direction, tMax);
+        return source().intersect(primitiveIndex, ray, its, rng);
+    }
+
+    /// @brief The default packet intersection for a single child, which
+    /// intersects the rays one by one.
+    RayPacket::Mask intersectPacket(int primitiveIndex, const RayPacket &packet,
+                                    RayPacket::Mask rays,
+                                    Intersection *its) const {
+        RayPacket::Mask hit = 0;
+        RayPacket::forEach(rays, [&](int i) {
+            if (source().intersect(primitiveIndex, packet.rays[i], its[i],
+                                   *packet.rng[i]))
+                hit |= RayPacket::Mask(1) << i;
+        });
+        return hit;
+    }
+
+    /// @brief The default packet occlusion test for a single child, which
+    /// tests the rays one by one.
+    RayPacket::Mask occludedPacket(int primitiveIndex, const RayPacket &packet,
+                                   RayPacket::Mask rays,
+                                   const float *tMax) const {
+        RayPacket::Mask hit = 0;
+        RayPacket::forEach(rays, [&](int i) {
+            if (source().occluded(primitiveIndex, packet.rays[i], tMax[i],
+                                  *packet.rng[i]))
+                hit |= RayPacket::Mask(1) << i;
+        });
+        return hit;
+    }
+
+public:
+    bool intersect(const Ray &ray, Intersection &its,
+                   Sampler &rng) const override {
+        return traverse<false>(ray, its, [&](int first, int count) {
+            bool wasIntersected = false;
+            for (int i = first; i < first + count; i++)
+                wasIntersected |= source().intersect(
+                    leafPrimitiveIndices()[i], ray, its, rng);
+            return wasIntersected;
+        });
+    }
+
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const override {
+        // the traversal only uses the intersection to track tMax
+        Intersection its(-ray.direction, tMax);
+        return traverse<true>(ray, its, [&](int first, int count) {
+            for (int i = first; i < first + count; i++) {
+                if (source().occluded(leafPrimitiveIndices()[i], ray, tMax,
+                                      rng))
+                    return true;
+            }
+            return false;
+        });
+    }
+
+    RayPacket::Mask intersect(const RayPacket &packet, RayPacket::Mask active,
+                              Intersection *its) const override {
+        float tMax[RayPacket::MaxSize];
+        RayPacket::forEach(active, [&](int i) { tMax[i] = its[i].t; });
+        return traversePacket<false>(
+            packet, active, tMax, [&](int first, int count,
+                                      RayPacket::Mask rays) {
+                RayPacket::Mask hit = 0;
+                for (int i = first; i < first + count; i++)
+                    hit |= source().intersectPacket(
+                        leafPrimitiveIndices()[i], packet, rays, its);
+                RayPacket::forEach(hit, [&](int i) { tMax[i] = its[i].t; });
+                return hit;
+            });
+    }
+
+    RayPacket::Mask occluded(const RayPacket &packet, RayPacket::Mask active,
+                             const float *tMax) const override {
+        float limits[RayPacket::MaxSize];
+        RayPacket::forEach(active, [&](int i) { limits[i] = tMax[i]; });
+        return traversePacket<true>(
+            packet, active, limits, [&](int first, int count,
+                                        RayPacket::Mask rays) {
+                RayPacket::Mask hit = 0;
+                for (int i = first; i < first + count && rays; i++) {
+                    const RayPacket::Mask occluded = source().occludedPacket(
+                        leafPrimitiveIndices()[i], packet, rays, tMax);
+                    hit |= occluded;
+                    rays &= ~occluded;
+                }
+                return hit;
+            });
+    }
 };
 
 } // namespace lightwave
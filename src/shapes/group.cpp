@@ -1,6 +1,7 @@
 #include <lightwave.hpp>
 
 #include "accel.hpp"
+#include "mesh.hpp"
 
 namespace lightwave {
 
@@ -10,29 +11,56 @@ namespace lightwave {
  * objects in the scene whenever we need to find an intersection, and also
  * provides noticeable speed-up by using an acceleration structure under the
  * hood.
+ *
+ * If the @c flatten property is set, instances of triangle meshes that are
+ * not shared with other instances are merged into a single mesh in world
+ * coordinates (see flattenInstances()), so that rays no longer need to
+ * descend into the BVHs of many small, overlapping meshes.
  */
-class Group final : public AccelerationStructure {
+class Group final : public Bvh<Group> {
+    friend AccelerationStructure;
+    friend Bvh<Group>;
+
     std::vector<ref<Shape>> m_children;
 
 protected:
-    int numberOfPrimitives() const override { return int(m_children.size()); }
+    int numberOfPrimitives() const { return int(m_children.size()); }
 
     bool intersect(int primitiveIndex, const Ray &ray, Intersection &its,
-                   Sampler &rng) const override {
+                   Sampler &rng) const {
         return m_children[primitiveIndex]->intersect(ray, its, rng);
     }
 
-    Bounds getBoundingBox(int primitiveIndex) const override {
+    bool occluded(int primitiveIndex, const Ray &ray, float tMax,
+                  Sampler &rng) const {
+        return m_children[primitiveIndex]->occluded(ray, tMax, rng);
+    }
+
+    RayPacket::Mask intersectPacket(int primitiveIndex, const RayPacket &packet,
+                                    RayPacket::Mask rays,
+                                    Intersection *its) const {
+        return m_children[primitiveIndex]->intersect(packet, rays, its);
+    }
+
+    RayPacket::Mask occludedPacket(int primitiveIndex, const RayPacket &packet,
+                                   RayPacket::Mask rays,
+                                   const float *tMax) const {
+        return m_children[primitiveIndex]->occluded(packet, rays, tMax);
+    }
+
+    Bounds getBoundingBox(int primitiveIndex) const {
         return m_children[primitiveIndex]->getBoundingBox();
     }
 
-    Point getCentroid(int primitiveIndex) const override {
+    Point getCentroid(int primitiveIndex) const {
         return m_children[primitiveIndex]->getCentroid();
     }
 
 public:
-    Group(const Properties &properties) {
+    Group(const Properties &properties) : Bvh(properties) {
         m_children = properties.getChildren<Shape>();
+        if (properties.get<bool>("flatten", false))
+            m_children = flattenInstances(m_children, properties);
         buildAccelerationStructure();
     }
 
@@ -50,6 +78,10 @@ public:
         return sample;
     }
 
+    std::string reportName() const override {
+        return id().empty() ? "group" : id();
+    }
+
     std::string toString() const override {
         std::stringstream oss;
         oss << "Group[" << std::endl;
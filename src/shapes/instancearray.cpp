@@ -0,0 +1,181 @@
+#include <lightwave.hpp>
+
+#include "../core/mappedfile.hpp"
+#include "accel.hpp"
+
+#include <cstring>
+
+namespace lightwave {
+
+/**
+ * @brief Places copies of one shape (e.g., a tree mesh) at many (thousands to
+ * millions of) affine transforms, with a single BVH over all copies. Unlike
+ * one @ref Instance per copy, every copy only costs its transform and inverse
+ * (96 bytes), and materials are bound once by the instance that wraps the
+ * array.
+ *
+ * The transforms are read from @c filename , a raw binary file of consecutive
+ * little-endian float records, each holding the upper 3x4 part of a matrix
+ * (leading from object to world coordinates) in row-major order.
+ *
+ * @example
+ * @code
+ * <instance>
+ *     <bsdf type="diffuse"/>
+ *     <shape type="instancearray" filename="forest.bin">
+ *         <shape type="mesh" filename="tree.ply"/>
+ *     </shape>
+ * </instance>
+ * @endcode
+ */
+class InstanceArray final : public Bvh<InstanceArray> {
+    friend AccelerationStructure;
+    friend Bvh<InstanceArray>;
+
+    /// @brief The placement of a single copy of the shape.
+    struct Element {
+        /// @brief The transform from object to world coordinates.
+        AffineTransform toWorld;
+        /// @brief The transform from world to object coordinates.
+        AffineTransform toObject;
+    };
+
+    /// @brief The shape that is placed by every element.
+    ref<Shape> m_shape;
+    /// @brief The placements of the copies of m_shape.
+    std::vector<Element> m_elements;
+    /// @brief The file the transforms were loaded from, for logging and
+    /// debugging purposes.
+    std::filesystem::path m_originalPath;
+
+    /**
+     * @brief Moves a ray into the object coordinates of an element, and
+     * normalizes it.
+     * @return The factor by which distances along the ray grow in object
+     * coordinates.
+     */
+    static float toObject(const Element &element, const Ray &worldRay,
+                          Ray &localRay) {
+        localRay = element.toObject.apply(worldRay);
+        const auto [scale, direction] =
+            localRay.direction.lengthAndNormalized();
+        localRay.direction = direction;
+        return scale;
+    }
+
+    /// @brief Moves the surface details of a hit from the object coordinates
+    /// of an element into world coordinates.
+    static void transformFrame(const Element &element, SurfaceEvent &surf) {
+        const Vector bitangent = surf.shadingFrame().bitangent;
+        const Vector tangent   = element.toWorld.apply(surf.tangent);
+        surf.position          = element.toWorld.apply(surf.position);
+        // the area density shrinks with the area scaling of the transform
+        surf.pdf /= tangent.cross(element.toWorld.apply(bitangent)).length();
+        surf.tangent = tangent.normalized();
+        surf.geometryNormal =
+            element.toObject.applyTransposed(surf.geometryNormal).normalized();
+        surf.shadingNormal =
+            element.toObject.applyTransposed(surf.shadingNormal).normalized();
+    }
+
+    /// @brief Reads the transforms from a binary file of 3x4 matrices.
+    void readTransforms(const std::filesystem::path &path) {
+        constexpr size_t RecordSize = 12 * sizeof(float);
+
+        logger(EInfo, "loading transforms %s", path);
+        const MappedFile file(path);
+        if (!file)
+            lightwave_throw("could not open %s", path);
+        if (file.size() % RecordSize != 0) {
+            lightwave_throw("size of %s is not a multiple of %d bytes (3x4 "
+                            "matrices of floats)",
+                            path,
+                            RecordSize);
+        }
+
+        m_elements.resize(file.size() / RecordSize);
+        for (size_t i = 0; i < m_elements.size(); i++) {
+            float values[12];
+            std::memcpy(values, file.data() + i * RecordSize, RecordSize);
+
+            Matrix4x4 matrix = Matrix4x4::identity();
+            for (int row = 0; row < 3; row++)
+                for (int column = 0; column < 4; column++)
+                    matrix(row, column) = values[4 * row + column];
+            const auto inverse = invert(matrix);
+            if (!inverse)
+                lightwave_throw("transform %d of %s is not invertible", i, path);
+
+            m_elements[i] = { AffineTransform(matrix),
+                              AffineTransform(*inverse) };
+        }
+    }
+
+protected:
+    int numberOfPrimitives() const { return int(m_elements.size()); }
+
+    bool intersect(int primitiveIndex, const Ray &worldRay, Intersection &its,
+                   Sampler &rng) const {
+        const Element &element = m_elements[primitiveIndex];
+        Ray localRay;
+        const float scale     = toObject(element, worldRay, localRay);
+        const float previousT = its.t;
+        its.t *= scale;
+        if (!m_shape->intersect(localRay, its, rng)) {
+            its.t = previousT;
+            return false;
+        }
+
+        its.t /= scale;
+        transformFrame(element, its);
+        return true;
+    }
+
+    bool occluded(int primitiveIndex, const Ray &worldRay, float tMax,
+                  Sampler &rng) const {
+        Ray localRay;
+        const float scale =
+            toObject(m_elements[primitiveIndex], worldRay, localRay);
+        return m_shape->occluded(localRay, tMax * scale, rng);
+    }
+
+    Bounds getBoundingBox(int primitiveIndex) const {
+        return m_shape->getTransformedBoundingBox(
+            m_elements[primitiveIndex].toWorld);
+    }
+
+    Point getCentroid(int primitiveIndex) const {
+        return m_elements[primitiveIndex].toWorld.apply(m_shape->getCentroid());
+    }
+
+public:
+    InstanceArray(const Properties &properties) : Bvh(properties) {
+        m_shape        = properties.getChild<Shape>();
+        m_originalPath = properties.get<std::filesystem::path>("filename");
+        readTransforms(m_originalPath);
+        logger(EInfo, "loaded %d transforms", m_elements.size());
+        buildAccelerationStructure();
+    }
+
+    void markAsVisible() override { m_shape->markAsVisible(); }
+
+    std::string reportName() const override {
+        return id().empty() ? m_originalPath.filename().generic_string()
+                            : id();
+    }
+
+    std::string toString() const override {
+        return tfm::format("InstanceArray[\n"
+                           "  shape = %s,\n"
+                           "  instances = %d,\n"
+                           "  filename = \"%s\"\n"
+                           "]",
+                           indent(m_shape),
+                           m_elements.size(),
+                           m_originalPath.generic_string());
+    }
+};
+
+} // namespace lightwave
+
+REGISTER_SHAPE(InstanceArray, "instancearray")
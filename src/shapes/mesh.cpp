@@ -2,6 +2,9 @@
 
 #include "../core/plyparser.hpp"
 #include "accel.hpp"
+#include "mesh.hpp"
+
+#include <unordered_map>
 
 // #include <fstream>
 
@@ -9,6 +12,26 @@
 
 namespace lightwave {
 
+/**
+ * @brief The triangles of a mesh classified by an alpha mask (see
+ * AlphaMaskedMesh), as bit masks of the lanes of each packet of triangles in
+ * BVH leaf order.
+ */
+struct AlphaMask {
+    static_assert(simd::Lanes <= 8, "lanes must fit into a byte");
+
+    /// @brief The texture that describes the opacity.
+    const Texture *texture;
+    /// @brief The lanes that hold fully transparent triangles, which are
+    /// never hit.
+    std::vector<uint8_t> transparent;
+    /// @brief The lanes that hold partially transparent triangles, for which
+    /// the texture is looked up at every hit.
+    std::vector<uint8_t> mixed;
+};
+
+class AlphaMaskedMesh;
+
 /**
  * @brief A shape consisting of many (potentially millions) of triangles, which
  * share an index and vertex buffer. Since individual triangles are rarely
@@ -16,6 +39,10 @@ namespace lightwave {
  * triangles are combined in a single shape.
  */
 class TriangleMesh : public AccelerationStructure {
+    friend AccelerationStructure;
+    friend class FlattenedMesh;
+    friend class AlphaMaskedMesh;
+
     /**
      * @brief The index buffer of the triangles.
      * The n-th element corresponds to the n-th triangle, and each component of
@@ -37,6 +64,47 @@ class TriangleMesh : public AccelerationStructure {
     /// geometric normal instead.
     bool m_smoothNormals;
 
+    /// @brief The data of a triangle that is needed to test it for
+    /// intersection, i.e., its first vertex and the two edges leaving it.
+    struct PrecomputedTriangle {
+        Point v0;
+        Vector e1;
+        Vector e2;
+    };
+    /**
+     * @brief A group of triangles (e.g., of the same BVH leaf) in
+     * structure-of-arrays layout, so that all of them can be tested for
+     * intersection at once.
+     */
+    struct TrianglePacket {
+        alignas(16) float v0[3][simd::Lanes];
+        alignas(16) float e1[3][simd::Lanes];
+        alignas(16) float e2[3][simd::Lanes];
+
+        /// @brief Assigns the triangle of one lane.
+        void set(int lane, const PrecomputedTriangle &triangle) {
+            for (int dim = 0; dim < 3; dim++) {
+                v0[dim][lane] = triangle.v0[dim];
+                e1[dim][lane] = triangle.e1[dim];
+                e2[dim][lane] = triangle.e2[dim];
+            }
+        }
+    };
+    /**
+     * @brief The triangles in the order they are referenced by the BVH leaves
+     * (see @ref leafPrimitiveIndices ), packed into groups of simd::Lanes
+     * triangles, so that the triangles of a leaf can be tested without any
+     * indirections. The vertex attributes are only looked up for the closest
+     * hit.
+     */
+    std::vector<TrianglePacket> m_leafPackets;
+    /**
+     * @brief The alpha masks of this mesh (see @ref AlphaMaskedMesh ), which
+     * refer to the triangles by their slot in m_leafPackets and hence need to
+     * be updated when the BVH is rebuilt.
+     */
+    std::vector<AlphaMaskedMesh *> m_alphaMasks;
+
     inline void populate(SurfaceEvent &surf, const Point &position, Vector shadingNormal, Vector normal, Vector2 uv_map) const {
         surf.position = position;
         // surf.tangent = Vector(0.f, normal[2], -normal[1]).normalized();
@@ -56,82 +124,309 @@ class TriangleMesh : public AccelerationStructure {
         surf.pdf = 0.0f / 4;
         }
 
-protected:
-    int numberOfPrimitives() const override { return int(m_triangles.size()); }
-
-    bool intersect(int primitiveIndex, const Ray &ray, Intersection &its,
-                   Sampler &rng) const override {
-        // NOT_IMPLEMENTED
-
-        // hints:
-        // * use m_triangles[primitiveIndex] to get the vertex indices of the
-        // triangle that should be intersected
-        // * if m_smoothNormals is true, interpolate the vertex normals from
-        // m_vertices
-        //   * make sure that your shading frame stays orthonormal!
-        // * if m_smoothNormals is false, use the geometrical normal (can be
-        // computed from the vertex positions)
-        Vector3i v_indices = m_triangles[primitiveIndex];
-        Vertex A = m_vertices[v_indices[0]];
-        Vertex B = m_vertices[v_indices[1]];
-        Vertex C = m_vertices[v_indices[2]];
-        Point a = A.position;
-        Point b = B.position;
-        Point c = C.position;
+    /// @brief Returns the vertices and edges of a triangle.
+    PrecomputedTriangle precomputeTriangle(int primitiveIndex) const {
+        const Vector3i v_indices = m_triangles[primitiveIndex];
+        const Point a = m_vertices[v_indices[0]].position;
+        const Point b = m_vertices[v_indices[1]].position;
+        const Point c = m_vertices[v_indices[2]].position;
+        return { a, b - a, c - a };
+    }
 
-        Point ray_ori = ray.origin;
-        Vector d = ray.direction;
+    /**
+     * @brief Intersects all triangles of a packet with a ray at once, using
+     * the Möller-Trumbore algorithm.
+     * @param t Receives the hit distance of each lane.
+     * @param u Receives the first barycentric coordinate of each lane.
+     * @param v Receives the second barycentric coordinate of each lane.
+     * @return A bit mask of the lanes that are hit closer than @c tMax .
+     */
+    static inline int intersectPacket(const TrianglePacket &packet,
+                                      const Ray &ray, float tMax, float *t,
+                                      float *u, float *v) {
+        using simd::Float4;
 
-        //Möller-Trumbore algorithm
         // o + td = (1-u-v)a + ub + vc <=> o-a = -td + u(b-a) + v(c-a)
-        Vector ba = b - a;
-        Vector ca = c - a;
-        Vector s = ray_ori - a;
-        Vector geoNormal = ba.cross(ca).normalized();
-        Vector shadingNormal = geoNormal;
-        // s = -t*d + u*ba + v*ca
+        Float4 d[3], s[3], ba[3], ca[3];
+        for (int dim = 0; dim < 3; dim++) {
+            d[dim]  = Float4::broadcast(ray.direction[dim]);
+            s[dim]  = Float4::broadcast(ray.origin[dim]) -
+                     Float4::load(packet.v0[dim]);
+            ba[dim] = Float4::load(packet.e1[dim]);
+            ca[dim] = Float4::load(packet.e2[dim]);
+        }
 
-        float det = d.dot(ba.cross(ca));
-        float check = d.dot(geoNormal);
+        const auto cross = [](const Float4 *a, const Float4 *b, Float4 *r) {
+            r[0] = a[1] * b[2] - a[2] * b[1];
+            r[1] = a[2] * b[0] - a[0] * b[2];
+            r[2] = a[0] * b[1] - a[1] * b[0];
+        };
+        const auto dot = [](const Float4 *a, const Float4 *b) {
+            return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        };
 
-        if (-Epsilon < check && check < Epsilon) {
-            return false;
-        }
+        Float4 n[3], sca[3], bas[3];
+        cross(ba, ca, n);
+        cross(s, ca, sca);
+        cross(ba, s, bas);
 
-        float inv_det = 1.f / det;
-        float u = d.dot(s.cross(ca)) * inv_det;
-        // if ((u < 0 && abs(u) > Epsilon) || (u > 1 && abs(u-1) > Epsilon))
-        //     return false;
-        if (u < 0 || u > 1) 
-            return false;
+        const Float4 zero    = Float4::broadcast(0);
+        const Float4 one     = Float4::broadcast(1);
+        const Float4 epsilon = Float4::broadcast(Epsilon);
 
-        float v = d.dot((ba).cross(s)) * inv_det;
-        // if ((v < 0 && abs(v) > Epsilon) || (u + v > 1 && abs(u + v - 1) > Epsilon))
-        //     return false;
-        if (v < 0 || (u + v > 1)) 
-            return false;
+        const Float4 det     = dot(d, n);
+        const Float4 inv_det = one / det;
+        const Float4 uu      = dot(d, sca) * inv_det;
+        const Float4 vv      = dot(d, bas) * inv_det;
+        const Float4 tt      = (zero - dot(s, n)) * inv_det;
+        uu.store(u);
+        vv.store(v);
+        tt.store(t);
 
-        float t = -s.dot(ba.cross(ca)) * inv_det;        
-        // Done with Möller-Trumbore
+        // dismiss rays that are (almost) parallel to the triangle, i.e., for
+        // which the cosine to the geometry normal is below Epsilon
+        const simd::Mask4 hit =
+            (det * det >= epsilon * epsilon * dot(n, n)) & (uu >= zero) &
+            (uu <= one) & (vv >= zero) & (uu + vv <= one) & (tt >= epsilon) &
+            (tt <= Float4::broadcast(tMax));
+        return hit.bits();
+    }
 
-        if (t < Epsilon || t > its.t)
-            return false;
-            
+    /// @brief Returns a bit mask of the lanes of a packet that hold one of
+    /// the remaining triangles of a leaf (the others are padding).
+    static inline int laneMask(int remaining) {
+        return remaining >= simd::Lanes ? (1 << simd::Lanes) - 1
+                                        : (1 << remaining) - 1;
+    }
+
+    /**
+     * @brief Fills in the surface details of a hit that has been found by
+     * @ref intersectPacket (with @c its.t already set).
+     * @param ray The ray in the coordinates of this mesh, or null to
+     * interpolate the position of the hit from the vertices instead.
+     */
+    void populateHit(int primitiveIndex, const Vector2 &bary, const Ray *ray,
+                     Intersection &its) const {
+        const Vector3i v_indices = m_triangles[primitiveIndex];
+        const Vertex &A = m_vertices[v_indices[0]];
+        const Vertex &B = m_vertices[v_indices[1]];
+        const Vertex &C = m_vertices[v_indices[2]];
+        const Vertex interpolated = Vertex::interpolate(bary, A, B, C);
+
+        const PrecomputedTriangle triangle = precomputeTriangle(primitiveIndex);
+        const Vector geoNormal = triangle.e1.cross(triangle.e2).normalized();
+        Vector shadingNormal = geoNormal;
         if (m_smoothNormals) {
-            shadingNormal = Vertex::interpolate(Vector2(u, v), A, B, C).normal.normalized();
+            shadingNormal = interpolated.normal.normalized();
         }
 
-        const Vector2 uv_map = Vertex::interpolate(Vector2(u, v), A, B, C).uv;
+        populate(its, ray ? (*ray)(its.t) : interpolated.position,
+                 shadingNormal, geoNormal, interpolated.uv);
+    }
 
-        const Point position = ray(t);
-        its.t = t;
-        // std::cout << "geoNormal: " << geoNormal << std::endl;
-        populate(its, position, shadingNormal, geoNormal, uv_map);
+    /**
+     * @brief Whether a hit of the triangle in a slot of m_leafPackets is kept
+     * by an alpha mask. Hits of partially transparent triangles are dismissed
+     * at random, with the probability given by the mask at the hit.
+     */
+    bool passesAlphaMask(const AlphaMask *mask, int slot, float u, float v,
+                         Sampler &rng) const {
+        if (!mask ||
+            !((mask->mixed[slot / simd::Lanes] >> (slot % simd::Lanes)) & 1))
+            return true;
+        const Vector3i v_indices = m_triangles[leafPrimitiveIndices()[slot]];
+        const Vector2 uv         = interpolateBarycentric(
+            Vector2(u, v), m_vertices[v_indices[0]].uv,
+            m_vertices[v_indices[1]].uv, m_vertices[v_indices[2]].uv);
+        return rng.next() <= mask->texture->scalar(Point2(uv.x(), uv.y()));
+    }
 
-        return true;
+    /// @brief Returns the lanes of a packet of m_leafPackets that can be hit
+    /// at all.
+    static inline int opaqueLanes(const AlphaMask *mask, int packetIndex) {
+        return mask ? ~mask->transparent[packetIndex] : ~0;
+    }
+
+    /**
+     * @brief Finds the closest triangle that is hit by a ray, updating
+     * @c its.t but none of the surface details (which only need to be looked
+     * up for the closest hit, see populateHit()).
+     * @param bary Receives the barycentric coordinates of the hit.
+     * @param mask An optional alpha mask that dismisses hits.
+     * @return The index of the triangle that was hit, or -1 if there is no
+     * hit closer than @c its.t .
+     */
+    int closestHit(const Ray &ray, Intersection &its, Vector2 &bary,
+                   const AlphaMask *mask, Sampler &rng) const {
+        int hitSlot = -1;
+        traverse<false>(ray, its, [&](int first, int count) {
+            bool wasIntersected = false;
+            float t[simd::Lanes], u[simd::Lanes], v[simd::Lanes];
+            for (int slot = first; slot < first + count;) {
+                // small leaves might start in the middle of a packet
+                const int offset = slot % simd::Lanes;
+                const int lanes  = (opaqueLanes(mask, slot / simd::Lanes) >>
+                                   offset) &
+                                  laneMask(first + count - slot);
+                int hitMask = 0;
+                if (lanes) {
+                    hitMask = intersectPacket(m_leafPackets[slot / simd::Lanes],
+                                              ray, its.t, t, u, v);
+                    hitMask = (hitMask >> offset) & lanes;
+                }
+                while (hitMask) {
+                    const int lane = offset + std::countr_zero(unsigned(hitMask));
+                    hitMask &= hitMask - 1;
+                    if (t[lane] < its.t &&
+                        passesAlphaMask(mask, slot - offset + lane, u[lane],
+                                        v[lane], rng)) {
+                        its.t          = t[lane];
+                        hitSlot        = slot - offset + lane;
+                        bary           = Vector2(u[lane], v[lane]);
+                        wasIntersected = true;
+                    }
+                }
+                slot += simd::Lanes - offset;
+            }
+            return wasIntersected;
+        });
+        return hitSlot < 0 ? -1 : leafPrimitiveIndices()[hitSlot];
+    }
+
+    /**
+     * @brief Finds the closest triangle that is hit by each ray of a packet,
+     * see closestHit().
+     * @param tMax The distance up to which hits are of interest, per ray,
+     * which receives the distance of the closest hit for rays that are hit.
+     * @param primitiveIndices Receives the index of the triangle that each
+     * ray hit.
+     * @param bary Receives the barycentric coordinates of each hit.
+     * @param mask An optional alpha mask that dismisses hits.
+     * @return A bit mask of the rays that hit a triangle closer than their
+     * @c tMax .
+     */
+    RayPacket::Mask closestHits(const RayPacket &packet, RayPacket::Mask active,
+                                float *tMax, int *primitiveIndices,
+                                Vector2 *bary, const AlphaMask *mask) const {
+        int hitSlot[RayPacket::MaxSize];
+        const RayPacket::Mask hit = traversePacket<false>(
+            packet, active, tMax, [&](int first, int count,
+                                      RayPacket::Mask rays) {
+                RayPacket::Mask wasIntersected = 0;
+                float t[simd::Lanes], u[simd::Lanes], v[simd::Lanes];
+                for (int slot = first; slot < first + count;) {
+                    // the triangles of a packet are shared by all rays
+                    const int offset = slot % simd::Lanes;
+                    const TrianglePacket &triangles =
+                        m_leafPackets[slot / simd::Lanes];
+                    const int lanes =
+                        (opaqueLanes(mask, slot / simd::Lanes) >> offset) &
+                        laneMask(first + count - slot);
+                    RayPacket::forEach(lanes ? rays : 0, [&](int i) {
+                        int hitMask = intersectPacket(
+                            triangles, packet.rays[i], tMax[i], t, u, v);
+                        hitMask = (hitMask >> offset) & lanes;
+                        while (hitMask) {
+                            const int lane =
+                                offset + std::countr_zero(unsigned(hitMask));
+                            hitMask &= hitMask - 1;
+                            if (t[lane] < tMax[i] &&
+                                passesAlphaMask(mask, slot - offset + lane,
+                                                u[lane], v[lane],
+                                                *packet.rng[i])) {
+                                tMax[i]    = t[lane];
+                                hitSlot[i] = slot - offset + lane;
+                                bary[i]    = Vector2(u[lane], v[lane]);
+                                wasIntersected |= RayPacket::Mask(1) << i;
+                            }
+                        }
+                    });
+                    slot += simd::Lanes - offset;
+                }
+                return wasIntersected;
+            });
+        RayPacket::forEach(hit, [&](int i) {
+            primitiveIndices[i] = leafPrimitiveIndices()[hitSlot[i]];
+        });
+        return hit;
     }
 
-    Bounds getBoundingBox(int primitiveIndex) const override {
+    /// @brief Tests whether a ray hits any triangle closer than @c tMax ,
+    /// see closestHit().
+    bool anyHit(const Ray &ray, float tMax, const AlphaMask *mask,
+                Sampler &rng) const {
+        Intersection its(-ray.direction, tMax);
+        return traverse<true>(ray, its, [&](int first, int count) {
+            float t[simd::Lanes], u[simd::Lanes], v[simd::Lanes];
+            for (int slot = first; slot < first + count;) {
+                const int offset = slot % simd::Lanes;
+                const int lanes  = (opaqueLanes(mask, slot / simd::Lanes) >>
+                                   offset) &
+                                  laneMask(first + count - slot);
+                int hitMask = 0;
+                if (lanes) {
+                    hitMask = intersectPacket(m_leafPackets[slot / simd::Lanes],
+                                              ray, tMax, t, u, v);
+                    hitMask = (hitMask >> offset) & lanes;
+                }
+                while (hitMask) {
+                    const int lane = offset + std::countr_zero(unsigned(hitMask));
+                    hitMask &= hitMask - 1;
+                    if (passesAlphaMask(mask, slot - offset + lane, u[lane],
+                                        v[lane], rng))
+                        return true;
+                }
+                slot += simd::Lanes - offset;
+            }
+            return false;
+        });
+    }
+
+    /// @brief Tests which rays of a packet hit any triangle closer than their
+    /// respective @c tMax , see closestHit().
+    RayPacket::Mask anyHits(const RayPacket &packet, RayPacket::Mask active,
+                            const float *tMax, const AlphaMask *mask) const {
+        float limits[RayPacket::MaxSize];
+        RayPacket::forEach(active, [&](int i) { limits[i] = tMax[i]; });
+        return traversePacket<true>(
+            packet, active, limits, [&](int first, int count,
+                                        RayPacket::Mask rays) {
+                RayPacket::Mask hit = 0;
+                float t[simd::Lanes], u[simd::Lanes], v[simd::Lanes];
+                for (int slot = first; slot < first + count && rays;) {
+                    const int offset = slot % simd::Lanes;
+                    const TrianglePacket &triangles =
+                        m_leafPackets[slot / simd::Lanes];
+                    const int lanes =
+                        (opaqueLanes(mask, slot / simd::Lanes) >> offset) &
+                        laneMask(first + count - slot);
+                    RayPacket::forEach(lanes ? rays : 0, [&](int i) {
+                        int hitMask = intersectPacket(
+                            triangles, packet.rays[i], tMax[i], t, u, v);
+                        hitMask = (hitMask >> offset) & lanes;
+                        while (hitMask) {
+                            const int lane =
+                                offset + std::countr_zero(unsigned(hitMask));
+                            hitMask &= hitMask - 1;
+                            if (passesAlphaMask(mask, slot - offset + lane,
+                                                u[lane], v[lane],
+                                                *packet.rng[i])) {
+                                hit |= RayPacket::Mask(1) << i;
+                                break;
+                            }
+                        }
+                    });
+                    rays &= ~hit;
+                    slot += simd::Lanes - offset;
+                }
+                return hit;
+            });
+    }
+
+protected:
+    int numberOfPrimitives() const { return int(m_triangles.size()); }
+
+    Bounds getBoundingBox(int primitiveIndex) const {
         Vector3i v_indices = m_triangles[primitiveIndex];
         Point a = m_vertices[v_indices[0]].position;
         Point b = m_vertices[v_indices[1]].position;
@@ -145,7 +440,39 @@ protected:
         return Bounds(Point(min_x, min_y, min_z), Point(max_x, max_y, max_z));
     }
 
-    Point getCentroid(int primitiveIndex) const override {
+    void splitPrimitive(int primitiveIndex, int axis, float position,
+                        const Bounds &bounds, Bounds &left,
+                        Bounds &right) const {
+        // clip the triangle against the plane: vertices contribute to the side
+        // they lie on, and edges crossing the plane contribute their
+        // intersection point to both sides
+        Vector3i v_indices = m_triangles[primitiveIndex];
+        left  = Bounds::empty();
+        right = Bounds::empty();
+        for (int i = 0; i < 3; i++) {
+            const Point a = m_vertices[v_indices[i]].position;
+            const Point b = m_vertices[v_indices[(i + 1) % 3]].position;
+            if (a[axis] <= position)
+                left.extend(a);
+            if (a[axis] >= position)
+                right.extend(a);
+
+            if ((a[axis] < position && b[axis] > position) ||
+                (a[axis] > position && b[axis] < position)) {
+                const float t = (position - a[axis]) / (b[axis] - a[axis]);
+                Point crossing = a + t * (b - a);
+                crossing[axis] = position;
+                left.extend(crossing);
+                right.extend(crossing);
+            }
+        }
+
+        // the reference might only cover part of the triangle already
+        left  = overlap(left, bounds);
+        right = overlap(right, bounds);
+    }
+
+    Point getCentroid(int primitiveIndex) const {
         Vector3i v_indices = m_triangles[primitiveIndex];
         Vector a = Vector(m_vertices[v_indices[0]].position);
         Vector b = Vector(m_vertices[v_indices[1]].position);
@@ -154,22 +481,120 @@ protected:
         return centroid;
     }
 
-public:
-    TriangleMesh(const Properties &properties) {
-        m_originalPath  = properties.get<std::filesystem::path>("filename");
+    /// @brief Stores the triangles in the order of the BVH leaves, see
+    /// m_leafPackets.
+    void buildLeafPackets() {
+        const std::vector<int> &order = leafPrimitiveIndices();
+        m_leafPackets.assign((order.size() + simd::Lanes - 1) / simd::Lanes,
+                             TrianglePacket { {}, {}, {} });
+        for (size_t slot = 0; slot < order.size(); slot++) {
+            if (order[slot] < 0)
+                continue; // padding
+            m_leafPackets[slot / simd::Lanes].set(
+                slot % simd::Lanes, precomputeTriangle(order[slot]));
+        }
+    }
+
+    /// @brief Hashes the triangles and vertex positions, i.e., everything the
+    /// BVH depends on.
+    uint64_t contentHash() const {
+        hash::fnv1a hash;
+        hash.update(m_triangles.data(), m_triangles.size() * sizeof(Vector3i));
+        for (const Vertex &vertex : m_vertices)
+            hash.update(&vertex.position, sizeof(Point));
+        return hash;
+    }
+
+    /**
+     * @brief Creates a mesh whose triangles and vertices are provided by a
+     * subclass, which then needs to call initialize().
+     * @param name Describes the mesh in logs.
+     */
+    TriangleMesh(const Properties &properties, std::filesystem::path name)
+        : AccelerationStructure(properties), m_originalPath(std::move(name)) {}
+
+    /// @brief Reads the options of the mesh, and builds the BVH over the
+    /// triangles.
+    void initialize(const Properties &properties) {
         m_smoothNormals = properties.get<bool>("smooth", true);
+        if (properties.get<bool>("spatialSplits", false)) {
+            // allow spatial splits to create up to this fraction of
+            // additional triangle references
+            m_duplicationBudget =
+                properties.get<float>("duplicationBudget", 0.3f);
+        }
+        // larger leaves make the tree shallower, and are tested one packet of
+        // triangles at a time
+        m_maxLeafSize = properties.get<int>("maxLeafSize", 2);
+        if (m_maxLeafSize < 1) {
+            lightwave_throw("maxLeafSize must be at least 1");
+        }
+        // align leaves so that small leaves never straddle two packets
+        m_leafAlignment = std::min<int>(
+            std::bit_ceil(unsigned(m_maxLeafSize)), simd::Lanes);
+        buildAccelerationStructure(*this, cacheDirectory(properties),
+                                   contentHash());
+        buildLeafPackets();
+    }
+
+public:
+    TriangleMesh(const Properties &properties)
+        : AccelerationStructure(properties) {
+        m_originalPath = properties.get<std::filesystem::path>("filename");
         readPLY(m_originalPath, m_triangles, m_vertices);
         logger(EInfo,
                "loaded ply with %d triangles, %d vertices",
                m_triangles.size(),
                m_vertices.size());
-        buildAccelerationStructure();
+        initialize(properties);
     }
 
+    /**
+     * @brief Replaces the vertices of the mesh (e.g., for the next frame of a
+     * vertex animation), keeping its triangles. Instead of building a new BVH,
+     * the existing one is refit to the new vertex positions (see @ref
+     * AccelerationStructure::refitAccelerationStructure ).
+     * @return @c true if the BVH was refit, @c false if it was rebuilt.
+     */
+    bool setVertices(std::vector<Vertex> vertices);
+
     bool intersect(const Ray &ray, Intersection &its,
                    Sampler &rng) const override {
         PROFILE("Triangle mesh")
-        return AccelerationStructure::intersect(ray, its, rng);
+        // only remember the closest hit during traversal, and look up its
+        // vertex attributes once the traversal is done
+        Vector2 bary;
+        const int primitiveIndex = closestHit(ray, its, bary, nullptr, rng);
+        if (primitiveIndex < 0)
+            return false;
+
+        populateHit(primitiveIndex, bary, &ray, its);
+        return true;
+    }
+
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const override {
+        return anyHit(ray, tMax, nullptr, rng);
+    }
+
+    RayPacket::Mask intersect(const RayPacket &packet, RayPacket::Mask active,
+                              Intersection *its) const override {
+        PROFILE("Triangle mesh")
+        float tMax[RayPacket::MaxSize];
+        int primitiveIndices[RayPacket::MaxSize];
+        Vector2 bary[RayPacket::MaxSize];
+        RayPacket::forEach(active, [&](int i) { tMax[i] = its[i].t; });
+        const RayPacket::Mask hit = closestHits(
+            packet, active, tMax, primitiveIndices, bary, nullptr);
+        RayPacket::forEach(hit, [&](int i) {
+            its[i].t = tMax[i];
+            populateHit(primitiveIndices[i], bary[i], &packet.rays[i], its[i]);
+        });
+        return hit;
+    }
+
+    RayPacket::Mask occluded(const RayPacket &packet, RayPacket::Mask active,
+                             const float *tMax) const override {
+        return anyHits(packet, active, tMax, nullptr);
     }
 
     AreaSample sampleArea(Sampler &rng) const override{
@@ -178,6 +603,11 @@ public:
         NOT_IMPLEMENTED
     }
 
+    std::string reportName() const override {
+        return id().empty() ? m_originalPath.filename().generic_string()
+                            : id();
+    }
+
     std::string toString() const override {
         return tfm::format(
             "Mesh[\n"
@@ -191,6 +621,339 @@ public:
     }
 };
 
+/**
+ * @brief A triangle mesh that merges the meshes of many instances in world
+ * coordinates (see flattenInstances()). Rays only traverse a single BVH, but
+ * hits are still reported for the original instances, with their surface
+ * details computed by the original meshes in object coordinates.
+ */
+class FlattenedMesh final : public TriangleMesh {
+    /// @brief The instance and triangle that a merged triangle was created
+    /// from.
+    struct Origin {
+        int instance;
+        int triangle;
+    };
+
+    /// @brief The instances whose meshes have been merged.
+    std::vector<ref<Instance>> m_instances;
+    /// @brief The mesh of each instance.
+    std::vector<const TriangleMesh *> m_meshes;
+    /// @brief For each merged triangle, where it was created from.
+    std::vector<Origin> m_origins;
+
+public:
+    FlattenedMesh(const Properties &properties,
+                  std::vector<ref<Instance>> instances)
+        : TriangleMesh(properties, "flattened instances"),
+          m_instances(std::move(instances)) {
+        size_t triangleCount = 0, vertexCount = 0;
+        for (const ref<Instance> &instance : m_instances) {
+            m_meshes.push_back(
+                static_cast<const TriangleMesh *>(instance->shape()));
+            triangleCount += m_meshes.back()->m_triangles.size();
+            vertexCount += m_meshes.back()->m_vertices.size();
+        }
+
+        m_triangles.reserve(triangleCount);
+        m_origins.reserve(triangleCount);
+        m_vertices.reserve(vertexCount);
+        for (int instance = 0; instance < int(m_instances.size()); instance++) {
+            const TriangleMesh &mesh = *m_meshes[instance];
+            const AffineTransform &toWorld =
+                m_instances[instance]->objectToWorld();
+            const int firstVertex = int(m_vertices.size());
+            // only positions are needed, the other vertex attributes are
+            // looked up in the original mesh
+            for (const Vertex &vertex : mesh.m_vertices)
+                m_vertices.push_back({ .position = toWorld.apply(vertex.position),
+                                       .uv       = {},
+                                       .normal   = {} });
+            for (int triangle = 0; triangle < int(mesh.m_triangles.size());
+                 triangle++) {
+                const Vector3i &v_indices = mesh.m_triangles[triangle];
+                m_triangles.push_back({ v_indices[0] + firstVertex,
+                                        v_indices[1] + firstVertex,
+                                        v_indices[2] + firstVertex });
+                m_origins.push_back({ instance, triangle });
+            }
+        }
+        logger(EInfo,
+               "flattened %d instances into a mesh with %d triangles",
+               m_instances.size(),
+               m_triangles.size());
+        initialize(properties);
+    }
+
+    bool intersect(const Ray &ray, Intersection &its,
+                   Sampler &rng) const override {
+        PROFILE("Triangle mesh")
+        Vector2 bary;
+        const int primitiveIndex = closestHit(ray, its, bary, nullptr, rng);
+        if (primitiveIndex < 0)
+            return false;
+
+        // barycentric coordinates are unaffected by affine transforms, so the
+        // original mesh can fill in the hit as if its instance had been hit
+        const Origin &origin = m_origins[primitiveIndex];
+        m_meshes[origin.instance]->populateHit(origin.triangle, bary, nullptr,
+                                               its);
+        m_instances[origin.instance]->completeHit(its);
+        return true;
+    }
+
+    RayPacket::Mask intersect(const RayPacket &packet, RayPacket::Mask active,
+                              Intersection *its) const override {
+        PROFILE("Triangle mesh")
+        float tMax[RayPacket::MaxSize];
+        int primitiveIndices[RayPacket::MaxSize];
+        Vector2 bary[RayPacket::MaxSize];
+        RayPacket::forEach(active, [&](int i) { tMax[i] = its[i].t; });
+        const RayPacket::Mask hit = closestHits(
+            packet, active, tMax, primitiveIndices, bary, nullptr);
+        RayPacket::forEach(hit, [&](int i) {
+            its[i].t             = tMax[i];
+            const Origin &origin = m_origins[primitiveIndices[i]];
+            m_meshes[origin.instance]->populateHit(
+                origin.triangle, bary[i], nullptr, its[i]);
+            m_instances[origin.instance]->completeHit(its[i]);
+        });
+        return hit;
+    }
+
+    void markAsVisible() override {
+        for (const ref<Instance> &instance : m_instances)
+            instance->markAsVisible();
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "FlattenedMesh[\n"
+            "  instances = %d,\n"
+            "  triangles = %d,\n"
+            "]",
+            m_instances.size(),
+            m_triangles.size());
+    }
+};
+
+/**
+ * @brief A triangle mesh seen through an alpha mask (see alphaMaskedMesh()).
+ * The mesh itself is left untouched, so that it can still be shared by
+ * instances with other masks or none at all.
+ */
+class AlphaMaskedMesh final : public Shape {
+    enum Opacity : uint8_t { Opaque, Transparent, Mixed };
+
+    /// @brief The mesh whose hits are dismissed.
+    ref<TriangleMesh> m_mesh;
+    /// @brief The texture that describes the opacity of the mesh.
+    ref<Texture> m_alpha;
+    /// @brief The classification of the triangles of m_mesh by m_alpha, in
+    /// the order of m_mesh->m_triangles.
+    std::vector<Opacity> m_opacity;
+    /// @brief The classification of the triangles of m_mesh by m_alpha, in
+    /// the order of the leaves of its BVH.
+    AlphaMask m_mask;
+
+public:
+    AlphaMaskedMesh(ref<TriangleMesh> mesh, ref<Texture> alpha)
+        : m_mesh(std::move(mesh)), m_alpha(std::move(alpha)) {
+        Timer classifyTimer;
+        const TriangleMesh &source = *m_mesh;
+        std::vector<Opacity> &opacity = m_opacity;
+        opacity.resize(source.m_triangles.size());
+        int counts[3] = {};
+        for (size_t triangle = 0; triangle < opacity.size(); triangle++) {
+            const Vector3i &v_indices = source.m_triangles[triangle];
+            Point2 uv[3];
+            for (int i = 0; i < 3; i++) {
+                const Vector2 &vertexUv = source.m_vertices[v_indices[i]].uv;
+                uv[i]                   = Point2(vertexUv.x(), vertexUv.y());
+            }
+
+            // hits are dismissed if a random number exceeds the mask
+            float min, max;
+            if (!m_alpha->scalarRange(uv[0], uv[1], uv[2], min, max))
+                opacity[triangle] = Mixed;
+            else if (max <= 0)
+                opacity[triangle] = Transparent;
+            else if (min >= 1)
+                opacity[triangle] = Opaque;
+            else
+                opacity[triangle] = Mixed;
+            counts[opacity[triangle]]++;
+        }
+
+        m_mask.texture = m_alpha.get();
+        updateMask();
+        m_mesh->m_alphaMasks.push_back(this);
+        logger(EInfo,
+               "classified triangles of %s by alpha mask in %.1f ms: %d "
+               "opaque, %d transparent, %d mixed",
+               source.m_originalPath.filename(),
+               classifyTimer.getElapsedTime() * 1000,
+               counts[Opaque],
+               counts[Transparent],
+               counts[Mixed]);
+    }
+
+    ~AlphaMaskedMesh() {
+        auto &masks = m_mesh->m_alphaMasks;
+        masks.erase(std::find(masks.begin(), masks.end(), this));
+    }
+
+    /// @brief Arranges the classification of the triangles in the current
+    /// order of the leaves of the BVH of the mesh.
+    void updateMask() {
+        const TriangleMesh &source     = *m_mesh;
+        const std::vector<int> &order = source.leafPrimitiveIndices();
+        m_mask.transparent.assign(source.m_leafPackets.size(), 0);
+        m_mask.mixed.assign(source.m_leafPackets.size(), 0);
+        for (size_t slot = 0; slot < order.size(); slot++) {
+            if (order[slot] < 0)
+                continue; // padding
+            const uint8_t bit = uint8_t(1 << (slot % simd::Lanes));
+            if (m_opacity[order[slot]] == Transparent)
+                m_mask.transparent[slot / simd::Lanes] |= bit;
+            else if (m_opacity[order[slot]] == Mixed)
+                m_mask.mixed[slot / simd::Lanes] |= bit;
+        }
+    }
+
+    bool intersect(const Ray &ray, Intersection &its,
+                   Sampler &rng) const override {
+        PROFILE("Triangle mesh")
+        Vector2 bary;
+        const int primitiveIndex =
+            m_mesh->closestHit(ray, its, bary, &m_mask, rng);
+        if (primitiveIndex < 0)
+            return false;
+
+        m_mesh->populateHit(primitiveIndex, bary, &ray, its);
+        return true;
+    }
+
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const override {
+        return m_mesh->anyHit(ray, tMax, &m_mask, rng);
+    }
+
+    RayPacket::Mask intersect(const RayPacket &packet, RayPacket::Mask active,
+                              Intersection *its) const override {
+        PROFILE("Triangle mesh")
+        float tMax[RayPacket::MaxSize];
+        int primitiveIndices[RayPacket::MaxSize];
+        Vector2 bary[RayPacket::MaxSize];
+        RayPacket::forEach(active, [&](int i) { tMax[i] = its[i].t; });
+        const RayPacket::Mask hit = m_mesh->closestHits(
+            packet, active, tMax, primitiveIndices, bary, &m_mask);
+        RayPacket::forEach(hit, [&](int i) {
+            its[i].t = tMax[i];
+            m_mesh->populateHit(
+                primitiveIndices[i], bary[i], &packet.rays[i], its[i]);
+        });
+        return hit;
+    }
+
+    RayPacket::Mask occluded(const RayPacket &packet, RayPacket::Mask active,
+                             const float *tMax) const override {
+        return m_mesh->anyHits(packet, active, tMax, &m_mask);
+    }
+
+    // the accessors of the whole mesh are hidden by those of its triangles
+    Bounds getBoundingBox() const override {
+        return static_cast<const Shape &>(*m_mesh).getBoundingBox();
+    }
+
+    Bounds getTransformedBoundingBox(
+        const AffineTransform &transform) const override {
+        return m_mesh->getTransformedBoundingBox(transform);
+    }
+
+    Point getCentroid() const override {
+        return static_cast<const Shape &>(*m_mesh).getCentroid();
+    }
+
+    AreaSample sampleArea(Sampler &rng) const override {
+        return m_mesh->sampleArea(rng);
+    }
+
+    void markAsVisible() override { m_mesh->markAsVisible(); }
+
+    std::string toString() const override {
+        return tfm::format("AlphaMaskedMesh[\n"
+                           "  mesh = %s,\n"
+                           "  alpha = %s\n"
+                           "]",
+                           indent(m_mesh),
+                           indent(m_alpha));
+    }
+};
+
+bool TriangleMesh::setVertices(std::vector<Vertex> vertices) {
+    if (vertices.size() != m_vertices.size()) {
+        lightwave_throw("cannot change the number of vertices of %s from %d "
+                        "to %d",
+                        m_originalPath,
+                        m_vertices.size(),
+                        vertices.size());
+    }
+    m_vertices           = std::move(vertices);
+    const bool refitted = refitAccelerationStructure(*this);
+    buildLeafPackets();
+    if (!refitted) {
+        // the rebuilt BVH orders the triangles differently
+        for (AlphaMaskedMesh *mask : m_alphaMasks)
+            mask->updateMask();
+    }
+    return refitted;
+}
+
+std::vector<ref<Shape>> flattenInstances(const std::vector<ref<Shape>> &shapes,
+                                         const Properties &properties) {
+    // meshes that several instances share stay instanced, as merging them
+    // would duplicate their triangles
+    std::unordered_map<const Shape *, int> instanceCount;
+    for (const ref<Shape> &shape : shapes) {
+        if (const auto *instance = dynamic_cast<const Instance *>(shape.get()))
+            instanceCount[instance->shape()]++;
+    }
+
+    std::vector<ref<Instance>> flattened;
+    std::vector<ref<Shape>> remaining;
+    for (const ref<Shape> &shape : shapes) {
+        const auto instance = std::dynamic_pointer_cast<Instance>(shape);
+        if (instance && instance->canBeFlattened() &&
+            dynamic_cast<const TriangleMesh *>(instance->shape()) &&
+            instanceCount[instance->shape()] == 1) {
+            flattened.push_back(instance);
+        } else {
+            remaining.push_back(shape);
+        }
+    }
+    if (flattened.size() < 2)
+        return shapes;
+
+    remaining.insert(remaining.begin(),
+                     std::make_shared<FlattenedMesh>(properties,
+                                                     std::move(flattened)));
+    return remaining;
+}
+
+ref<Shape> alphaMaskedMesh(const ref<Shape> &shape, const ref<Texture> &alpha) {
+    auto mesh = std::dynamic_pointer_cast<TriangleMesh>(shape);
+    if (!mesh)
+        return nullptr;
+    return std::make_shared<AlphaMaskedMesh>(std::move(mesh), alpha);
+}
+
+bool setMeshVertices(const ref<Shape> &shape, std::vector<Vertex> vertices) {
+    const auto mesh = std::dynamic_pointer_cast<TriangleMesh>(shape);
+    if (!mesh)
+        lightwave_throw("only the vertices of triangle meshes can be replaced");
+    return mesh->setVertices(std::move(vertices));
+}
+
 } // namespace lightwave
 
 REGISTER_SHAPE(TriangleMesh, "mesh")
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <lightwave/core.hpp>
+#include <lightwave/properties.hpp>
+
+#include <vector>
+
+namespace lightwave {
+
+/**
+ * @brief Merges the triangle meshes of instances into a single mesh in world
+ * coordinates, so that one BVH can be built over all of their triangles
+ * instead of nesting a BVH per instance. Only instances whose mesh is not
+ * shared with other instances of @c shapes are merged, and their bindings
+ * (materials, emission, normal maps) are kept.
+ * @param properties The options that the merged mesh is built with.
+ * @return The shapes that remain, starting with the merged mesh (or
+ * @c shapes itself if fewer than two instances can be merged).
+ */
+std::vector<ref<Shape>> flattenInstances(const std::vector<ref<Shape>> &shapes,
+                                         const Properties &properties);
+
+/**
+ * @brief Lets a triangle mesh handle the alpha mask of an instance: the
+ * triangles are classified as opaque, transparent or partially transparent
+ * once, so that transparent triangles are skipped during traversal and the
+ * mask is only looked up for hits of partially transparent ones.
+ * @return A shape that dismisses hits of @c shape according to @c alpha , or
+ * null if @c shape is not a triangle mesh.
+ */
+ref<Shape> alphaMaskedMesh(const ref<Shape> &shape, const ref<Texture> &alpha);
+
+/**
+ * @brief Replaces the vertices of a triangle mesh (e.g., for the next frame of
+ * a vertex animation), refitting its BVH unless it has degraded too much.
+ * @return @c true if the BVH was refit, @c false if it was rebuilt.
+ */
+bool setMeshVertices(const ref<Shape> &shape, std::vector<Vertex> vertices);
+
+} // namespace lightwave
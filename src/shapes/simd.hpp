@@ -0,0 +1,228 @@
+/**
+ * @file simd.hpp
+ * @brief A minimal four-wide SIMD abstraction used by the acceleration
+ * structures to test several bounding boxes (or triangles) at once.
+ */
+
+#pragma once
+
+#include <lightwave/core.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LW_SIMD_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LW_SIMD_NEON
+#endif
+
+namespace lightwave::simd {
+
+/// @brief The number of lanes processed by a single @ref Float4 operation.
+static constexpr int Lanes = 4;
+
+/**
+ * @brief A boolean mask over four lanes, as returned by the comparison
+ * operators of @ref Float4 .
+ */
+struct Mask4 {
+#if defined(LW_SIMD_SSE)
+    __m128 v;
+#elif defined(LW_SIMD_NEON)
+    uint32x4_t v;
+#else
+    bool v[Lanes];
+#endif
+
+    /// @brief Returns the mask as integer, with bit @c i set if lane @c i is
+    /// set.
+    int bits() const {
+#if defined(LW_SIMD_SSE)
+        return _mm_movemask_ps(v);
+#elif defined(LW_SIMD_NEON)
+        const uint32x4_t weights = { 1, 2, 4, 8 };
+        return int(vaddvq_u32(vandq_u32(v, weights)));
+#else
+        return int(v[0]) | int(v[1]) << 1 | int(v[2]) << 2 | int(v[3]) << 3;
+#endif
+    }
+
+    friend Mask4 operator&(const Mask4 &a, const Mask4 &b) {
+#if defined(LW_SIMD_SSE)
+        return { _mm_and_ps(a.v, b.v) };
+#elif defined(LW_SIMD_NEON)
+        return { vandq_u32(a.v, b.v) };
+#else
+        Mask4 r;
+        for (int i = 0; i < Lanes; i++)
+            r.v[i] = a.v[i] && b.v[i];
+        return r;
+#endif
+    }
+
+    friend Mask4 operator|(const Mask4 &a, const Mask4 &b) {
+#if defined(LW_SIMD_SSE)
+        return { _mm_or_ps(a.v, b.v) };
+#elif defined(LW_SIMD_NEON)
+        return { vorrq_u32(a.v, b.v) };
+#else
+        Mask4 r;
+        for (int i = 0; i < Lanes; i++)
+            r.v[i] = a.v[i] || b.v[i];
+        return r;
+#endif
+    }
+};
+
+/// @brief Four single precision floats that are processed in lockstep.
+struct Float4 {
+#if defined(LW_SIMD_SSE)
+    __m128 v;
+#elif defined(LW_SIMD_NEON)
+    float32x4_t v;
+#else
+    float v[Lanes];
+#endif
+
+    /// @brief Loads four consecutive floats (no alignment required).
+    static Float4 load(const float *data) {
+#if defined(LW_SIMD_SSE)
+        return { _mm_loadu_ps(data) };
+#elif defined(LW_SIMD_NEON)
+        return { vld1q_f32(data) };
+#else
+        return { { data[0], data[1], data[2], data[3] } };
+#endif
+    }
+
+    /// @brief Loads four consecutive 8-bit unsigned integers and converts them
+    /// to floats.
+    static Float4 load(const uint8_t *data) {
+        uint32_t bits;
+        std::memcpy(&bits, data, sizeof(bits));
+#if defined(LW_SIMD_SSE)
+        const __m128i zero = _mm_setzero_si128();
+        __m128i v          = _mm_cvtsi32_si128(int(bits));
+        v                  = _mm_unpacklo_epi8(v, zero);
+        v                  = _mm_unpacklo_epi16(v, zero);
+        return { _mm_cvtepi32_ps(v) };
+#elif defined(LW_SIMD_NEON)
+        const uint16x8_t v = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(bits)));
+        return { vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))) };
+#else
+        return { { float(data[0]), float(data[1]), float(data[2]),
+                   float(data[3]) } };
+#endif
+    }
+
+    /// @brief Loads four consecutive 16-bit unsigned integers and converts
+    /// them to floats.
+    static Float4 load(const uint16_t *data) {
+#if defined(LW_SIMD_SSE)
+        const __m128i zero = _mm_setzero_si128();
+        __m128i v =
+            _mm_loadl_epi64(reinterpret_cast<const __m128i *>(data));
+        v = _mm_unpacklo_epi16(v, zero);
+        return { _mm_cvtepi32_ps(v) };
+#elif defined(LW_SIMD_NEON)
+        return { vcvtq_f32_u32(vmovl_u16(vld1_u16(data))) };
+#else
+        return { { float(data[0]), float(data[1]), float(data[2]),
+                   float(data[3]) } };
+#endif
+    }
+
+    /// @brief Sets all four lanes to the same value.
+    static Float4 broadcast(float value) {
+#if defined(LW_SIMD_SSE)
+        return { _mm_set1_ps(value) };
+#elif defined(LW_SIMD_NEON)
+        return { vdupq_n_f32(value) };
+#else
+        return { { value, value, value, value } };
+#endif
+    }
+
+    /// @brief Stores the four lanes to consecutive floats (no alignment
+    /// required).
+    void store(float *data) const {
+#if defined(LW_SIMD_SSE)
+        _mm_storeu_ps(data, v);
+#elif defined(LW_SIMD_NEON)
+        vst1q_f32(data, v);
+#else
+        for (int i = 0; i < Lanes; i++)
+            data[i] = v[i];
+#endif
+    }
+
+#if defined(LW_SIMD_SSE)
+#define LW_SIMD_BINARY(op, sse, neon, scalar)                                  \
+    friend Float4 op(const Float4 &a, const Float4 &b) {                       \
+        return { sse(a.v, b.v) };                                              \
+    }
+#define LW_SIMD_COMPARE(op, sse, neon, scalar)                                 \
+    friend Mask4 op(const Float4 &a, const Float4 &b) {                        \
+        return { sse(a.v, b.v) };                                              \
+    }
+#elif defined(LW_SIMD_NEON)
+#define LW_SIMD_BINARY(op, sse, neon, scalar)                                  \
+    friend Float4 op(const Float4 &a, const Float4 &b) {                       \
+        return { neon(a.v, b.v) };                                             \
+    }
+#define LW_SIMD_COMPARE(op, sse, neon, scalar)                                 \
+    friend Mask4 op(const Float4 &a, const Float4 &b) {                        \
+        return { neon(a.v, b.v) };                                             \
+    }
+#else
+#define LW_SIMD_BINARY(op, sse, neon, scalar)                                  \
+    friend Float4 op(const Float4 &a, const Float4 &b) {                       \
+        Float4 r;                                                              \
+        for (int i = 0; i < Lanes; i++)                                        \
+            r.v[i] = scalar(a.v[i], b.v[i]);                                   \
+        return r;                                                              \
+    }
+#define LW_SIMD_COMPARE(op, sse, neon, scalar)                                 \
+    friend Mask4 op(const Float4 &a, const Float4 &b) {                        \
+        Mask4 r;                                                               \
+        for (int i = 0; i < Lanes; i++)                                        \
+            r.v[i] = scalar(a.v[i], b.v[i]);                                   \
+        return r;                                                              \
+    }
+#endif
+
+    static float add(float a, float b) { return a + b; }
+    static float sub(float a, float b) { return a - b; }
+    static float mul(float a, float b) { return a * b; }
+    static float div(float a, float b) { return a / b; }
+    // matches the semantics of minps/maxps, which return the second operand
+    // if either operand is NaN
+    static float fmin(float a, float b) { return a < b ? a : b; }
+    static float fmax(float a, float b) { return a > b ? a : b; }
+    static bool lt(float a, float b) { return a < b; }
+    static bool le(float a, float b) { return a <= b; }
+    static bool ge(float a, float b) { return a >= b; }
+    static bool gt(float a, float b) { return a > b; }
+
+    LW_SIMD_BINARY(operator+, _mm_add_ps, vaddq_f32, add)
+    LW_SIMD_BINARY(operator-, _mm_sub_ps, vsubq_f32, sub)
+    LW_SIMD_BINARY(operator*, _mm_mul_ps, vmulq_f32, mul)
+    LW_SIMD_BINARY(operator/, _mm_div_ps, vdivq_f32, div)
+    LW_SIMD_BINARY(min, _mm_min_ps, vminq_f32, fmin)
+    LW_SIMD_BINARY(max, _mm_max_ps, vmaxq_f32, fmax)
+    LW_SIMD_COMPARE(operator<, _mm_cmplt_ps, vcltq_f32, lt)
+    LW_SIMD_COMPARE(operator<=, _mm_cmple_ps, vcleq_f32, le)
+    LW_SIMD_COMPARE(operator>=, _mm_cmpge_ps, vcgeq_f32, ge)
+    LW_SIMD_COMPARE(operator>, _mm_cmpgt_ps, vcgtq_f32, gt)
+
+#undef LW_SIMD_BINARY
+#undef LW_SIMD_COMPARE
+};
+
+} // namespace lightwave::simd
@@ -0,0 +1,222 @@
+#include <lightwave.hpp>
+
+#include "../core/mappedfile.hpp"
+#include "../core/plyparser.hpp"
+#include "accel.hpp"
+
+#include <cstring>
+
+namespace lightwave {
+
+/**
+ * @brief A shape consisting of many (potentially millions of) spheres, e.g.,
+ * for particles or point clouds. Instead of an instance with its own transform
+ * per sphere, the centers and radii of all spheres are stored in one flat
+ * array (16 bytes per sphere), over which a single BVH is built.
+ *
+ * The spheres are read from @c filename , which is either a PLY file whose
+ * vertices provide the centers (and optionally a float @c radius property),
+ * or a raw binary file of consecutive little-endian float records
+ * (x, y, z, radius). For PLY files without radii, all spheres use the
+ * @c radius property of the shape instead.
+ */
+class Spheres final : public AccelerationStructure {
+    friend AccelerationStructure;
+
+    /// @brief A single sphere.
+    struct Particle {
+        Point center;
+        float radius;
+    };
+    static_assert(sizeof(Particle) == 16, "spheres must be tightly packed");
+
+    /**
+     * @brief The spheres. Once the BVH is built, they are stored in the order
+     * they are referenced by the BVH leaves (see @ref leafPrimitiveIndices ),
+     * so that leaves can be tested without any indirections.
+     */
+    std::vector<Particle> m_particles;
+    /// @brief The file the spheres were loaded from, for logging and
+    /// debugging purposes.
+    std::filesystem::path m_originalPath;
+
+    /**
+     * @brief Intersects a sphere with a (normalized) ray, using the
+     * formulation of Haines et al., "Precision Improvements for Ray/Sphere
+     * Intersection", which stays accurate for small spheres far away from the
+     * ray origin.
+     * @return The distance to the closest hit between Epsilon and @c tMax ,
+     * or Infinity if there is none.
+     */
+    static inline float intersectSphere(const Particle &sphere, const Ray &ray,
+                                        float tMax) {
+        const Vector f      = ray.origin - sphere.center;
+        const float b       = -f.dot(ray.direction);
+        const Vector l      = f + b * ray.direction;
+        const float radius2 = sqr(sphere.radius);
+        const float discriminant = radius2 - l.dot(l);
+        if (discriminant < 0)
+            return Infinity;
+
+        // avoid the cancellation of the textbook formula by computing the
+        // farther root first
+        const float q = b + std::copysign(std::sqrt(discriminant), b);
+        float t0      = (f.dot(f) - radius2) / q;
+        float t1      = q;
+        if (t0 > t1)
+            std::swap(t0, t1);
+
+        const float t = t0 > Epsilon ? t0 : t1;
+        return t > Epsilon && t < tMax ? t : Infinity;
+    }
+
+    /// @brief Fills in the surface details of a point on a sphere.
+    static void populate(SurfaceEvent &surf, const Particle &sphere,
+                         const Point &position) {
+        const Vector normal = (position - sphere.center).normalized();
+        // project the point back onto the sphere to remove rounding errors
+        surf.position       = sphere.center + sphere.radius * normal;
+        surf.shadingNormal  = normal;
+        surf.geometryNormal = normal;
+        surf.tangent        = Vector(0.f, normal.z(), -normal.y());
+        if (surf.tangent.isZero())
+            surf.tangent = Vector(0.f, 0.f, 1.f);
+        else
+            surf.tangent = surf.tangent.normalized();
+        surf.uv = Point2(0.5f + std::atan2(normal.z(), normal.x()) / (2 * Pi),
+                         0.5f + std::asin(clamp(normal.y(), -1.f, 1.f)) / Pi);
+        // area sampling is not supported
+        surf.pdf = 0;
+    }
+
+    /// @brief Reads spheres from a raw binary file of (x, y, z, radius)
+    /// records.
+    void readBinary(const std::filesystem::path &path) {
+        logger(EInfo, "loading spheres %s", path);
+        const MappedFile file(path);
+        if (!file)
+            lightwave_throw("could not open %s", path);
+        if (file.size() % sizeof(Particle) != 0) {
+            lightwave_throw("size of %s is not a multiple of %d bytes (x, y, "
+                            "z and radius as floats)",
+                            path,
+                            sizeof(Particle));
+        }
+        m_particles.resize(file.size() / sizeof(Particle));
+        std::memcpy(m_particles.data(), file.data(), file.size());
+    }
+
+    /// @brief Hashes the spheres, so that cached BVHs can be reused.
+    uint64_t contentHash() const {
+        hash::fnv1a hash;
+        hash.update(m_particles.data(), m_particles.size() * sizeof(Particle));
+        return hash;
+    }
+
+protected:
+    int numberOfPrimitives() const { return int(m_particles.size()); }
+
+    Bounds getBoundingBox(int primitiveIndex) const {
+        const Particle &sphere = m_particles[primitiveIndex];
+        const Vector extent(sphere.radius);
+        return { sphere.center - extent, sphere.center + extent };
+    }
+
+    Point getCentroid(int primitiveIndex) const {
+        return m_particles[primitiveIndex].center;
+    }
+
+    /// @brief Spatial splits are not used for spheres (which would break
+    /// storing them in leaf order), but the BVH builder requires this.
+    void splitPrimitive(int primitiveIndex, int axis, float position,
+                        const Bounds &bounds, Bounds &left,
+                        Bounds &right) const {
+        splitBounds(axis, position, bounds, left, right);
+    }
+
+public:
+    Spheres(const Properties &properties) : AccelerationStructure(properties) {
+        m_originalPath = properties.get<std::filesystem::path>("filename");
+        const float radius = properties.get<float>("radius", 1);
+        if (m_originalPath.extension() == ".ply") {
+            std::vector<Point> centers;
+            std::vector<float> radii;
+            readPLY(m_originalPath, centers, radii);
+            m_particles.resize(centers.size());
+            for (size_t i = 0; i < centers.size(); i++) {
+                m_particles[i] = { centers[i],
+                                   radii.empty() ? radius : radii[i] };
+            }
+        } else {
+            readBinary(m_originalPath);
+        }
+        logger(EInfo, "loaded %d spheres", m_particles.size());
+
+        m_maxLeafSize = properties.get<int>("maxLeafSize", 2);
+        if (m_maxLeafSize < 1) {
+            lightwave_throw("maxLeafSize must be at least 1");
+        }
+        buildAccelerationStructure(*this, cacheDirectory(properties),
+                                   contentHash());
+
+        // store the spheres in leaf order (without spatial splits, every
+        // sphere is referenced exactly once)
+        std::vector<Particle> ordered(leafPrimitiveIndices().size());
+        for (size_t i = 0; i < ordered.size(); i++)
+            ordered[i] = m_particles[leafPrimitiveIndices()[i]];
+        m_particles = std::move(ordered);
+    }
+
+    bool intersect(const Ray &ray, Intersection &its,
+                   Sampler &rng) const override {
+        PROFILE("Spheres")
+        int closest = -1;
+        traverse<false>(ray, its, [&](int first, int count) {
+            bool wasIntersected = false;
+            for (int i = first; i < first + count; i++) {
+                const float t = intersectSphere(m_particles[i], ray, its.t);
+                if (t < its.t) {
+                    its.t          = t;
+                    closest        = i;
+                    wasIntersected = true;
+                }
+            }
+            return wasIntersected;
+        });
+        if (closest < 0)
+            return false;
+
+        populate(its, m_particles[closest], ray(its.t));
+        return true;
+    }
+
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const override {
+        PROFILE("Spheres")
+        Intersection its(-ray.direction, tMax);
+        return traverse<true>(ray, its, [&](int first, int count) {
+            for (int i = first; i < first + count; i++) {
+                if (intersectSphere(m_particles[i], ray, tMax) < tMax)
+                    return true;
+            }
+            return false;
+        });
+    }
+
+    std::string reportName() const override {
+        return id().empty() ? m_originalPath.filename().generic_string()
+                            : id();
+    }
+
+    std::string toString() const override {
+        return tfm::format("Spheres[\n"
+                           "  count = %d,\n"
+                           "  filename = \"%s\"\n"
+                           "]",
+                           m_particles.size(),
+                           m_originalPath.generic_string());
+    }
+};
+
+} // namespace lightwave
+
+REGISTER_SHAPE(Spheres, "spheres")
@@ -0,0 +1,207 @@
+#include <lightwave.hpp>
+
+#include "../shapes/accel.hpp"
+
+#include <fstream>
+
+namespace lightwave {
+
+/**
+ * @brief Reports the quality of all acceleration structures of the scene (SAH
+ * cost, leaf size and depth histograms, sibling overlap and memory), and how
+ * many nodes and children the rays traced by an integrator visit in each of
+ * them, split into camera, shadow and indirect rays.
+ *
+ * The report is printed to the console and written to a JSON file, which
+ * makes it easy to compare build strategies and to catch regressions in
+ * exported scenes. The integrator is optional; without it, only the quality
+ * metrics are reported.
+ *
+ * @example
+ * @code
+ * <test type="bvhreport" filename="bvh.json">
+ *     <integrator type="direct"> ... </integrator>
+ * </test>
+ * @endcode
+ * @note Recording traversal statistics slows rendering down, so timings of
+ * the integrator are not representative.
+ */
+class BvhReport : public Test {
+    typedef AccelerationStructure::RayKind RayKind;
+
+    /// @brief The integrator whose rays are recorded, or null.
+    ref<Integrator> m_integrator;
+    /// @brief The path the JSON report is written to.
+    std::filesystem::path m_filename;
+
+    static constexpr std::pair<RayKind, const char *> RayKinds[] = {
+        { RayKind::Camera, "camera" },
+        { RayKind::Shadow, "shadow" },
+        { RayKind::Indirect, "indirect" },
+    };
+
+public:
+    BvhReport(const Properties &properties) {
+        m_integrator = properties.getOptionalChild<Integrator>();
+        m_filename   = properties.get<std::filesystem::path>(
+            "filename", properties.basePath() / "bvh.json");
+    }
+
+    void execute() override {
+        if (m_integrator) {
+            AccelerationStructure::collectStatistics(true);
+            m_integrator->execute();
+            AccelerationStructure::collectStatistics(false);
+        }
+
+        const auto structures = AccelerationStructure::instances();
+        for (const AccelerationStructure *structure : structures)
+            print(*structure);
+
+        std::ofstream stream(m_filename);
+        writeJson(structures, stream);
+        if (!stream)
+            lightwave_throw("could not write BVH report to %s", m_filename);
+        logger(EInfo, "wrote BVH report to %s", m_filename);
+    }
+
+    std::string toString() const override {
+        return tfm::format("BvhReport[\n"
+                           "  integrator = %s,\n"
+                           "  filename = \"%s\"\n"
+                           "]",
+                           m_integrator ? indent(m_integrator) : "none",
+                           m_filename.generic_string());
+    }
+
+private:
+    /// @brief Formats a histogram as "bin:count" pairs, skipping empty bins.
+    static std::string histogram(const std::vector<size_t> &bins) {
+        std::string result;
+        for (size_t bin = 0; bin < bins.size(); bin++) {
+            if (bins[bin])
+                result += tfm::format(" %d:%d", bin, bins[bin]);
+        }
+        return result;
+    }
+
+    void print(const AccelerationStructure &structure) const {
+        const AccelerationStructure::Quality quality = structure.quality();
+        logger(EInfo,
+               "BVH%d \"%s\" (%s%s): %d nodes, %d leaves, %d references, "
+               "%.2f MiB",
+               quality.width,
+               structure.reportName(),
+               quality.builder,
+               quality.quantization
+                   ? tfm::format(", %d bit", quality.quantization)
+                   : "",
+               quality.nodeCount,
+               quality.leafCount,
+               quality.referenceCount,
+               (quality.nodeBytes + quality.indexBytes) / (1024.0 * 1024.0));
+        logger(EInfo,
+               "  SAH cost %.2f, sibling overlap %.3f",
+               quality.sahCost,
+               quality.overlapRatio);
+        logger(EInfo, "  leaf sizes:%s", histogram(quality.leafSizes));
+        logger(EInfo, "  leaf depths:%s", histogram(quality.leafDepths));
+
+        if (!m_integrator)
+            return;
+        for (const auto &[kind, name] : RayKinds) {
+            const auto statistics = structure.statistics(kind);
+            if (!statistics.traversals)
+                continue;
+            logger(EInfo,
+                   "  %s rays: %d traversals, %.2f nodes and %.2f children "
+                   "per traversal",
+                   name,
+                   statistics.traversals,
+                   double(statistics.nodes) / statistics.traversals,
+                   double(statistics.primitives) / statistics.traversals);
+        }
+    }
+
+    /// @brief Escapes a string for use in JSON.
+    static std::string quoted(const std::string &value) {
+        std::string result = "\"";
+        for (const char c : value) {
+            if (c == '"' || c == '\\')
+                result += '\\';
+            if (static_cast<unsigned char>(c) < 0x20) {
+                result += tfm::format("\\u%04x", int(c));
+                continue;
+            }
+            result += c;
+        }
+        return result + "\"";
+    }
+
+    static std::string jsonArray(const std::vector<size_t> &values) {
+        std::string result = "[";
+        for (size_t i = 0; i < values.size(); i++)
+            result += tfm::format(i ? ", %d" : "%d", values[i]);
+        return result + "]";
+    }
+
+    void writeJson(
+        const std::vector<const AccelerationStructure *> &structures,
+        std::ostream &stream) const {
+        stream << "{\n  \"structures\": [";
+        for (size_t i = 0; i < structures.size(); i++) {
+            const AccelerationStructure &structure = *structures[i];
+            const AccelerationStructure::Quality quality = structure.quality();
+            stream << (i ? ",\n" : "\n") << "    {\n";
+            stream << tfm::format("      \"name\": %s,\n"
+                                  "      \"width\": %d,\n"
+                                  "      \"quantization\": %d,\n"
+                                  "      \"builder\": \"%s\",\n"
+                                  "      \"nodes\": %d,\n"
+                                  "      \"leaves\": %d,\n"
+                                  "      \"references\": %d,\n"
+                                  "      \"nodeBytes\": %d,\n"
+                                  "      \"indexBytes\": %d,\n"
+                                  "      \"sahCost\": %.9g,\n"
+                                  "      \"overlapRatio\": %.9g,\n"
+                                  "      \"leafSizes\": %s,\n"
+                                  "      \"leafDepths\": %s",
+                                  quoted(structure.reportName()),
+                                  quality.width,
+                                  quality.quantization,
+                                  quality.builder,
+                                  quality.nodeCount,
+                                  quality.leafCount,
+                                  quality.referenceCount,
+                                  quality.nodeBytes,
+                                  quality.indexBytes,
+                                  quality.sahCost,
+                                  quality.overlapRatio,
+                                  jsonArray(quality.leafSizes),
+                                  jsonArray(quality.leafDepths));
+            if (m_integrator) {
+                stream << ",\n      \"traversal\": {";
+                bool first = true;
+                for (const auto &[kind, name] : RayKinds) {
+                    const auto statistics = structure.statistics(kind);
+                    stream << tfm::format(
+                        "%s\n        \"%s\": { \"traversals\": %d, "
+                        "\"nodes\": %d, \"primitives\": %d }",
+                        first ? "" : ",",
+                        name,
+                        statistics.traversals,
+                        statistics.nodes,
+                        statistics.primitives);
+                    first = false;
+                }
+                stream << "\n      }";
+            }
+            stream << "\n    }";
+        }
+        stream << "\n  ]\n}\n";
+    }
+};
+
+} // namespace lightwave
+
+REGISTER_TEST(BvhReport, "bvhreport");
@@ -12,6 +12,12 @@ public:
 
     Color evaluate(const Point2 &uv) const override { return m_value; }
 
+    bool scalarRange(const Point2 &a, const Point2 &b, const Point2 &c,
+                     float &min, float &max) const override {
+        min = max = scalar(a);
+        return true;
+    }
+
     std::string toString() const override {
         return tfm::format(
             "ConstantTexture[\n"
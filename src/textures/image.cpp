@@ -103,6 +103,227 @@ namespace lightwave
         return Color(0); // Fallback
     }
 
+    /**
+     * @brief A triangle in texel coordinates (texel [x,y] covers
+     * [x,x+1)x[y,y+1)), together with a range of texel indices that
+     * conservatively bounds which texels it reads.
+     */
+    struct ImageTexture::Footprint {
+        /// @brief The corners of the triangle.
+        Point2 vertices[3];
+        /// @brief The sign of the area of the triangle (zero if it is
+        /// degenerate).
+        float orientation;
+        /// @brief How far beyond its cell a texel contributes to lookups
+        /// (half a texel for bilinear filtering).
+        float margin;
+        /// @brief The inclusive range of texel indices that can be read.
+        Point2i minIndex, maxIndex;
+        /// @brief Whether the triangle itself is tested, or only the index
+        /// range (for triangles outside of clamped images).
+        bool useTriangle;
+
+        /// @brief Returns the edge function of edge @c i at @c p , which is
+        /// positive on the inside of the triangle.
+        float edge(int i, float x, float y) const {
+            const Point2 &a = vertices[i];
+            const Point2 &b = vertices[(i + 1) % 3];
+            return orientation * ((b.x() - a.x()) * (y - a.y()) -
+                           (b.y() - a.y()) * (x - a.x()));
+        }
+
+        /// @brief Tests whether the block of texels [x0,x1)x[y0,y1) could be
+        /// read (@c overlaps ), and whether all of its texels are read for
+        /// certain (@c contained ).
+        void test(int x0, int y0, int x1, int y1, bool &overlaps,
+                  bool &contained) const {
+            overlaps  = x0 <= maxIndex.x() && x1 > minIndex.x() &&
+                       y0 <= maxIndex.y() && y1 > minIndex.y();
+            contained = overlaps && x0 >= minIndex.x() &&
+                        x1 <= maxIndex.x() + 1 && y0 >= minIndex.y() &&
+                        y1 <= maxIndex.y() + 1;
+            if (!overlaps || !useTriangle || orientation == 0)
+                return;
+
+            // separating axis test of the edges against the (grown) block
+            const float corners[4][2] = { { x0 - margin, y0 - margin },
+                                          { x1 + margin, y0 - margin },
+                                          { x0 - margin, y1 + margin },
+                                          { x1 + margin, y1 + margin } };
+            for (int i = 0; i < 3; i++) {
+                float lowest = Infinity, highest = -Infinity;
+                for (const auto &[x, y] : corners) {
+                    const float value = edge(i, x, y);
+                    lowest            = std::min(lowest, value);
+                    highest           = std::max(highest, value);
+                }
+                if (highest < 0) {
+                    overlaps = contained = false;
+                    return;
+                }
+                contained &= lowest >= 0;
+            }
+        }
+    };
+
+    void ImageTexture::buildRangePyramid() const {
+        std::vector<std::pair<float, float>> level(width * height);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                const float value     = m_image->get(Point2i(x, y)).r();
+                level[y * width + x] = { value, value };
+            }
+        }
+        m_rangePyramid.push_back(std::move(level));
+
+        // every level halves the resolution (rounding up) of the one below
+        for (int w = width, h = height; w > 1 || h > 1;) {
+            const auto &fine = m_rangePyramid.back();
+            const int cw = (w + 1) / 2, ch = (h + 1) / 2;
+            std::vector<std::pair<float, float>> coarse(
+                cw * ch, { Infinity, -Infinity });
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    auto &[min, max] = coarse[(y / 2) * cw + x / 2];
+                    min = std::min(min, fine[y * w + x].first);
+                    max = std::max(max, fine[y * w + x].second);
+                }
+            }
+            m_rangePyramid.push_back(std::move(coarse));
+            w = cw;
+            h = ch;
+        }
+    }
+
+    void ImageTexture::rangeWithin(const Footprint &footprint, int level, int x,
+                                   int y, float &min, float &max) const {
+        const int levelWidth = ((width - 1) >> level) + 1;
+        const auto &[blockMin, blockMax] =
+            m_rangePyramid[level][y * levelWidth + x];
+        if (blockMin >= min && blockMax <= max)
+            return; // the block cannot widen the range
+
+        bool overlaps, contained;
+        footprint.test(x << level,
+                       y << level,
+                       std::min((x + 1) << level, width),
+                       std::min((y + 1) << level, height),
+                       overlaps,
+                       contained);
+        if (!overlaps)
+            return;
+        if (contained || level == 0) {
+            min = std::min(min, blockMin);
+            max = std::max(max, blockMax);
+            return;
+        }
+
+        const int childWidth  = ((width - 1) >> (level - 1)) + 1;
+        const int childHeight = ((height - 1) >> (level - 1)) + 1;
+        for (int cy = 2 * y; cy < std::min(2 * y + 2, childHeight); cy++) {
+            for (int cx = 2 * x; cx < std::min(2 * x + 2, childWidth); cx++)
+                rangeWithin(footprint, level - 1, cx, cy, min, max);
+        }
+    }
+
+    bool ImageTexture::scalarRange(const Point2 &a, const Point2 &b,
+                                   const Point2 &c, float &min,
+                                   float &max) const {
+        // beyond this many repetitions (or far away from the origin), the
+        // whole image is used
+        constexpr float MaxTiles = 16;
+        constexpr float MaxTileIndex = 1 << 20;
+
+        if (!m_image)
+            return false;
+        std::call_once(m_rangePyramidBuilt, [&]() { buildRangePyramid(); });
+
+        Footprint footprint;
+        footprint.margin = m_filter == FilterMode::Bilinear ? 0.5f : 0.f;
+        Point2 lower(Infinity), upper(-Infinity);
+        const Point2 uvs[3] = { a, b, c };
+        for (int i = 0; i < 3; i++) {
+            // the same mapping as evaluate() and the filters
+            const Point2 p(uvs[i].x() * width, (1 - uvs[i].y()) * height);
+            if (!std::isfinite(p.x()) || !std::isfinite(p.y()))
+                return false;
+            footprint.vertices[i] = p;
+            lower = elementwiseMin(lower, p);
+            upper = elementwiseMax(upper, p);
+        }
+        const Vector2 e1 = footprint.vertices[1] - footprint.vertices[0];
+        const Vector2 e2 = footprint.vertices[2] - footprint.vertices[0];
+        const float doubleArea = e1.x() * e2.y() - e1.y() * e2.x();
+        footprint.orientation  = doubleArea > 0 ? 1.f
+                                 : doubleArea < 0 ? -1.f
+                                                  : 0.f;
+        lower = lower - Vector2(footprint.margin);
+        upper = upper + Vector2(footprint.margin);
+
+        const Point2i resolution(width, height);
+        const int top = int(m_rangePyramid.size()) - 1;
+        min           = Infinity;
+        max           = -Infinity;
+        if (m_border == BorderMode::Repeat) {
+            // visit every repetition of the image that the triangle touches
+            Point2 firstTile, lastTile;
+            for (int dim = 0; dim < 2; dim++) {
+                firstTile[dim] = std::floor(lower[dim] / resolution[dim]);
+                lastTile[dim]  = std::floor(upper[dim] / resolution[dim]);
+            }
+            if ((lastTile.x() - firstTile.x() + 1) *
+                        (lastTile.y() - firstTile.y() + 1) >
+                    MaxTiles ||
+                std::max(std::abs(firstTile.x()), std::abs(firstTile.y())) >
+                    MaxTileIndex) {
+                std::tie(min, max) = m_rangePyramid[top][0];
+            } else {
+                const Footprint original = footprint;
+                for (int ty = int(firstTile.y()); ty <= int(lastTile.y());
+                     ty++) {
+                    for (int tx = int(firstTile.x()); tx <= int(lastTile.x());
+                         tx++) {
+                        const Vector2 offset(float(tx * width),
+                                             float(ty * height));
+                        for (int i = 0; i < 3; i++)
+                            footprint.vertices[i] =
+                                original.vertices[i] - offset;
+                        for (int dim = 0; dim < 2; dim++) {
+                            footprint.minIndex[dim] = std::max(
+                                int(std::floor(lower[dim] - offset[dim])), 0);
+                            footprint.maxIndex[dim] = std::min(
+                                int(std::floor(upper[dim] - offset[dim])),
+                                resolution[dim] - 1);
+                        }
+                        footprint.useTriangle = true;
+                        rangeWithin(footprint, top, 0, 0, min, max);
+                    }
+                }
+            }
+        } else {
+            // texels outside of the image are clamped to its border, which
+            // the triangle test cannot capture
+            footprint.useTriangle = true;
+            for (int dim = 0; dim < 2; dim++) {
+                footprint.useTriangle &=
+                    lower[dim] >= 0 && upper[dim] <= resolution[dim];
+                footprint.minIndex[dim] = int(std::clamp(
+                    std::floor(lower[dim]), 0.f, float(resolution[dim] - 1)));
+                footprint.maxIndex[dim] = int(std::clamp(
+                    std::floor(upper[dim]), 0.f, float(resolution[dim] - 1)));
+            }
+            rangeWithin(footprint, top, 0, 0, min, max);
+        }
+        if (min > max)
+            return false;
+
+        min *= m_exposure;
+        max *= m_exposure;
+        if (min > max)
+            std::swap(min, max);
+        return true;
+    }
+
 } // namespace lightwave
 
 REGISTER_TEXTURE(ImageTexture, "image")
@@ -0,0 +1,44 @@
+#include <catch_amalgamated.hpp>
+#include <core/checkpoint.hpp>
+
+#include <fstream>
+
+using namespace lightwave;
+
+// clang-format off
+
+TEST_CASE( "Checkpoint tests", "[checkpoint]" ) {
+    const auto file = std::filesystem::temp_directory_path() / "lightwave-test.checkpoint";
+
+    Checkpoint checkpoint( Checkpoint::Mode::Adaptive, 42, Vector2i( 3, 2 ), 64 );
+    for ( int i = 0; i < 6; i++ ) {
+        checkpoint.pixels[i]  = Color( float( i ), 1.f, 2.f );
+        checkpoint.squares[i] = Color( float( i * i ) );
+        checkpoint.samples[i] = 4 * i;
+    }
+
+    SECTION( "Round trip" ) {
+        checkpoint.save( file );
+        const auto loaded = Checkpoint::load( file );
+        REQUIRE( loaded );
+        REQUIRE( loaded->matches( checkpoint ) );
+        for ( int i = 0; i < 6; i++ ) {
+            REQUIRE( loaded->pixels[i] == checkpoint.pixels[i] );
+            REQUIRE( loaded->squares[i] == checkpoint.squares[i] );
+            REQUIRE( loaded->samples[i] == checkpoint.samples[i] );
+        }
+        REQUIRE_FALSE( loaded->matches( Checkpoint( Checkpoint::Mode::Progressive, 42, Vector2i( 3, 2 ), 64 ) ) );
+        // e.g., the scene was edited
+        REQUIRE_FALSE( loaded->matches( Checkpoint( Checkpoint::Mode::Adaptive, 43, Vector2i( 3, 2 ), 64 ) ) );
+    }
+    SECTION( "Missing and damaged files" ) {
+        std::filesystem::remove( file );
+        REQUIRE_FALSE( Checkpoint::load( file ) );
+
+        checkpoint.save( file );
+        std::filesystem::resize_file( file, std::filesystem::file_size( file ) - 4 );
+        REQUIRE_THROWS( Checkpoint::load( file ) );
+    }
+
+    std::filesystem::remove( file );
+}
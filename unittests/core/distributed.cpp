@@ -0,0 +1,123 @@
+#include <catch_amalgamated.hpp>
+#include <core/distributed.hpp>
+#include <lightwave/core.hpp>
+#include <lightwave/logger.hpp>
+
+#include <map>
+
+using namespace lightwave;
+
+// clang-format off
+
+TEST_CASE( "Tile queue tests", "[distributed]" ) {
+    using Renderer = TileQueue::Renderer;
+    TileQueue queue( 3 );
+    queue.skip( 1 );
+
+    SECTION( "Tiles are handed out once" ) {
+        REQUIRE( queue.take( Renderer::Local ) == 0 );
+        REQUIRE( queue.take( Renderer::Remote ) == 2 );
+        // local threads help out with tiles that are out at workers
+        REQUIRE( queue.take( Renderer::Local ) == 2 );
+        REQUIRE( queue.claim( 2 ) );
+        REQUIRE_FALSE( queue.claim( 2 ) );
+        queue.complete( 2 );
+        REQUIRE( queue.claim( 0 ) );
+        queue.complete( 0 );
+        REQUIRE_FALSE( queue.take( Renderer::Local ) );
+    }
+    SECTION( "Tiles of failed workers are handed out again" ) {
+        REQUIRE( queue.take( Renderer::Remote ) == 0 );
+        REQUIRE( queue.take( Renderer::Remote ) == 2 );
+        queue.release( 2 );
+        REQUIRE( queue.take( Renderer::Remote ) == 2 );
+    }
+    SECTION( "Requests can be answered without waiting" ) {
+        REQUIRE( queue.take( Renderer::Remote ) == 0 );
+        REQUIRE( queue.take( Renderer::Remote ) == 2 );
+        REQUIRE_FALSE( queue.take( Renderer::Remote, false ) );
+        REQUIRE_FALSE( queue.finished() );
+        queue.release( 0 );
+        REQUIRE( queue.take( Renderer::Remote, false ) == 0 );
+    }
+    SECTION( "Closing wakes up waiting threads" ) {
+        REQUIRE( queue.take( Renderer::Remote ) == 0 );
+        REQUIRE( queue.take( Renderer::Remote ) == 2 );
+        std::thread closer( [&]() { queue.close(); } );
+        REQUIRE_FALSE( queue.take( Renderer::Remote ) );
+        closer.join();
+    }
+}
+
+#ifndef LW_OS_WINDOWS
+TEST_CASE( "Distributed rendering tests", "[distributed]" ) {
+    constexpr uint64_t Key = 42;
+    std::vector<Bounds2i> tiles;
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            tiles.emplace_back( Point2i( 2 * x, 2 * y ), Point2i( 2 * x + 2, 2 * y + 2 ) );
+        }
+    }
+
+    std::mutex lock;
+    std::map<int, int> deliveries;
+    bool correct = true;
+    TileQueue queue( int( tiles.size() ) );
+    TileCoordinator coordinator( 0, Key, tiles, queue,
+        [&]( int tile, const std::vector<Color> &pixels ) {
+            std::lock_guard guard( lock );
+            deliveries[tile]++;
+            correct &= pixels.size() == 4 &&
+                       std::all_of( pixels.begin(), pixels.end(), [&]( const Color &pixel ) {
+                           return pixel == Color( float( tile ) );
+                       } );
+        } );
+    const std::string address = tfm::format( "127.0.0.1:%d", coordinator.port() );
+
+    // assertions are not thread-safe, hence failures are collected
+    const auto work = [&]( TileWorker &worker ) {
+        int tile;
+        Bounds2i bounds;
+        while (worker.next( tile, bounds )) {
+            if (bounds != tiles[tile]) {
+                std::lock_guard guard( lock );
+                correct = false;
+            }
+            worker.send( tile, std::vector<Color>( 4, Color( float( tile ) ) ) );
+        }
+    };
+
+    SECTION( "Every tile is delivered exactly once" ) {
+        TileWorker first( address, Key );
+        TileWorker second( address, Key );
+        std::thread other( [&]() { work( second ); } );
+        work( first );
+        other.join();
+        REQUIRE( first.tilesSent() + second.tilesSent() == int( tiles.size() ) );
+    }
+    SECTION( "Tiles of disconnected workers are handed out again" ) {
+        TileWorker survivor( address, Key );
+        int abandoned;
+        {
+            TileWorker quitter( address, Key );
+            Bounds2i bounds;
+            REQUIRE( quitter.next( abandoned, bounds ) );
+        }
+        // the survivor is told to retry until the coordinator notices
+        work( survivor );
+        REQUIRE( survivor.tilesSent() == int( tiles.size() ) );
+        REQUIRE( deliveries.count( abandoned ) == 1 );
+    }
+    SECTION( "Workers of other renders are rejected" ) {
+        REQUIRE_THROWS( TileWorker( address, Key + 1 ) );
+        queue.close();
+        return;
+    }
+
+    REQUIRE( queue.finished() );
+    REQUIRE( correct );
+    REQUIRE( deliveries.size() == tiles.size() );
+    for (const auto &[tile, count] : deliveries)
+        REQUIRE( count == 1 );
+}
+#endif
@@ -0,0 +1,37 @@
+#include <catch_amalgamated.hpp>
+#include <lightwave/parallel.hpp>
+
+using namespace lightwave;
+
+// clang-format off
+
+TEST_CASE( "Thread pool tests", "[parallel]" ) {
+    ThreadPool pool( 4 );
+
+    SECTION( "Every index is visited once" ) {
+        std::vector<std::atomic<int>> visits( 10000 );
+        pool.parallelFor( 10000, [&]( int64_t i ) { visits[i]++; }, 7 );
+        for ( const auto &count : visits )
+            REQUIRE( count == 1 );
+    }
+    SECTION( "Nested loops" ) {
+        std::atomic<int64_t> sum = 0;
+        pool.parallelFor( 16, [&]( int64_t i ) {
+            pool.parallelFor( 100, [&]( int64_t j ) { sum += i * 100 + j; } );
+        } );
+        REQUIRE( sum == 1600 * 1599 / 2 );
+    }
+    SECTION( "Exceptions reach the caller" ) {
+        REQUIRE_THROWS_AS( pool.parallelFor( 100, []( int64_t i ) {
+            if ( i == 42 )
+                throw std::runtime_error( "failed" );
+        } ), std::runtime_error );
+    }
+    SECTION( "Futures" ) {
+        auto result = pool.async( [&]() {
+            return pool.isWorker() ? 1 : 0;
+        } );
+        REQUIRE( result.get() == 1 );
+        REQUIRE_FALSE( pool.isWorker() );
+    }
+}
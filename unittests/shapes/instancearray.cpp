@@ -0,0 +1,98 @@
+#include <catch_amalgamated.hpp>
+#include <lightwave.hpp>
+
+#include <fstream>
+
+using namespace lightwave;
+
+// clang-format off
+
+namespace {
+/// @brief The transforms stored in the fixture instances.bin, as the upper 3x4 part of their matrices.
+const float FixtureTransforms[][12] = {
+    { 1, 0, 0, 2,       0, 1, 0, 0,       0, 0, 1, 0 },        // translated
+    { -1, 0, 0, -2,     0, 1, 0, 0,       0, 0, 1, 0 },        // mirrored
+    { 0, 0, 0.5f, 0,    0, 0.5f, 0, 0,    -0.5f, 0, 0, 2 },    // rotated and scaled
+    { 1.5f, 0.25f, 0, 0, 0, 0.75f, 0, 2,  0, 0, 1.25f, -2 },   // sheared
+    { 1, 0, 0, 0,       0, 1, 0, -2,      0, 0, -1, 0 },       // mirrored
+};
+
+/// @brief Places a shape via an instance with the given 3x4 matrix, like an <instance> block of a scene.
+ref<Shape> instance( const ref<Shape> &shape, const float (&values)[12] ) {
+    Matrix4x4 matrix = Matrix4x4::identity();
+    for ( int row = 0; row < 3; row++ )
+        for ( int column = 0; column < 4; column++ )
+            matrix( row, column ) = values[4 * row + column];
+    const auto transform = std::make_shared<Transform>();
+    transform->matrix( matrix );
+    Properties props;
+    props.addChild( std::static_pointer_cast<Object>( shape ) );
+    props.addChild( transform );
+    return std::static_pointer_cast<Shape>( Registry::create( "instance", "default", props ) );
+}
+}
+
+TEST_CASE( "Instance array tests", "[instancearray]" ) {
+    const auto meshes = std::filesystem::path(__FILE__).parent_path() / ".." / ".." / "tests" / "meshes";
+    Properties meshProps;
+    meshProps.set( "filename", (meshes / "bunny.ply").string() );
+    meshProps.set( "bvhCache", std::string() );
+    const auto mesh = std::static_pointer_cast<Shape>( Registry::create( "shape", "mesh", meshProps ) );
+    const auto createArray = [&]( const std::filesystem::path &path ) {
+        Properties props;
+        props.set( "filename", path.string() );
+        props.addChild( std::static_pointer_cast<Object>( mesh ) );
+        return std::static_pointer_cast<Shape>( Registry::create( "shape", "instancearray", props ) );
+    };
+
+    const auto sampler = std::static_pointer_cast<Sampler>( Registry::create( "sampler", "independent", Properties() ) );
+    sampler->seed( 0 );
+
+    SECTION( "Instance arrays match instances with the same transforms" ) {
+        const auto array = createArray( meshes / "instances.bin" );
+        std::vector<ref<Shape>> instances;
+        for ( const auto &values : FixtureTransforms )
+            instances.push_back( instance( mesh, values ) );
+
+        const Bounds bounds = array->getBoundingBox();
+        int hits = 0, mismatches = 0;
+        for ( int i = 0; i < 4096; i++ ) {
+            const Point target = bounds.min() + Vector( sampler->next(), sampler->next(), sampler->next() ) * bounds.diagonal();
+            const Point origin = bounds.center() + squareToUniformSphere( sampler->next2D() ) * bounds.diagonal().length();
+            const Ray ray( origin, ( target - origin ).normalized() );
+            const float tMax = ( target - origin ).length();
+
+            Intersection its, expectedIts;
+            bool expectedHit = false, expectedOcclusion = false;
+            for ( const ref<Shape> &instance : instances ) {
+                expectedHit |= instance->intersect( ray, expectedIts, *sampler );
+                expectedOcclusion |= instance->occluded( ray, tMax, *sampler );
+            }
+            const bool hit = array->intersect( ray, its, *sampler );
+            hits += hit;
+            if ( hit != expectedHit ||
+                 ( hit && ( its.t != Catch::Approx( expectedIts.t ).epsilon( 1e-4 ) ||
+                            ( its.position - expectedIts.position ).length() > 1e-3f ||
+                            its.geometryNormal.dot( expectedIts.geometryNormal ) < 0.999f ||
+                            its.shadingNormal.dot( expectedIts.shadingNormal ) < 0.999f ) ) ||
+                 array->occluded( ray, tMax, *sampler ) != expectedOcclusion )
+                mismatches++;
+        }
+        REQUIRE( hits > 0 );
+        REQUIRE( mismatches == 0 );
+    }
+    SECTION( "Transforms must be invertible" ) {
+        const auto path = std::filesystem::temp_directory_path() / "lightwave_singular_instances.bin";
+        {
+            // the second transform collapses the z axis
+            const float values[2][12] = {
+                { 1, 0, 0, 0,   0, 1, 0, 0,   0, 0, 1, 0 },
+                { 1, 0, 0, 0,   0, 1, 0, 0,   0, 0, 0, 1 },
+            };
+            std::ofstream stream( path, std::ios::binary );
+            stream.write( reinterpret_cast<const char *>( values ), sizeof( values ) );
+        }
+        REQUIRE_THROWS( createArray( path ) );
+        std::filesystem::remove( path );
+    }
+}
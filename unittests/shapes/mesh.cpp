@@ -0,0 +1,244 @@
+#include <catch_amalgamated.hpp>
+#include <lightwave.hpp>
+#include <core/plyparser.hpp>
+#include <shapes/accel.hpp>
+#include <shapes/mesh.hpp>
+
+#include <random>
+
+using namespace lightwave;
+
+// Hidden by default, run with: ./deerling -r console "[benchmark]"
+TEST_CASE( "BVH traversal benchmark", "[.][benchmark]" ) {
+    const auto meshes = std::filesystem::path(__FILE__).parent_path() / ".." / ".." / "tests" / "meshes";
+    const char *filename = GENERATE( "bunny.ply", "sibenik.ply", "rubber_duck_toy_1k.ply" );
+    const int width = GENERATE( 2, 4, 8 );
+    // depth-first renumbered nodes, or nodes in the order the build claimed them
+    const bool reorder = GENERATE( true, false );
+
+    Properties props;
+    props.set( "filename", (meshes / filename).string() );
+    props.set( "bvhWidth", width );
+    props.set( "bvhReorder", reorder );
+    props.set( "bvhCache", std::string() );
+    const auto mesh = std::static_pointer_cast<Shape>( Registry::create( "shape", "mesh", props ) );
+
+    const auto sampler = std::static_pointer_cast<Sampler>( Registry::create( "sampler", "independent", Properties() ) );
+    sampler->seed( 0 );
+
+    // rays from a sphere around the mesh towards random points inside of it
+    const Bounds bounds = mesh->getBoundingBox();
+    const Vector extent = bounds.diagonal();
+    const auto pointInside = [&]() {
+        return bounds.min() + Vector( sampler->next(), sampler->next(), sampler->next() ) * extent;
+    };
+    std::vector<Ray> rays;
+    for ( int i = 0; i < 16384; i++ ) {
+        const Point target = pointInside();
+        const Point origin = bounds.center() + squareToUniformSphere( sampler->next2D() ) * extent.length();
+        rays.push_back( Ray( origin, ( target - origin ).normalized() ) );
+    }
+
+    BENCHMARK( tfm::format( "%s, %d-wide, %s (16384 rays)", filename, width, reorder ? "reordered" : "build order" ) ) {
+        int hits = 0;
+        for ( const Ray &ray : rays ) {
+            Intersection its;
+            hits += mesh->intersect( ray, its, *sampler );
+        }
+        return hits;
+    };
+}
+
+namespace {
+/// @brief An alpha mask that is transparent for u < 0.5 and opaque elsewhere.
+class HalfTexture : public Texture {
+public:
+    Color evaluate( const Point2 &uv ) const override { return Color( uv.x() < 0.5f ? 0.0f : 1.0f ); }
+
+    bool scalarRange( const Point2 &a, const Point2 &b, const Point2 &c, float &min, float &max ) const override {
+        min = scalar( Point2( std::min( { a.x(), b.x(), c.x() } ), 0 ) );
+        max = scalar( Point2( std::max( { a.x(), b.x(), c.x() } ), 0 ) );
+        return true;
+    }
+
+    std::string toString() const override { return "HalfTexture[]"; }
+};
+
+/// @brief A ray from outside of a mesh towards a random point inside of it, with the distance to that point.
+struct TestRay {
+    Ray ray;
+    float tMax;
+};
+
+std::vector<TestRay> randomRays( const Bounds &bounds, Sampler &sampler, int count ) {
+    std::vector<TestRay> rays;
+    for ( int i = 0; i < count; i++ ) {
+        const Point target = bounds.min() + Vector( sampler.next(), sampler.next(), sampler.next() ) * bounds.diagonal();
+        const Point origin = bounds.center() + squareToUniformSphere( sampler.next2D() ) * bounds.diagonal().length();
+        rays.push_back( { Ray( origin, ( target - origin ).normalized() ), ( target - origin ).length() } );
+    }
+    // rays along the coordinate axes, whose directions have exact zeros (which random directions never do)
+    for ( int i = 0; i < count / 4; i++ ) {
+        const Point target = bounds.min() + Vector( sampler.next(), sampler.next(), sampler.next() ) * bounds.diagonal();
+        const int axis  = i % 3;
+        const float sign = i % 2 ? -1 : +1;
+        Vector direction( 0 );
+        direction[axis] = sign;
+        Point origin = target;
+        origin[axis] = ( sign > 0 ? bounds.min() : bounds.max() )[axis] - sign * bounds.diagonal()[axis];
+        rays.push_back( { Ray( origin, direction ), std::abs( target[axis] - origin[axis] ) } );
+    }
+    return rays;
+}
+
+/// @brief Counts the rays for which two shapes disagree on the closest hit or on occlusion.
+int countMismatches( const Shape &shape, const Shape &expected, const std::vector<TestRay> &rays, Sampler &sampler ) {
+    int mismatches = 0;
+    for ( const auto &[ray, tMax] : rays ) {
+        Intersection its, expectedIts;
+        const bool hit = shape.intersect( ray, its, sampler );
+        if ( hit != expected.intersect( ray, expectedIts, sampler ) ||
+             ( hit && its.t != Catch::Approx( expectedIts.t ).epsilon( 1e-4 ) ) ||
+             shape.occluded( ray, tMax, sampler ) != expected.occluded( ray, tMax, sampler ) )
+            mismatches++;
+    }
+    return mismatches;
+}
+}
+
+TEST_CASE( "BVH traversal tests", "[mesh]" ) {
+    const auto meshes = std::filesystem::path(__FILE__).parent_path() / ".." / ".." / "tests" / "meshes";
+    const char *filename = GENERATE( "bunny.ply", "sibenik.ply" );
+    const auto [builder, width, quantization, spatialSplits] = GENERATE( table<std::string, int, int, bool>( {
+        { "sah", 4, 0, false }, { "sah", 8, 0, false }, { "sah", 4, 8, false }, { "sah", 8, 8, false },
+        { "sah", 4, 16, false }, { "sah", 8, 16, false },
+        { "sah", 2, 0, true }, { "sah", 4, 0, true }, { "sah", 8, 0, true }, { "sah", 8, 8, true },
+        { "lbvh", 2, 0, false }, { "lbvh", 8, 8, false }, { "hlbvh", 2, 0, false }, { "hlbvh", 8, 8, false } } ) );
+    constexpr float DuplicationBudget = 0.3f;
+    const auto createMesh = [&]( Properties props ) {
+        props.set( "filename", (meshes / filename).string() );
+        props.set( "bvhCache", std::string() );
+        return std::static_pointer_cast<AccelerationStructure>( Registry::create( "shape", "mesh", props ) );
+    };
+
+    const auto sampler = std::static_pointer_cast<Sampler>( Registry::create( "sampler", "independent", Properties() ) );
+    sampler->seed( 0 );
+
+    // wide BVHs are collapsed from binary ones, which are traversed differently,
+    // quantized ones bound their children conservatively, and the Morton code
+    // builders produce entirely different trees
+    const auto reference = createMesh( Properties() );
+    Properties props;
+    props.set( "bvhBuilder", builder );
+    props.set( "bvhWidth", width );
+    props.set( "bvhQuantization", quantization );
+    if ( spatialSplits ) {
+        props.set( "spatialSplits", true );
+        props.set( "duplicationBudget", DuplicationBudget );
+    }
+    const auto mesh = createMesh( props );
+    const auto rays = randomRays( reference->getBoundingBox(), *sampler, 4096 );
+    INFO( builder << " " << width << " " << quantization << " " << spatialSplits );
+    REQUIRE( countMismatches( *mesh, *reference, rays, *sampler ) == 0 );
+
+    // without spatial splits, every triangle is referenced once
+    const size_t triangleCount  = reference->quality().referenceCount;
+    const size_t referenceCount = mesh->quality().referenceCount;
+    if ( spatialSplits ) {
+        REQUIRE( referenceCount > triangleCount );
+        REQUIRE( referenceCount <= size_t( triangleCount * ( 1 + DuplicationBudget ) ) );
+    } else {
+        REQUIRE( referenceCount == triangleCount );
+    }
+}
+
+TEST_CASE( "BVH refit tests", "[mesh]" ) {
+    const auto path = std::filesystem::path(__FILE__).parent_path() / ".." / ".." / "tests" / "meshes" / "bunny.ply";
+    const auto [width, quantization] = GENERATE( table<int, int>( {
+        { 2, 0 }, { 4, 0 }, { 8, 0 }, { 4, 8 }, { 8, 8 }, { 4, 16 }, { 8, 16 } } ) );
+    const auto createMesh = [&]( float rebuildThreshold ) {
+        Properties props;
+        props.set( "filename", path.string() );
+        props.set( "bvhWidth", width );
+        props.set( "bvhQuantization", quantization );
+        props.set( "bvhRebuildThreshold", rebuildThreshold );
+        props.set( "bvhCache", std::string() );
+        return std::static_pointer_cast<Shape>( Registry::create( "shape", "mesh", props ) );
+    };
+    const auto alpha = std::make_shared<HalfTexture>();
+
+    const auto sampler = std::static_pointer_cast<Sampler>( Registry::create( "sampler", "independent", Properties() ) );
+    sampler->seed( 0 );
+
+    std::vector<Vector3i> triangles;
+    std::vector<Vertex> vertices;
+    readPLY( path, triangles, vertices );
+
+    SECTION( "Refit BVHs find the same hits as new ones" ) {
+        // a small perturbation, which refitting handles well
+        const auto mesh       = createMesh( Infinity );
+        const auto masked     = alphaMaskedMesh( mesh, alpha );
+        const Vector extent   = mesh->getBoundingBox().diagonal();
+        for ( Vertex &vertex : vertices )
+            vertex.position += Vector( sampler->next() - 0.5f, sampler->next() - 0.5f, sampler->next() - 0.5f ) * extent * 0.01f;
+        REQUIRE( setMeshVertices( mesh, vertices ) );
+
+        // any refit exceeds a threshold of zero, so this BVH is built anew
+        const auto reference = createMesh( 0 );
+        REQUIRE_FALSE( setMeshVertices( reference, vertices ) );
+        const auto referenceMasked = alphaMaskedMesh( reference, alpha );
+        // its mask was set up before the rebuild, and needs to follow it
+        const auto rebuilt       = createMesh( 0 );
+        const auto rebuiltMasked = alphaMaskedMesh( rebuilt, alpha );
+        REQUIRE_FALSE( setMeshVertices( rebuilt, vertices ) );
+
+        const Bounds bounds = reference->getBoundingBox();
+        REQUIRE( mesh->getBoundingBox().diagonal().length() == Catch::Approx( bounds.diagonal().length() ) );
+
+        const auto rays = randomRays( bounds, *sampler, 4096 );
+        REQUIRE( countMismatches( *mesh, *reference, rays, *sampler ) == 0 );
+        REQUIRE( countMismatches( *masked, *referenceMasked, rays, *sampler ) == 0 );
+        REQUIRE( countMismatches( *rebuiltMasked, *referenceMasked, rays, *sampler ) == 0 );
+    }
+
+    SECTION( "BVHs are rebuilt once refitting degrades them too much" ) {
+        const auto mesh = createMesh( 1.5f );
+        // scrambling the vertices stretches all triangles across the mesh
+        std::vector<Point> positions;
+        for ( const Vertex &vertex : vertices )
+            positions.push_back( vertex.position );
+        std::shuffle( positions.begin(), positions.end(), std::mt19937( 0 ) );
+        for ( size_t i = 0; i < vertices.size(); i++ )
+            vertices[i].position = positions[i];
+        REQUIRE_FALSE( setMeshVertices( mesh, vertices ) );
+    }
+}
+
+TEST_CASE( "BVH cache tests", "[mesh]" ) {
+    const auto path  = std::filesystem::path(__FILE__).parent_path() / ".." / ".." / "tests" / "meshes" / "bunny.ply";
+    const auto scene = std::filesystem::temp_directory_path() / "lightwave_bvh_cache_test";
+    std::filesystem::remove_all( scene );
+    std::filesystem::create_directories( scene );
+    const auto createMesh = [&]( const std::string &cache ) {
+        // properties of a mesh in a scene file stored in the directory above
+        Properties props( scene );
+        props.set( "filename", path.string() );
+        props.set( "bvhCache", cache );
+        return Registry::create( "shape", "mesh", props );
+    };
+    const auto countFiles = [&]() {
+        return std::distance( std::filesystem::recursive_directory_iterator( scene ),
+                              std::filesystem::recursive_directory_iterator() );
+    };
+
+    SECTION( "An empty cache directory disables caching" ) {
+        createMesh( "" );
+        REQUIRE( countFiles() == 0 );
+    }
+    SECTION( "Cache directories are relative to the scene" ) {
+        createMesh( "cache" );
+        REQUIRE( std::filesystem::is_directory( scene / "cache" ) );
+        REQUIRE( countFiles() == 2 );
+    }
+    std::filesystem::remove_all( scene );
+}
@@ -0,0 +1,99 @@
+#include <catch_amalgamated.hpp>
+#include <lightwave.hpp>
+
+#include <fstream>
+
+using namespace lightwave;
+
+// clang-format off
+
+namespace {
+/// @brief The spheres stored in the fixtures spheres.bin and spheres.ply (and, without radii, points.ply).
+const std::pair<Point, float> FixtureSpheres[] = {
+    { Point( 0, 0, 0 ), 1 },      { Point( 2.5f, 0, 0 ), 0.5f },   { Point( -2, 1, 0.5f ), 0.75f },
+    { Point( 0, 2, -1 ), 0.25f }, { Point( 1, -1.5f, 1 ), 0.6f },  { Point( -1, -1, -2 ), 1.2f },
+    { Point( 3, 2, 1 ), 0.1f },   { Point( 0.5f, 0.5f, 2.5f ), 0.4f },
+};
+
+/// @brief Places a unit sphere at the given center and radius via an instance.
+ref<Shape> sphereInstance( const Point &center, float radius ) {
+    const auto transform = std::make_shared<Transform>();
+    transform->scale( Vector( radius ) );
+    transform->translate( Vector( center ) );
+    Properties props;
+    props.addChild( std::static_pointer_cast<Object>( Registry::create( "shape", "sphere", Properties() ) ) );
+    props.addChild( transform );
+    return std::static_pointer_cast<Shape>( Registry::create( "instance", "default", props ) );
+}
+
+/// @brief Counts the rays for which the spheres disagree with the instances on the closest hit or on occlusion.
+int countMismatches( const Shape &spheres, const std::vector<ref<Shape>> &instances, Sampler &sampler ) {
+    const Bounds bounds = spheres.getBoundingBox();
+    int mismatches = 0;
+    for ( int i = 0; i < 4096; i++ ) {
+        const Point target = bounds.min() + Vector( sampler.next(), sampler.next(), sampler.next() ) * bounds.diagonal();
+        const Point origin = bounds.center() + squareToUniformSphere( sampler.next2D() ) * bounds.diagonal().length();
+        const Ray ray( origin, ( target - origin ).normalized() );
+        const float tMax = ( target - origin ).length();
+
+        Intersection its, expectedIts;
+        bool expectedHit = false, expectedOcclusion = false;
+        for ( const ref<Shape> &instance : instances ) {
+            expectedHit |= instance->intersect( ray, expectedIts, sampler );
+            expectedOcclusion |= instance->occluded( ray, tMax, sampler );
+        }
+        const bool hit = spheres.intersect( ray, its, sampler );
+        if ( hit != expectedHit ||
+             ( hit && ( its.t != Catch::Approx( expectedIts.t ).epsilon( 1e-4 ) ||
+                        ( its.position - expectedIts.position ).length() > 1e-3f ||
+                        its.geometryNormal.dot( expectedIts.geometryNormal ) < 0.999f ) ) ||
+             spheres.occluded( ray, tMax, sampler ) != expectedOcclusion )
+            mismatches++;
+    }
+    return mismatches;
+}
+}
+
+TEST_CASE( "Spheres tests", "[spheres]" ) {
+    const auto meshes = std::filesystem::path(__FILE__).parent_path() / ".." / ".." / "tests" / "meshes";
+    const auto createSpheres = [&]( const std::filesystem::path &path, float radius = 1 ) {
+        Properties props;
+        props.set( "filename", path.string() );
+        props.set( "radius", radius );
+        props.set( "bvhCache", std::string() );
+        return std::static_pointer_cast<Shape>( Registry::create( "shape", "spheres", props ) );
+    };
+
+    const auto sampler = std::static_pointer_cast<Sampler>( Registry::create( "sampler", "independent", Properties() ) );
+    sampler->seed( 0 );
+
+    std::vector<ref<Shape>> instances;
+    for ( const auto &[center, radius] : FixtureSpheres )
+        instances.push_back( sphereInstance( center, radius ) );
+
+    SECTION( "Binary files match sphere instances" ) {
+        const auto spheres = createSpheres( meshes / "spheres.bin" );
+        REQUIRE( countMismatches( *spheres, instances, *sampler ) == 0 );
+    }
+    SECTION( "PLY files match sphere instances" ) {
+        const auto spheres = createSpheres( meshes / "spheres.ply" );
+        REQUIRE( countMismatches( *spheres, instances, *sampler ) == 0 );
+    }
+    SECTION( "PLY files without radii use the radius property" ) {
+        const auto spheres = createSpheres( meshes / "points.ply", 0.3f );
+        instances.clear();
+        for ( const auto &[center, radius] : FixtureSpheres )
+            instances.push_back( sphereInstance( center, 0.3f ) );
+        REQUIRE( countMismatches( *spheres, instances, *sampler ) == 0 );
+    }
+    SECTION( "Binary files must consist of whole spheres" ) {
+        const auto path = std::filesystem::temp_directory_path() / "lightwave_truncated_spheres.bin";
+        {
+            std::ofstream stream( path, std::ios::binary );
+            const float values[5] = { 0, 0, 0, 1, 0 };
+            stream.write( reinterpret_cast<const char *>( values ), sizeof( values ) );
+        }
+        REQUIRE_THROWS( createSpheres( path ) );
+        std::filesystem::remove( path );
+    }
+}
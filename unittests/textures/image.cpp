@@ -0,0 +1,106 @@
+#include <catch_amalgamated.hpp>
+#include <lightwave.hpp>
+
+using namespace lightwave;
+
+// clang-format off
+
+namespace {
+/// @brief A random triangle in texture space, with corners within [lo,hi)^2.
+struct TestTriangle {
+    Point2 a, b, c;
+};
+
+Point2 randomPoint( Sampler &sampler, float lo, float hi ) {
+    return Point2( lo + ( hi - lo ) * sampler.next(), lo + ( hi - lo ) * sampler.next() );
+}
+
+/// @brief Counts the points of a triangle (its corners, and random points inside of it and on its edges) at which
+/// the texture leaves the range reported by scalarRange() (which needs to be conservative).
+int countOutliers( const Texture &texture, const TestTriangle &triangle, Sampler &sampler ) {
+    float min, max;
+    REQUIRE( texture.scalarRange( triangle.a, triangle.b, triangle.c, min, max ) );
+    REQUIRE( min <= max );
+
+    const auto outside = [&]( const Point2 &uv ) {
+        const float value = texture.scalar( uv );
+        return value < min - 1e-5f || value > max + 1e-5f;
+    };
+    const Vector2 e1 = triangle.b - triangle.a;
+    const Vector2 e2 = triangle.c - triangle.a;
+    int outliers = outside( triangle.a ) + outside( triangle.b ) + outside( triangle.c );
+    for ( int i = 0; i < 256; i++ ) {
+        Point2 barycentrics = sampler.next2D();
+        if ( barycentrics.x() + barycentrics.y() > 1 )
+            barycentrics = Point2( 1 - barycentrics.x(), 1 - barycentrics.y() );
+        outliers += outside( triangle.a + barycentrics.x() * e1 + barycentrics.y() * e2 );
+        // points on the edges, where the footprint is tightest
+        const float t = sampler.next();
+        outliers += outside( triangle.a + t * e1 ) + outside( triangle.a + t * e2 ) +
+                    outside( triangle.b + t * ( triangle.c - triangle.b ) );
+    }
+    return outliers;
+}
+}
+
+TEST_CASE( "Image texture tests", "[texture]" ) {
+    const std::string border = GENERATE( "repeat", "clamp" );
+    const std::string filter = GENERATE( "nearest", "bilinear" );
+
+    const auto sampler = std::static_pointer_cast<Sampler>( Registry::create( "sampler", "independent", Properties() ) );
+    sampler->seed( 0 );
+
+    // odd sizes, so that the blocks at the borders of the range pyramid are cut off
+    const auto image = std::make_shared<Image>( Point2i( 13, 7 ) );
+    for ( int y = 0; y < 7; y++ )
+        for ( int x = 0; x < 13; x++ )
+            image->get( Point2i( x, y ) ) = Color( sampler->next() );
+    Properties props;
+    props.set( "border", border );
+    props.set( "filter", filter );
+    props.set( "exposure", 2.f );
+    props.addChild( image );
+    const auto texture = std::static_pointer_cast<Texture>( Registry::create( "texture", "image", props ) );
+
+    const auto countAllOutliers = [&]( float lo, float hi ) {
+        int outliers = 0;
+        for ( int i = 0; i < 512; i++ ) {
+            // small triangles are bounded by few texels, and most prone to being bounded too tightly
+            const Point2 a    = randomPoint( *sampler, lo, hi );
+            const float size = i % 2 ? 0.05f : 1.f;
+            outliers += countOutliers( *texture, { a, a + size * ( randomPoint( *sampler, 0, 1 ) - Point2( 0.5f ) ),
+                                                   a + size * ( randomPoint( *sampler, 0, 1 ) - Point2( 0.5f ) ) }, *sampler );
+        }
+        return outliers;
+    };
+
+    SECTION( "Ranges cover triangles within the image" ) {
+        REQUIRE( countAllOutliers( 0, 1 ) == 0 );
+    }
+    SECTION( "Ranges cover triangles beyond the image" ) {
+        // repeated (or clamped) images, up to beyond the number of tiles that are visited individually
+        REQUIRE( countAllOutliers( -1.5f, 2.5f ) == 0 );
+        REQUIRE( countAllOutliers( -8, 8 ) == 0 );
+    }
+    SECTION( "Ranges cover degenerate triangles" ) {
+        int outliers = 0;
+        for ( int i = 0; i < 512; i++ ) {
+            const Point2 a = randomPoint( *sampler, -1.5f, 2.5f );
+            const Point2 b = randomPoint( *sampler, -1.5f, 2.5f );
+            // collinear corners, and all corners at the same point
+            outliers += countOutliers( *texture, { a, b, a + 0.3f * ( b - a ) }, *sampler );
+            outliers += countOutliers( *texture, { a, a, a }, *sampler );
+        }
+        REQUIRE( outliers == 0 );
+    }
+    SECTION( "Ranges are exact for single texels" ) {
+        // with nearest filtering, a tiny triangle within a texel only reads that texel
+        if ( filter == "nearest" ) {
+            const Point2 uv( 4.5f / 13, 1 - 2.5f / 7 );
+            float min, max;
+            REQUIRE( texture->scalarRange( uv, uv + Vector2( 0.01f, 0 ), uv + Vector2( 0, 0.01f ), min, max ) );
+            REQUIRE( min == Catch::Approx( 2 * image->get( Point2i( 4, 2 ) ).r() ) );
+            REQUIRE( max == Catch::Approx( 2 * image->get( Point2i( 4, 2 ) ).r() ) );
+        }
+    }
+}